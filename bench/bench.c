@@ -0,0 +1,659 @@
+// microbenchmarks of the message and packet paths, run with `make bench`
+//
+// server.c is included rather than linked so its static dispatch and broadcast functions can be
+// driven directly, with the same client table and I/O thread the server would use. Results are
+// printed as one tab separated line per benchmark, with the heap bytes and allocations made per
+// operation counted through SDL's memory functions, so runs of two versions can be diffed.
+
+#include "server.c"
+
+#define BENCH_MIN_TIME 0.2
+#define BENCH_MAX_ITERATIONS 100000000
+
+enum sample
+{
+    SAMPLE_ID,
+    SAMPLE_CHAT,
+    SAMPLE_MOUSE,
+    SAMPLE_INPUT,
+    SAMPLE_ACK,
+    SAMPLE_PING,
+    SAMPLE_SNAPSHOT,
+    SAMPLE_DELTA,
+    SAMPLE_CATCH_UP,
+    NUM_SAMPLES
+};
+
+// a message of each shape, and its encoding
+struct sample_message
+{
+    union data_any message;
+    unsigned char encoded[DATA_MAX_ENCODED_SIZE];
+    int len;
+};
+
+static struct sample_message samples[NUM_SAMPLES];
+static struct snapshot_data baseline_snapshot;
+static struct snapshot_data full_snapshot;
+static char chat_texts[16][32];
+
+// results are folded into this so the compiler can't drop the work
+static volatile unsigned int sink;
+
+// what the benchmarks of the server's output sent each client per operation, or the size of the
+// message encoded or decoded
+static double client_bytes;
+
+// where the server's UDP replies go, nothing ever reads it
+static UDPsocket udp_sink;
+static IPaddress udp_sink_address;
+static UDPsocket udp_sender;
+static UDPpacket **bench_packets;
+
+static SDLNet_Wakeup *logic_wakeup;
+
+struct benchmark
+{
+    const char *name;
+    void (*run)(int iterations, int arg);
+    int arg;
+};
+
+static void fill_snapshot(struct snapshot_data *snapshot, unsigned int sequence, int moved)
+{
+    *snapshot = snapshot_data_create(DATA_SNAPSHOT, sequence, sequence * 33);
+    snapshot->num_clients = SNAPSHOT_MAX_CLIENTS;
+    for (int i = 0; i < SNAPSHOT_MAX_CLIENTS; i++)
+    {
+        struct client_state *state = &snapshot->clients[i];
+        state->id = (1 << CLIENT_SLOT_BITS) | i;
+        state->x = (i * 37 + (i < moved ? 5 : 0)) % WORLD_WIDTH;
+        state->y = (i * 23) % WORLD_HEIGHT;
+        state->buttons = 0;
+    }
+}
+
+// every sample has to decode to what re-encodes to the same bytes, or the benchmarks would be of
+// a broken format
+static bool setup_samples(void)
+{
+    // a quarter of the clients moved since the baseline, a typical delta
+    fill_snapshot(&baseline_snapshot, 1, 0);
+    fill_snapshot(&full_snapshot, 2, SNAPSHOT_MAX_CLIENTS / 4);
+
+    samples[SAMPLE_ID].message.id_data = id_data_create(DATA_CONNECT_BROADCAST, 65537);
+    samples[SAMPLE_CHAT].message.chat_data = chat_data_create(DATA_CHAT_BROADCAST, 65537, "Hello, World!");
+    samples[SAMPLE_MOUSE].message.mouse_data = mouse_data_create(DATA_MOUSEDOWN_REQUEST, 65537, 400, 300);
+    samples[SAMPLE_INPUT].message.input_data = input_data_create(DATA_INPUT_REQUEST, 65537, 400, 300, 1);
+    samples[SAMPLE_ACK].message.ack_data = ack_data_create(DATA_SNAPSHOT_ACK, 65537, 1);
+    samples[SAMPLE_PING].message.ping_data = ping_data_create(DATA_PING, 65537, 123456, 0);
+    samples[SAMPLE_SNAPSHOT].message.snapshot_data = full_snapshot;
+    samples[SAMPLE_DELTA].message.delta_data = delta_data_create(DATA_SNAPSHOT_DELTA, &baseline_snapshot, &full_snapshot);
+
+    // clients and the load generator's chats, as many of each as fill about one catch-up message
+    struct catch_up_data *catch_up_data = &samples[SAMPLE_CATCH_UP].message.catch_up_data;
+    *catch_up_data = catch_up_data_create(DATA_CATCH_UP);
+    for (int i = 0; i < 16; i++)
+    {
+        catch_up_data->clients[catch_up_data->num_clients++] = (1 << CLIENT_SLOT_BITS) | i;
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        snprintf(chat_texts[i], sizeof(chat_texts[i]), "bench %llu", 81985529216486895ull + (unsigned long long)i * 7919);
+        catch_up_data->chats[catch_up_data->num_chats++] = chat_data_create(DATA_CHAT_BROADCAST, (1 << CLIENT_SLOT_BITS) | i, chat_texts[i]);
+    }
+
+    for (int i = 0; i < NUM_SAMPLES; i++)
+    {
+        samples[i].len = data_encode(&samples[i].message.data, samples[i].encoded, sizeof(samples[i].encoded));
+
+        union data_any decoded;
+        unsigned char encoded[DATA_MAX_ENCODED_SIZE];
+        if (samples[i].len == -1 ||
+            data_decode(&decoded, samples[i].encoded, samples[i].len) != samples[i].len ||
+            data_encode(&decoded.data, encoded, sizeof(encoded)) != samples[i].len ||
+            memcmp(encoded, samples[i].encoded, samples[i].len) != 0)
+        {
+            log_error("%s doesn't survive a round trip", data_type_name(samples[i].message.data.type));
+            return false;
+        }
+    }
+
+    // and the catch-up has to come back out of compression the same
+    compressor = compressor_alloc();
+    if (!compressor)
+    {
+        log_error("%s", SDLNet_GetError());
+        return false;
+    }
+
+    const struct sample_message *sample = &samples[SAMPLE_CATCH_UP];
+    unsigned char compressed[DATA_MAX_ENCODED_SIZE];
+    unsigned char decompressed[DATA_MAX_ENCODED_SIZE];
+    int compressed_len = compress_message(compressor, sample->encoded, sample->len, compressed, sizeof(compressed));
+    if (compressed_len == -1 ||
+        decompress_message(compressed, compressed_len, decompressed, sizeof(decompressed)) != sample->len ||
+        memcmp(decompressed, sample->encoded, sample->len) != 0)
+    {
+        log_error("catch_up doesn't survive compression");
+        return false;
+    }
+
+    return true;
+}
+
+// clients on the I/O thread without a connection, which it drops whatever is sent to
+static struct client *add_clients(int count)
+{
+    while (num_clients > count)
+    {
+        close_client(&clients[active_clients[num_clients - 1]]);
+    }
+
+    while (num_clients < count)
+    {
+        int slot = alloc_client();
+        if (slot == -1)
+        {
+            return NULL;
+        }
+
+        struct client *client = &clients[slot];
+        snprintf(client->address, sizeof(client->address), "bench:%d", slot);
+        client->io = io_threads[0];
+        client->joined = true;
+        if (!connect_udp(client, &udp_sink_address))
+        {
+            return NULL;
+        }
+    }
+
+    return &clients[active_clients[0]];
+}
+
+/* Constructors */
+
+static void bench_create_id(int iterations, int arg)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        struct id_data id_data = id_data_create(DATA_CONNECT_BROADCAST, i);
+        sink += (unsigned int)id_data.id;
+    }
+}
+
+static void bench_create_chat(int iterations, int arg)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        struct chat_data chat_data = chat_data_create(DATA_CHAT_REQUEST, i, "Hello, World!");
+        sink += (unsigned int)chat_data.length;
+    }
+}
+
+static void bench_create_mouse(int iterations, int arg)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        struct mouse_data mouse_data = mouse_data_create(DATA_MOUSEDOWN_REQUEST, i, i, i);
+        sink += (unsigned int)mouse_data.x;
+    }
+}
+
+static void bench_create_input(int iterations, int arg)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        struct input_data input_data = input_data_create(DATA_INPUT_REQUEST, i, i, i, 1);
+        sink += (unsigned int)input_data.x;
+    }
+}
+
+static void bench_create_ack(int iterations, int arg)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        struct ack_data ack_data = ack_data_create(DATA_SNAPSHOT_ACK, i, (unsigned int)i);
+        sink += ack_data.sequence;
+    }
+}
+
+static void bench_create_ping(int iterations, int arg)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        struct ping_data ping_data = ping_data_create(DATA_PING, i, (unsigned int)i, 0);
+        sink += ping_data.client_time;
+    }
+}
+
+static void bench_create_snapshot(int iterations, int arg)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        struct snapshot_data snapshot_data = snapshot_data_create(DATA_SNAPSHOT, (unsigned int)i, 0);
+        sink += snapshot_data.sequence;
+    }
+}
+
+static void bench_create_delta(int iterations, int arg)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        struct delta_data delta_data = delta_data_create(DATA_SNAPSHOT_DELTA, &baseline_snapshot, &full_snapshot);
+        sink += (unsigned int)delta_data.num_changed;
+    }
+}
+
+/* Encoding */
+
+static void bench_encode(int iterations, int arg)
+{
+    unsigned char buffer[DATA_MAX_ENCODED_SIZE];
+    const struct data *data = &samples[arg].message.data;
+    for (int i = 0; i < iterations; i++)
+    {
+        sink += (unsigned int)data_encode(data, buffer, sizeof(buffer));
+    }
+
+    client_bytes = samples[arg].len;
+}
+
+static void bench_decode(int iterations, int arg)
+{
+    union data_any message;
+    const struct sample_message *sample = &samples[arg];
+    for (int i = 0; i < iterations; i++)
+    {
+        sink += (unsigned int)data_decode(&message, sample->encoded, sample->len);
+    }
+
+    client_bytes = sample->len;
+}
+
+/* Compression */
+
+static void bench_compress(int iterations, int arg)
+{
+    const struct sample_message *sample = &samples[arg];
+    unsigned char compressed[DATA_MAX_ENCODED_SIZE];
+    int len = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        len = compress_message(compressor, sample->encoded, sample->len, compressed, sizeof(compressed));
+        sink += (unsigned int)len;
+    }
+
+    client_bytes = len;
+}
+
+static void bench_decompress(int iterations, int arg)
+{
+    const struct sample_message *sample = &samples[arg];
+    unsigned char compressed[DATA_MAX_ENCODED_SIZE];
+    unsigned char decompressed[DATA_MAX_ENCODED_SIZE];
+    int len = compress_message(compressor, sample->encoded, sample->len, compressed, sizeof(compressed));
+    for (int i = 0; i < iterations; i++)
+    {
+        sink += (unsigned int)decompress_message(compressed, len, decompressed, sizeof(decompressed));
+    }
+
+    client_bytes = len;
+}
+
+/* Packets */
+
+static void bench_tcp_packet(int iterations, int arg)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        TCPpacket *packet = SDLNet_TCP_AllocPacket(PACKET_SIZE);
+        sink += (unsigned int)packet->size;
+        SDLNet_TCP_FreePacket(packet);
+    }
+}
+
+static void bench_udp_packet(int iterations, int arg)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        UDPpacket *packet = SDLNet_UDP_AllocPacket(PACKET_SIZE);
+        sink += (unsigned int)packet->maxlen;
+        SDLNet_UDP_FreePacket(packet);
+    }
+}
+
+static void bench_buffer_alloc(int iterations, int arg)
+{
+    const struct sample_message *sample = &samples[SAMPLE_CHAT];
+    for (int i = 0; i < iterations; i++)
+    {
+        TCPbuffer *buffer = SDLNet_TCP_AllocBuffer(sample->encoded, sample->len);
+        sink += (unsigned int)buffer->len;
+        SDLNet_TCP_ReleaseBuffer(buffer);
+    }
+}
+
+static void bench_buffer_acquire(int iterations, int arg)
+{
+    const struct sample_message *sample = &samples[SAMPLE_CHAT];
+    for (int i = 0; i < iterations; i++)
+    {
+        TCPbuffer *buffer = SDLNet_TCP_AcquireBuffer(buffer_pool, sample->encoded, sample->len);
+        sink += (unsigned int)buffer->len;
+        SDLNet_TCP_ReleaseBuffer(buffer);
+    }
+}
+
+// an operation is one datagram, sent on its own or in batches of arg
+static void bench_udp_send(int iterations, int arg)
+{
+    const struct sample_message *sample = &samples[SAMPLE_DELTA];
+    for (int i = 0; i < arg; i++)
+    {
+        bench_packets[i]->address = udp_sink_address;
+        bench_packets[i]->len = sample->len;
+        memcpy(bench_packets[i]->data, sample->encoded, sample->len);
+    }
+
+    for (int i = 0; i < iterations; i += arg)
+    {
+        int count = SDL_min(arg, iterations - i);
+        if (arg == 1)
+        {
+            sink += (unsigned int)SDLNet_UDP_Send(udp_sender, -1, bench_packets[0]);
+        }
+        else
+        {
+            sink += (unsigned int)SDLNet_UDP_SendBatch(udp_sender, bench_packets, count);
+        }
+    }
+}
+
+/* Dispatch */
+
+static void bench_dispatch_chat(int iterations, int arg)
+{
+    // relayed to the one other client
+    struct client *client = add_clients(2);
+    struct chat_data chat_data = chat_data_create(DATA_CHAT_REQUEST, client->id, "Hello, World!");
+    for (int i = 0; i < iterations; i++)
+    {
+        handle_message(client, &chat_data.data);
+        io_flush(io_threads[0]);
+    }
+}
+
+static void bench_dispatch_udp(int iterations, int arg)
+{
+    struct client *client = add_clients(2);
+    union data_any message = samples[arg].message;
+    switch (message.data.type)
+    {
+    case DATA_MOUSEDOWN_REQUEST:
+        message.mouse_data.id = client->id;
+        break;
+    case DATA_INPUT_REQUEST:
+        message.input_data.id = client->id;
+        break;
+    case DATA_SNAPSHOT_ACK:
+        message.ack_data.id = client->id;
+        break;
+    case DATA_PING:
+        message.ping_data.id = client->id;
+        break;
+    default:
+        break;
+    }
+
+    for (int i = 0; i < iterations; i++)
+    {
+        handle_udp_message(udp_sender, bench_packets[0], &udp_sink_address, &message.data);
+    }
+}
+
+static void bench_broadcast(int iterations, int arg)
+{
+    add_clients(arg);
+    const struct data *data = &samples[SAMPLE_CHAT].message.data;
+    for (int i = 0; i < iterations; i++)
+    {
+        broadcast(data, -1);
+        io_flush(io_threads[0]);
+    }
+}
+
+static void bench_join(int iterations, int arg)
+{
+    // the joining client is sent the other arg clients and a full history of chats
+    struct client *client = add_clients(arg + 1);
+    struct chat_data chat_data = chat_data_create(DATA_CHAT_BROADCAST, client->id, "the quick brown fox jumps over the lazy dog");
+    for (int i = 0; i < CHAT_HISTORY; i++)
+    {
+        record_chat(&chat_data);
+    }
+
+    Uint64 start_bytes = bytes_encoded;
+    for (int i = 0; i < iterations; i++)
+    {
+        send_catch_up(client);
+        io_flush(io_threads[0]);
+    }
+
+    client_bytes = (double)(bytes_encoded - start_bytes) / iterations;
+}
+
+static void bench_tick(int iterations, int arg)
+{
+    // spread over the world, like the load generator's clicks
+    add_clients(arg);
+    for (int i = 0; i < num_clients; i++)
+    {
+        struct client *client = &clients[active_clients[i]];
+        client->input.x = (i * 7919) % WORLD_WIDTH;
+        client->input.y = (i * 104729) % WORLD_HEIGHT;
+    }
+
+    // a quarter of the clients move each tick, and every client has acknowledged the last snapshot
+    Uint64 start_bytes = snapshot_bytes;
+    for (int i = 0; i < iterations; i++)
+    {
+        for (int j = i % 4; j < num_clients; j += 4)
+        {
+            struct client *client = &clients[active_clients[j]];
+            client->input.x = (client->input.x + 1) % WORLD_WIDTH;
+        }
+
+        tick(udp_sender, bench_packets);
+        flush_clients(udp_sender, bench_packets);
+
+        for (int j = 0; j < num_clients; j++)
+        {
+            clients[active_clients[j]].acked = tick_count;
+        }
+    }
+
+    client_bytes = (double)(snapshot_bytes - start_bytes) / iterations / num_clients;
+}
+
+static const struct benchmark benchmarks[] = {
+    {"create/id", bench_create_id, 0},
+    {"create/chat", bench_create_chat, 0},
+    {"create/mouse", bench_create_mouse, 0},
+    {"create/input", bench_create_input, 0},
+    {"create/ack", bench_create_ack, 0},
+    {"create/ping", bench_create_ping, 0},
+    {"create/snapshot", bench_create_snapshot, 0},
+    {"create/delta", bench_create_delta, 0},
+    {"encode/id", bench_encode, SAMPLE_ID},
+    {"encode/chat", bench_encode, SAMPLE_CHAT},
+    {"encode/mouse", bench_encode, SAMPLE_MOUSE},
+    {"encode/input", bench_encode, SAMPLE_INPUT},
+    {"encode/ack", bench_encode, SAMPLE_ACK},
+    {"encode/ping", bench_encode, SAMPLE_PING},
+    {"encode/snapshot", bench_encode, SAMPLE_SNAPSHOT},
+    {"encode/delta", bench_encode, SAMPLE_DELTA},
+    {"encode/catch_up", bench_encode, SAMPLE_CATCH_UP},
+    {"decode/id", bench_decode, SAMPLE_ID},
+    {"decode/chat", bench_decode, SAMPLE_CHAT},
+    {"decode/mouse", bench_decode, SAMPLE_MOUSE},
+    {"decode/input", bench_decode, SAMPLE_INPUT},
+    {"decode/ack", bench_decode, SAMPLE_ACK},
+    {"decode/ping", bench_decode, SAMPLE_PING},
+    {"decode/snapshot", bench_decode, SAMPLE_SNAPSHOT},
+    {"decode/delta", bench_decode, SAMPLE_DELTA},
+    {"decode/catch_up", bench_decode, SAMPLE_CATCH_UP},
+    {"compress/catch_up", bench_compress, SAMPLE_CATCH_UP},
+    {"decompress/catch_up", bench_decompress, SAMPLE_CATCH_UP},
+    {"packet/tcp_alloc_free", bench_tcp_packet, 0},
+    {"packet/udp_alloc_free", bench_udp_packet, 0},
+    {"buffer/alloc_release", bench_buffer_alloc, 0},
+    {"buffer/pool_acquire_release", bench_buffer_acquire, 0},
+    {"udp/send", bench_udp_send, 1},
+    {"udp/send_batch", bench_udp_send, UDP_MAX_BATCH},
+    {"dispatch/chat", bench_dispatch_chat, 0},
+    {"dispatch/mousedown", bench_dispatch_udp, SAMPLE_MOUSE},
+    {"dispatch/input", bench_dispatch_udp, SAMPLE_INPUT},
+    {"dispatch/ack", bench_dispatch_udp, SAMPLE_ACK},
+    {"dispatch/ping", bench_dispatch_udp, SAMPLE_PING},
+    {"broadcast/1", bench_broadcast, 1},
+    {"broadcast/10", bench_broadcast, 10},
+    {"broadcast/100", bench_broadcast, 100},
+    {"broadcast/1000", bench_broadcast, 1000},
+    {"join/0", bench_join, 0},
+    {"join/100", bench_join, 100},
+    {"join/1000", bench_join, 1000},
+    {"tick/10", bench_tick, 10},
+    {"tick/100", bench_tick, 100},
+    {"tick/1000", bench_tick, 1000},
+    {"tick/5000", bench_tick, 5000},
+};
+
+static void run_benchmark(const struct benchmark *benchmark, Uint64 frequency)
+{
+    // grow the iterations until a run is long enough to time, starting from one
+    int iterations = 1;
+    for (;;)
+    {
+        alloc_count_take();
+        alloc_bytes_take();
+        client_bytes = 0;
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        benchmark->run(iterations, benchmark->arg);
+        double seconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+
+        int allocations = alloc_count_take();
+        Uint64 bytes = alloc_bytes_take();
+
+        if (seconds >= BENCH_MIN_TIME || iterations >= BENCH_MAX_ITERATIONS)
+        {
+            printf("%s\t%d\t%.2f\t%.1f\t%.3f\t%.1f\n",
+                   benchmark->name,
+                   iterations,
+                   seconds * 1e9 / iterations,
+                   (double)bytes / iterations,
+                   (double)allocations / iterations,
+                   client_bytes);
+            fflush(stdout);
+            return;
+        }
+
+        // aim a little past the minimum, but never more than a hundred times further in one step
+        double scale = seconds > 0 ? BENCH_MIN_TIME * 1.2 / seconds : 100;
+        double next = iterations * SDL_min(scale, 100.0);
+        iterations = next > BENCH_MAX_ITERATIONS ? BENCH_MAX_ITERATIONS : SDL_max(iterations + 1, (int)next);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // only benchmarks whose names start with the argument are run, e.g. `bench encode/`
+    const char *filter = argc > 1 ? argv[1] : "";
+
+    // the chat dispatch logs every message
+    log_level = LOG_LEVEL_WARN;
+
+    if (!alloc_count_install())
+    {
+        log_error("%s", SDL_GetError());
+        return 1;
+    }
+
+    if (SDL_Init(SDL_INIT_TIMER) != 0)
+    {
+        log_error("%s", SDL_GetError());
+        return 1;
+    }
+
+    if (SDLNet_Init() != 0)
+    {
+        log_error("%s", SDLNet_GetError());
+        return 1;
+    }
+
+    if (!setup_samples())
+    {
+        return 1;
+    }
+
+    // the server's side of things, an I/O thread with no connections and nowhere real to send datagrams
+    buffer_pool = SDLNet_AllocPool(BUFFER_BLOCK_SIZE, BUFFERS_PER_SLAB);
+    udp_sink = SDLNet_UDP_Open(0);
+    udp_sender = SDLNet_UDP_Open(0);
+    bench_packets = SDLNet_AllocPacketV(UDP_MAX_BATCH, PACKET_SIZE);
+    logic_wakeup = SDLNet_AllocWakeup();
+    if (!buffer_pool || !udp_sink || !udp_sender || !bench_packets || !logic_wakeup)
+    {
+        log_error("%s", SDLNet_GetError());
+        return 1;
+    }
+
+    SDLNet_Write32(INADDR_LOOPBACK, &udp_sink_address.host);
+    udp_sink_address.port = SDLNet_UDP_GetPeerAddress(udp_sink, -1)->port;
+
+    // clients are added with a timeout, and the time spent queued is measured like it is by the server
+    init_timeouts();
+    frequency = SDL_GetPerformanceFrequency();
+
+    overflow_policy = OVERFLOW_DROP;
+    io_threads[0] = io_start(0, send_queue_size, overflow_policy, logic_wakeup, NULL);
+    if (!io_threads[0])
+    {
+        log_error("%s", SDLNet_GetError());
+        return 1;
+    }
+
+    int num_benchmarks = (int)(sizeof(benchmarks) / sizeof(benchmarks[0]));
+    printf("benchmark\titerations\tns/op\tbytes/op\tallocs/op\tsent/client\n");
+    for (int i = 0; i < num_benchmarks; i++)
+    {
+        if (strncmp(benchmarks[i].name, filter, strlen(filter)) == 0)
+        {
+            run_benchmark(&benchmarks[i], frequency);
+        }
+    }
+
+    // clients are dropped without telling anyone, there is nobody to tell
+    while (num_clients > 0)
+    {
+        close_client(&clients[active_clients[num_clients - 1]]);
+    }
+
+    io_stop(io_threads[0]);
+    SDLNet_FreePool(buffer_pool);
+    SDL_free(clients);
+    SDL_free(free_slots);
+    SDL_free(active_clients);
+    SDL_free(pending_clients);
+
+    compressor_free(compressor);
+    SDLNet_FreeWakeup(logic_wakeup);
+    SDLNet_FreePacketV(bench_packets);
+    SDLNet_UDP_Close(udp_sender);
+    SDLNet_UDP_Close(udp_sink);
+    SDLNet_Quit();
+    SDL_Quit();
+
+    return 0;
+}
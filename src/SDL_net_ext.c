@@ -1,12 +1,240 @@
+// recvmmsg and sendmmsg are GNU extensions
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 #include "SDL_net_ext.h"
 
 #include <SDL2/SDL_net.h>
 #include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#ifndef _WIN32
+/* Socket handles */
+
+// SDL_net does not expose socket handles, but every socket structure starts with the ready flag followed by the handle
+struct socket_header
+{
+    int ready;
+    int channel;
+};
+
+static int SDLNet_GetSocketFD(void *socket)
+{
+    return ((struct socket_header *)socket)->channel;
+}
+
+static int SDLNet_CheckSocketFD(void *socket, int type, const IPaddress *peer)
+{
+    // the handle has to be a socket of the right type, connected to the peer SDL_net says it is
+    int fd = SDLNet_GetSocketFD(socket);
+    int actual_type = 0;
+    socklen_t type_len = sizeof(actual_type);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &actual_type, &type_len) == -1 || actual_type != type)
+    {
+        return -1;
+    }
+
+    if (peer)
+    {
+        struct sockaddr_in address;
+        socklen_t address_len = sizeof(address);
+
+        if (getpeername(fd, (struct sockaddr *)&address, &address_len) == -1 ||
+            address.sin_addr.s_addr != peer->host ||
+            address.sin_port != peer->port)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+int SDLNet_CheckSocketHandles(void)
+{
+#ifndef _WIN32
+    // a listening socket and both ends of a loopback connection to it, and a UDP socket, all opened
+    // by SDL_net, whose handles have to match what the system says about them
+    IPaddress any;
+    any.host = INADDR_ANY;
+    any.port = 0;
+
+    TCPsocket server = SDLNet_TCP_Open(&any);
+    UDPsocket udp_socket = SDLNet_UDP_Open(0);
+    TCPsocket client = NULL;
+    TCPsocket accepted = NULL;
+    int result = -1;
+
+    struct sockaddr_in address;
+    socklen_t address_len = sizeof(address);
+    IPaddress *udp_address;
+
+    if (server &&
+        udp_socket &&
+        SDLNet_CheckSocketFD(server, SOCK_STREAM, NULL) == 0 &&
+        getsockname(SDLNet_GetSocketFD(server), (struct sockaddr *)&address, &address_len) == 0)
+    {
+        IPaddress loopback;
+        SDLNet_Write32(INADDR_LOOPBACK, &loopback.host);
+        loopback.port = address.sin_port;
+
+        // loopback connections are established by the time connect returns, so there is one to accept
+        client = SDLNet_TCP_Open(&loopback);
+        accepted = client ? SDLNet_TCP_Accept(server) : NULL;
+        udp_address = SDLNet_UDP_GetPeerAddress(udp_socket, -1);
+        address_len = sizeof(address);
+
+        if (client &&
+            accepted &&
+            udp_address &&
+            SDLNet_CheckSocketFD(client, SOCK_STREAM, &loopback) == 0 &&
+            SDLNet_CheckSocketFD(accepted, SOCK_STREAM, SDLNet_TCP_GetPeerAddress(accepted)) == 0 &&
+            SDLNet_CheckSocketFD(udp_socket, SOCK_DGRAM, NULL) == 0 &&
+            getsockname(SDLNet_GetSocketFD(udp_socket), (struct sockaddr *)&address, &address_len) == 0 &&
+            address.sin_port == udp_address->port)
+        {
+            result = 0;
+        }
+    }
+
+    if (result == -1)
+    {
+        SDLNet_SetError("This version of SDL_net doesn't lay out its sockets as expected, "
+                        "their handles can't be used");
+    }
+
+    SDLNet_TCP_Close(accepted);
+    SDLNet_TCP_Close(client);
+    SDLNet_TCP_Close(server);
+    SDLNet_UDP_Close(udp_socket);
+
+    return result;
+#else
+    return 0;
+#endif
+}
+
+/* Address */
+char *SDLNet_FormatAddress(const IPaddress *address, char *buffer, int size)
+{
+    // host and port are stored in network byte order
+    Uint32 host = SDLNet_Read32(&address->host);
+    unsigned short port = SDLNet_Read16(&address->port);
+
+    snprintf(buffer, size, "%u.%u.%u.%u:%u",
+             (host >> 24) & 0xFF,
+             (host >> 16) & 0xFF,
+             (host >> 8) & 0xFF,
+             host & 0xFF,
+             port);
+
+    return buffer;
+}
 
 /* TCP */
+
+// number of maximum-size messages the ring buffer can hold before the reader has to drain it
+#define TCP_BUFFERED_MESSAGES 4
+
+// small messages are framed in a stack buffer so the header and payload go out in a single send
+#define TCP_SEND_BUFFER_SIZE 1024
+
+TCPsocket SDLNet_TCP_Listen(const IPaddress *address)
+{
+    IPaddress any = *address;
+    any.host = INADDR_ANY;
+
+    if (address->host == INADDR_ANY)
+    {
+        return SDLNet_TCP_Open(&any);
+    }
+
+#ifndef _WIN32
+    // SDL_net connects when given a host, so it listens on a free port of every interface and its
+    // socket is swapped for one bound to the address
+    any.port = 0;
+    TCPsocket tcp_socket = SDLNet_TCP_Open(&any);
+
+    if (!tcp_socket)
+    {
+        return NULL;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int old_fd = SDLNet_GetSocketFD(tcp_socket);
+    int one = 1;
+
+    struct sockaddr_in bind_address;
+    memset(&bind_address, 0, sizeof(bind_address));
+    bind_address.sin_family = AF_INET;
+    bind_address.sin_addr.s_addr = address->host;
+    bind_address.sin_port = address->port;
+
+    if (fd == -1 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1 ||
+        bind(fd, (struct sockaddr *)&bind_address, sizeof(bind_address)) == -1 ||
+        listen(fd, SOMAXCONN) == -1 ||
+        fcntl(fd, F_SETFL, fcntl(old_fd, F_GETFL)) == -1 ||
+        dup2(fd, old_fd) == -1)
+    {
+        char formatted[ADDRESS_STRLEN];
+        SDLNet_SetError("Couldn't listen on %s: %s",
+                        SDLNet_FormatAddress(address, formatted, sizeof(formatted)),
+                        strerror(errno));
+
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        SDLNet_TCP_Close(tcp_socket);
+
+        return NULL;
+    }
+
+    close(fd);
+
+    return tcp_socket;
+#else
+    SDLNet_SetError("Listening on a single interface is not supported on this platform");
+
+    return NULL;
+#endif
+}
+
 TCPpacket *SDLNet_TCP_AllocPacket(int size)
 {
-    TCPpacket *packet = malloc(sizeof(TCPpacket));
+    if (size <= 0 || size > TCP_MAX_MESSAGE)
+    {
+        SDLNet_SetError("Invalid packet size %d", size);
+
+        return NULL;
+    }
+
+    // the packet, the message it copies out and the ring buffer behind it are a single allocation
+    int buffer_size = TCP_BUFFERED_MESSAGES * (TCP_HEADER_SIZE + size);
+    TCPpacket *packet = SDL_malloc(sizeof(TCPpacket) + size + buffer_size);
 
     if (!packet)
     {
@@ -15,80 +243,1166 @@ TCPpacket *SDLNet_TCP_AllocPacket(int size)
         return NULL;
     }
 
-    packet->data = malloc(size);
+    packet->data = (Uint8 *)(packet + 1);
+    packet->len = 0;
     packet->maxlen = size;
+    packet->buffer = packet->data + size;
+    packet->size = buffer_size;
+    packet->head = 0;
+    packet->count = 0;
 
     return packet;
 }
 
 int SDLNet_TCP_SendExt(TCPsocket socket, void *data, int len)
 {
-    IPaddress *address = SDLNet_TCP_GetPeerAddress(socket);
-    const char *host = SDLNet_ResolveIP(address);
-    unsigned short port = SDLNet_Read16(&address->port);
+    if (len < 0 || len > TCP_MAX_MESSAGE)
+    {
+        SDLNet_SetError("Message of %d bytes is too large to send", len);
+
+        return -1;
+    }
+
+    log_trace("TCP: Sending %d bytes", len);
 
-    printf("TCP: Sending %d bytes to %s:%d\n", len, host, port);
+    if (len <= TCP_SEND_BUFFER_SIZE - TCP_HEADER_SIZE)
+    {
+        Uint8 buffer[TCP_SEND_BUFFER_SIZE];
+        SDLNet_Write16((Uint16)len, buffer);
+        memcpy(buffer + TCP_HEADER_SIZE, data, len);
+
+        return SDLNet_TCP_Send(socket, buffer, TCP_HEADER_SIZE + len) - TCP_HEADER_SIZE;
+    }
+
+    Uint8 header[TCP_HEADER_SIZE];
+    SDLNet_Write16((Uint16)len, header);
+
+    if (SDLNet_TCP_Send(socket, header, TCP_HEADER_SIZE) < TCP_HEADER_SIZE)
+    {
+        return -1;
+    }
 
     return SDLNet_TCP_Send(socket, data, len);
 }
 
 int SDLNet_TCP_RecvExt(TCPsocket socket, TCPpacket *packet)
 {
-    packet->len = SDLNet_TCP_Recv(socket, packet->data, packet->maxlen);
+    // start at the beginning of the buffer whenever it is empty so the next read can be as large as possible
+    if (packet->count == 0)
+    {
+        packet->head = 0;
+    }
+
+    int space = packet->size - packet->count;
 
-    if (packet->len > 0)
+    if (space == 0)
     {
-        IPaddress *address = SDLNet_TCP_GetPeerAddress(socket);
-        const char *host = SDLNet_ResolveIP(address);
-        unsigned short port = SDLNet_Read16(&address->port);
+        SDLNet_SetError("Receive buffer is full");
+
+        return -1;
+    }
 
-        printf("TCP: Received %d bytes from %s:%d\n", packet->len, host, port);
+    // read as much as fits in the free region after the tail without wrapping
+    int tail = (packet->head + packet->count) % packet->size;
+    int contiguous = tail >= packet->head ? packet->size - tail : packet->head - tail;
 
-        return 1;
+    if (contiguous > space)
+    {
+        contiguous = space;
     }
 
-    return 0;
+    int len = SDLNet_TCP_Recv(socket, packet->buffer + tail, contiguous);
+
+    if (len <= 0)
+    {
+        SDLNet_SetError("Connection closed");
+
+        return -1;
+    }
+
+    packet->count += len;
+
+    log_trace("TCP: Received %d bytes", len);
+
+    return len;
+}
+
+static void SDLNet_TCP_PeekPacket(TCPpacket *packet, int offset, Uint8 *data, int len)
+{
+    int start = (packet->head + offset) % packet->size;
+    int first = packet->size - start;
+
+    if (first > len)
+    {
+        first = len;
+    }
+
+    memcpy(data, packet->buffer + start, first);
+    memcpy(data + first, packet->buffer, len - first);
+}
+
+int SDLNet_TCP_NextPacket(TCPpacket *packet)
+{
+    if (packet->count < TCP_HEADER_SIZE)
+    {
+        return 0;
+    }
+
+    Uint8 header[TCP_HEADER_SIZE];
+    SDLNet_TCP_PeekPacket(packet, 0, header, TCP_HEADER_SIZE);
+    int len = SDLNet_Read16(header);
+
+    if (len > packet->maxlen)
+    {
+        SDLNet_SetError("Message of %d bytes exceeds the maximum of %d", len, packet->maxlen);
+
+        return -1;
+    }
+
+    if (packet->count < TCP_HEADER_SIZE + len)
+    {
+        return 0;
+    }
+
+    SDLNet_TCP_PeekPacket(packet, TCP_HEADER_SIZE, packet->data, len);
+    packet->len = len;
+
+    packet->head = (packet->head + TCP_HEADER_SIZE + len) % packet->size;
+    packet->count -= TCP_HEADER_SIZE + len;
+
+    return 1;
 }
 
 void SDLNet_TCP_FreePacket(TCPpacket *packet)
 {
-    free(packet->data);
-    free(packet);
+    SDL_free(packet);
 }
 
-/* UDP */
-UDPpacket *SDLNet_UDP_AllocPacket(int size)
+/* Pool */
+
+// slabs are chained together so they can be freed with the pool, the header is padded so the
+// blocks after it are as aligned as anything malloc returns
+#define POOL_ALIGNMENT 16
+
+// free blocks are threaded onto a list through their first bytes
+struct pool_block
 {
-    return SDLNet_AllocPacket(size);
+    struct pool_block *next;
+};
+
+struct _SDLNet_Pool
+{
+    int block_size;
+    int blocks_per_slab;
+    void *slabs;
+
+    // pushed to by any thread, popped only by the owner, so a block at the head can't be popped and
+    // pushed back between the owner reading it and swapping it out
+    void *free;
+};
+
+static int SDLNet_PoolGrow(SDLNet_Pool pool)
+{
+    Uint8 *slab = SDL_malloc(POOL_ALIGNMENT + (size_t)pool->blocks_per_slab * pool->block_size);
+
+    if (!slab)
+    {
+        SDLNet_SetError("Couldn't allocate pool slab");
+
+        return 0;
+    }
+
+    *(void **)slab = pool->slabs;
+    pool->slabs = slab;
+
+    // link the new blocks up first, then hand the whole chain over in one swap
+    Uint8 *blocks = slab + POOL_ALIGNMENT;
+    for (int i = 0; i < pool->blocks_per_slab - 1; i++)
+    {
+        ((struct pool_block *)(blocks + (size_t)i * pool->block_size))->next =
+            (struct pool_block *)(blocks + (size_t)(i + 1) * pool->block_size);
+    }
+
+    struct pool_block *first = (struct pool_block *)blocks;
+    struct pool_block *last = (struct pool_block *)(blocks + (size_t)(pool->blocks_per_slab - 1) * pool->block_size);
+    do
+    {
+        last->next = SDL_AtomicGetPtr(&pool->free);
+    } while (!SDL_AtomicCASPtr(&pool->free, last->next, first));
+
+    return 1;
 }
 
-int SDLNet_UDP_SendExt(UDPsocket socket, UDPpacket *packet, IPaddress address, void *data, int len)
+SDLNet_Pool SDLNet_AllocPool(int block_size, int blocks_per_slab)
 {
-    packet->address = address;
-    packet->data = (Uint8 *)data;
-    packet->len = len;
+    if (block_size <= 0 || blocks_per_slab <= 0)
+    {
+        SDLNet_SetError("Invalid pool of %d blocks of %d bytes", blocks_per_slab, block_size);
+
+        return NULL;
+    }
 
-    const char *host = SDLNet_ResolveIP(&packet->address);
-    unsigned short port = SDLNet_Read16(&packet->address.port);
+    SDLNet_Pool pool = SDL_calloc(1, sizeof(struct _SDLNet_Pool));
 
-    printf("UDP: Sending %d bytes to %s:%d\n", packet->len, host, port);
+    if (!pool)
+    {
+        SDLNet_SetError("Couldn't allocate pool");
 
-    return SDLNet_UDP_Send(socket, -1, packet);
+        return NULL;
+    }
+
+    // room for the free list link, rounded up so every block stays aligned
+    int size = SDL_max(block_size, (int)sizeof(struct pool_block));
+    pool->block_size = (size + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT * POOL_ALIGNMENT;
+    pool->blocks_per_slab = blocks_per_slab;
+
+    return pool;
 }
 
-int SDLNet_UDP_RecvExt(UDPsocket socket, UDPpacket *packet)
+void *SDLNet_PoolAcquire(SDLNet_Pool pool)
 {
-    int recv = SDLNet_UDP_Recv(socket, packet);
+    for (;;)
+    {
+        struct pool_block *block = SDL_AtomicGetPtr(&pool->free);
 
-    if (recv == 1)
+        // only grows until the pool covers the most blocks ever in use at once
+        if (!block)
+        {
+            if (!SDLNet_PoolGrow(pool))
+            {
+                return NULL;
+            }
+
+            continue;
+        }
+
+        if (SDL_AtomicCASPtr(&pool->free, block, block->next))
+        {
+            return block;
+        }
+    }
+}
+
+void SDLNet_PoolRelease(SDLNet_Pool pool, void *block)
+{
+    struct pool_block *node = block;
+
+    do
+    {
+        node->next = SDL_AtomicGetPtr(&pool->free);
+    } while (!SDL_AtomicCASPtr(&pool->free, node->next, node));
+}
+
+int SDLNet_PoolBlockSize(SDLNet_Pool pool)
+{
+    return pool->block_size;
+}
+
+void SDLNet_FreePool(SDLNet_Pool pool)
+{
+    // every block has to have been released, they all live in the slabs
+    void *slab = pool->slabs;
+    while (slab)
+    {
+        void *next = *(void **)slab;
+        SDL_free(slab);
+        slab = next;
+    }
+
+    SDL_free(pool);
+}
+
+/* TCP send queue */
+
+#define QUEUE_INITIAL_CAPACITY 16
+
+// the most queued buffers gathered into a single write
+#define QUEUE_MAX_IOV 64
+
+TCPbuffer *SDLNet_TCP_AllocBuffer(const void *data, int len)
+{
+    if (len < 0 || len > TCP_MAX_MESSAGE)
     {
-        const char *host = SDLNet_ResolveIP(&packet->address);
-        unsigned short port = SDLNet_Read16(&packet->address.port);
+        SDLNet_SetError("Message of %d bytes is too large to send", len);
 
-        printf("UDP: Received %d bytes from %s:%d\n", packet->len, host, port);
+        return NULL;
     }
 
-    return recv;
+    TCPbuffer *buffer = SDL_malloc(sizeof(TCPbuffer) + TCP_HEADER_SIZE + len);
+
+    if (!buffer)
+    {
+        SDLNet_SetError("Couldn't allocate buffer");
+
+        return NULL;
+    }
+
+    SDL_AtomicSet(&buffer->refcount, 1);
+    buffer->pool = NULL;
+    buffer->len = TCP_HEADER_SIZE + len;
+    SDLNet_Write16((Uint16)len, buffer->data);
+    memcpy(buffer->data + TCP_HEADER_SIZE, data, len);
+
+    return buffer;
+}
+
+TCPbuffer *SDLNet_TCP_AllocRawBuffer(int size)
+{
+    TCPbuffer *buffer = SDL_malloc(sizeof(TCPbuffer) + size);
+
+    if (!buffer)
+    {
+        SDLNet_SetError("Couldn't allocate buffer");
+
+        return NULL;
+    }
+
+    SDL_AtomicSet(&buffer->refcount, 1);
+    buffer->pool = NULL;
+    buffer->len = size;
+
+    return buffer;
+}
+
+TCPbuffer *SDLNet_TCP_AcquireBuffer(SDLNet_Pool pool, const void *data, int len)
+{
+    if (len < 0 || (int)sizeof(TCPbuffer) + TCP_HEADER_SIZE + len > SDLNet_PoolBlockSize(pool))
+    {
+        SDLNet_SetError("Message of %d bytes doesn't fit a pool block", len);
+
+        return NULL;
+    }
+
+    TCPbuffer *buffer = SDLNet_PoolAcquire(pool);
+
+    if (!buffer)
+    {
+        return NULL;
+    }
+
+    SDL_AtomicSet(&buffer->refcount, 1);
+    buffer->pool = pool;
+    buffer->len = TCP_HEADER_SIZE + len;
+    SDLNet_Write16((Uint16)len, buffer->data);
+    memcpy(buffer->data + TCP_HEADER_SIZE, data, len);
+
+    return buffer;
+}
+
+void SDLNet_TCP_RetainBuffer(TCPbuffer *buffer)
+{
+    SDL_AtomicIncRef(&buffer->refcount);
+}
+
+void SDLNet_TCP_ReleaseBuffer(TCPbuffer *buffer)
+{
+    // whichever thread drops the last reference gives the buffer back
+    if (SDL_AtomicDecRef(&buffer->refcount))
+    {
+        if (buffer->pool)
+        {
+            SDLNet_PoolRelease(buffer->pool, buffer);
+        }
+        else
+        {
+            SDL_free(buffer);
+        }
+    }
+}
+
+TCPqueue *SDLNet_TCP_AllocQueue(int maxbytes)
+{
+    TCPqueue *queue = SDL_malloc(sizeof(TCPqueue));
+
+    if (!queue)
+    {
+        SDLNet_SetError("Couldn't allocate queue");
+
+        return NULL;
+    }
+
+    queue->capacity = QUEUE_INITIAL_CAPACITY;
+    queue->buffers = SDL_malloc(queue->capacity * sizeof(TCPbuffer *));
+    queue->head = 0;
+    queue->count = 0;
+    queue->offset = 0;
+    queue->bytes = 0;
+    queue->maxbytes = maxbytes;
+
+    if (!queue->buffers)
+    {
+        SDLNet_SetError("Couldn't allocate queue");
+
+        SDL_free(queue);
+
+        return NULL;
+    }
+
+    return queue;
+}
+
+int SDLNet_TCP_Enqueue(TCPqueue *queue, TCPbuffer *buffer)
+{
+    if (queue->bytes + buffer->len > queue->maxbytes)
+    {
+        SDLNet_SetError("Send queue is full");
+
+        return -1;
+    }
+
+    // the limit is in bytes, so the ring of references grows until it is reached
+    if (queue->count == queue->capacity)
+    {
+        int capacity = queue->capacity * 2;
+        TCPbuffer **buffers = SDL_malloc(capacity * sizeof(TCPbuffer *));
+
+        if (!buffers)
+        {
+            SDLNet_SetError("Couldn't grow queue");
+
+            return -1;
+        }
+
+        for (int i = 0; i < queue->count; i++)
+        {
+            buffers[i] = queue->buffers[(queue->head + i) % queue->capacity];
+        }
+
+        SDL_free(queue->buffers);
+        queue->buffers = buffers;
+        queue->capacity = capacity;
+        queue->head = 0;
+    }
+
+    SDLNet_TCP_RetainBuffer(buffer);
+
+    queue->buffers[(queue->head + queue->count) % queue->capacity] = buffer;
+    queue->count++;
+    queue->bytes += buffer->len;
+
+    return 0;
+}
+
+int SDLNet_TCP_Flush(TCPsocket socket, TCPqueue *queue)
+{
+    if (queue->count == 0)
+    {
+        return 0;
+    }
+
+#ifndef _WIN32
+    // gather as many queued buffers as possible into one write
+    struct iovec iov[QUEUE_MAX_IOV];
+    int num_iov = queue->count < QUEUE_MAX_IOV ? queue->count : QUEUE_MAX_IOV;
+
+    for (int i = 0; i < num_iov; i++)
+    {
+        TCPbuffer *buffer = queue->buffers[(queue->head + i) % queue->capacity];
+        int offset = i == 0 ? queue->offset : 0;
+
+        iov[i].iov_base = buffer->data + offset;
+        iov[i].iov_len = buffer->len - offset;
+    }
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = iov;
+    message.msg_iovlen = num_iov;
+
+    // write whatever the socket buffer has room for without blocking
+    ssize_t sent = sendmsg(SDLNet_GetSocketFD(socket), &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if (sent == -1)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        {
+            return 0;
+        }
+
+        SDLNet_SetError("sendmsg: %s", strerror(errno));
+
+        return -1;
+    }
+#else
+    // without access to non-blocking sends, fall back to blocking until the first buffer is written
+    TCPbuffer *first = queue->buffers[queue->head];
+    int sent = SDLNet_TCP_Send(socket, first->data + queue->offset, first->len - queue->offset);
+
+    if (sent < first->len - queue->offset)
+    {
+        return -1;
+    }
+#endif
+
+    log_trace("TCP: Flushed %d bytes", (int)sent);
+
+    // release every buffer that was written completely
+    int len = (int)sent;
+    queue->bytes -= len;
+
+    while (len > 0)
+    {
+        TCPbuffer *buffer = queue->buffers[queue->head];
+        int remaining = buffer->len - queue->offset;
+
+        if (len < remaining)
+        {
+            queue->offset += len;
+            break;
+        }
+
+        len -= remaining;
+        queue->offset = 0;
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+
+        SDLNet_TCP_ReleaseBuffer(buffer);
+    }
+
+    return (int)sent;
+}
+
+void SDLNet_TCP_FreeQueue(TCPqueue *queue)
+{
+    for (int i = 0; i < queue->count; i++)
+    {
+        SDLNet_TCP_ReleaseBuffer(queue->buffers[(queue->head + i) % queue->capacity]);
+    }
+
+    SDL_free(queue->buffers);
+    SDL_free(queue);
+}
+
+/* Poller */
+
+#define POLLER_INITIAL_SIZE 16
+#define POLLER_MAX_EVENTS 1024
+
+struct poller_entry
+{
+    SDLNet_GenericSocket socket;
+    void *userdata;
+};
+
+struct _SDLNet_Poller
+{
+#ifdef __linux__
+    // registered sockets are indexed by file descriptor
+    int epoll_fd;
+    struct epoll_event events[POLLER_MAX_EVENTS];
+#else
+    // registered sockets are kept densely so readiness can be collected after SDLNet_CheckSockets
+    SDLNet_SocketSet socket_set;
+    int count;
+#endif
+    struct poller_entry *entries;
+    int size;
+
+    // sockets reported by the last wait, so their ready flags can be cleared on the next one
+    struct poller_entry *ready;
+    int num_ready;
+};
+
+static int SDLNet_PollerGrow(SDLNet_Poller poller, int size)
+{
+    int new_size = poller->size;
+
+    while (new_size < size)
+    {
+        new_size *= 2;
+    }
+
+    if (new_size == poller->size)
+    {
+        return 0;
+    }
+
+    struct poller_entry *entries = SDL_realloc(poller->entries, new_size * sizeof(struct poller_entry));
+    struct poller_entry *ready = SDL_realloc(poller->ready, new_size * sizeof(struct poller_entry));
+
+    if (entries)
+    {
+        poller->entries = entries;
+    }
+    if (ready)
+    {
+        poller->ready = ready;
+    }
+    if (!entries || !ready)
+    {
+        SDLNet_SetError("Couldn't grow poller");
+
+        return -1;
+    }
+
+    memset(poller->entries + poller->size, 0, (new_size - poller->size) * sizeof(struct poller_entry));
+
+#ifndef __linux__
+    // socket sets can't be resized, so move everything into a bigger one
+    SDLNet_SocketSet socket_set = SDLNet_AllocSocketSet(new_size);
+
+    if (!socket_set)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < poller->count; i++)
+    {
+        SDLNet_AddSocket(socket_set, poller->entries[i].socket);
+    }
+
+    SDLNet_FreeSocketSet(poller->socket_set);
+    poller->socket_set = socket_set;
+#endif
+
+    poller->size = new_size;
+
+    return 0;
+}
+
+SDLNet_Poller SDLNet_AllocPoller(void)
+{
+    SDLNet_Poller poller = SDL_malloc(sizeof(struct _SDLNet_Poller));
+
+    if (!poller)
+    {
+        SDLNet_SetError("Couldn't allocate poller");
+
+        return NULL;
+    }
+
+    poller->size = POLLER_INITIAL_SIZE;
+    poller->entries = SDL_calloc(poller->size, sizeof(struct poller_entry));
+    poller->ready = SDL_malloc(poller->size * sizeof(struct poller_entry));
+    poller->num_ready = 0;
+
+#ifdef __linux__
+    poller->epoll_fd = epoll_create1(0);
+
+    if (poller->epoll_fd == -1)
+    {
+        SDLNet_SetError("epoll_create1: %s", strerror(errno));
+
+        SDL_free(poller->ready);
+        SDL_free(poller->entries);
+        SDL_free(poller);
+
+        return NULL;
+    }
+#else
+    poller->socket_set = SDLNet_AllocSocketSet(poller->size);
+    poller->count = 0;
+#endif
+
+    if (!poller->entries || !poller->ready)
+    {
+        SDLNet_SetError("Couldn't allocate poller");
+
+        SDLNet_FreePoller(poller);
+
+        return NULL;
+    }
+
+    return poller;
+}
+
+int SDLNet_PollerAdd(SDLNet_Poller poller, void *socket, void *userdata)
+{
+#ifdef __linux__
+    int fd = SDLNet_GetSocketFD(socket);
+
+    if (SDLNet_PollerGrow(poller, fd + 1) == -1)
+    {
+        return -1;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+
+    if (epoll_ctl(poller->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+    {
+        SDLNet_SetError("epoll_ctl: %s", strerror(errno));
+
+        return -1;
+    }
+
+    poller->entries[fd].socket = socket;
+    poller->entries[fd].userdata = userdata;
+#else
+    if (SDLNet_PollerGrow(poller, poller->count + 1) == -1)
+    {
+        return -1;
+    }
+
+    if (SDLNet_AddSocket(poller->socket_set, socket) == -1)
+    {
+        return -1;
+    }
+
+    poller->entries[poller->count].socket = socket;
+    poller->entries[poller->count].userdata = userdata;
+    poller->count++;
+#endif
+
+    return 0;
+}
+
+int SDLNet_PollerDel(SDLNet_Poller poller, void *socket)
+{
+    // make sure a socket closed after this call is never reported by a stale ready list
+    for (int i = 0; i < poller->num_ready; i++)
+    {
+        if (poller->ready[i].socket == socket)
+        {
+            poller->ready[i].socket = NULL;
+        }
+    }
+
+#ifdef __linux__
+    int fd = SDLNet_GetSocketFD(socket);
+
+    if (fd >= poller->size || poller->entries[fd].socket != socket)
+    {
+        SDLNet_SetError("Socket is not in the poller");
+
+        return -1;
+    }
+
+    epoll_ctl(poller->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+    poller->entries[fd].socket = NULL;
+    poller->entries[fd].userdata = NULL;
+#else
+    for (int i = 0; i < poller->count; i++)
+    {
+        if (poller->entries[i].socket == socket)
+        {
+            SDLNet_DelSocket(poller->socket_set, socket);
+
+            poller->entries[i] = poller->entries[--poller->count];
+
+            return 0;
+        }
+    }
+
+    SDLNet_SetError("Socket is not in the poller");
+
+    return -1;
+#endif
+
+    return 0;
+}
+
+int SDLNet_PollerWatchWrite(SDLNet_Poller poller, void *socket, int enable)
+{
+#ifdef __linux__
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = enable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.fd = SDLNet_GetSocketFD(socket);
+
+    if (epoll_ctl(poller->epoll_fd, EPOLL_CTL_MOD, event.data.fd, &event) == -1)
+    {
+        SDLNet_SetError("epoll_ctl: %s", strerror(errno));
+
+        return -1;
+    }
+#endif
+
+    // socket sets only report readability, so callers have to retry writes on every wakeup there
+
+    return 0;
+}
+
+int SDLNet_PollerWait(SDLNet_Poller poller, Uint32 timeout)
+{
+    // sockets that were ready last time are re-reported if they still are
+    for (int i = 0; i < poller->num_ready; i++)
+    {
+        if (poller->ready[i].socket)
+        {
+            poller->ready[i].socket->ready = 0;
+        }
+    }
+
+    poller->num_ready = 0;
+
+#ifdef __linux__
+    int count = epoll_wait(poller->epoll_fd, poller->events, POLLER_MAX_EVENTS, (int)timeout);
+
+    if (count == -1)
+    {
+        if (errno == EINTR)
+        {
+            return 0;
+        }
+
+        SDLNet_SetError("epoll_wait: %s", strerror(errno));
+
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        struct poller_entry *entry = &poller->entries[poller->events[i].data.fd];
+
+        if (entry->socket)
+        {
+            // only mark sockets that can be read from, errors and hangups are reported by the next read
+            if (poller->events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            {
+                entry->socket->ready = 1;
+            }
+            poller->ready[poller->num_ready++] = *entry;
+        }
+    }
+#else
+    int count = SDLNet_CheckSockets(poller->socket_set, timeout);
+
+    if (count <= 0)
+    {
+        return count;
+    }
+
+    for (int i = 0; i < poller->count; i++)
+    {
+        if (SDLNet_SocketReady(poller->entries[i].socket))
+        {
+            poller->ready[poller->num_ready++] = poller->entries[i];
+        }
+    }
+#endif
+
+    return poller->num_ready;
+}
+
+void *SDLNet_PollerReady(SDLNet_Poller poller, int index)
+{
+    return poller->ready[index].socket ? poller->ready[index].userdata : NULL;
+}
+
+void SDLNet_FreePoller(SDLNet_Poller poller)
+{
+#ifdef __linux__
+    close(poller->epoll_fd);
+#else
+    SDLNet_FreeSocketSet(poller->socket_set);
+#endif
+    SDL_free(poller->ready);
+    SDL_free(poller->entries);
+    SDL_free(poller);
+}
+
+/* Wakeup */
+
+SDLNet_Wakeup *SDLNet_AllocWakeup(void)
+{
+    SDLNet_Wakeup *wakeup = SDL_malloc(sizeof(SDLNet_Wakeup));
+
+    if (!wakeup)
+    {
+        SDLNet_SetError("Couldn't allocate wakeup");
+
+        return NULL;
+    }
+
+    // any free port will do, the socket only ever receives from this process
+    wakeup->socket = SDLNet_UDP_Open(0);
+
+    if (!wakeup->socket)
+    {
+        SDL_free(wakeup);
+
+        return NULL;
+    }
+
+    IPaddress *address = SDLNet_UDP_GetPeerAddress(wakeup->socket, -1);
+
+    if (!address)
+    {
+        SDLNet_UDP_Close(wakeup->socket);
+        SDL_free(wakeup);
+
+        return NULL;
+    }
+
+    SDLNet_Write32(INADDR_LOOPBACK, &wakeup->address.host);
+    wakeup->address.port = address->port;
+    SDL_AtomicSet(&wakeup->pending, 0);
+
+    return wakeup;
+}
+
+void SDLNet_Wake(SDLNet_Wakeup *wakeup)
+{
+    // one datagram is enough until the sleeping thread has cleared it
+    if (!SDL_AtomicCAS(&wakeup->pending, 0, 1))
+    {
+        return;
+    }
+
+    Uint8 byte = 0;
+    UDPpacket packet;
+    memset(&packet, 0, sizeof(packet));
+    packet.channel = -1;
+    packet.data = &byte;
+    packet.len = 1;
+    packet.maxlen = 1;
+    packet.address = wakeup->address;
+
+    SDLNet_UDP_Send(wakeup->socket, -1, &packet);
+}
+
+void SDLNet_ClearWakeup(SDLNet_Wakeup *wakeup)
+{
+    Uint8 byte;
+    UDPpacket packet;
+    memset(&packet, 0, sizeof(packet));
+    packet.data = &byte;
+    packet.maxlen = 1;
+
+    while (SDLNet_UDP_Recv(wakeup->socket, &packet) == 1)
+    {
+    }
+
+    // cleared only after draining, so whatever is checked next is either seen now or sends a new datagram
+    SDL_AtomicSet(&wakeup->pending, 0);
+}
+
+void SDLNet_FreeWakeup(SDLNet_Wakeup *wakeup)
+{
+    SDLNet_UDP_Close(wakeup->socket);
+    SDL_free(wakeup);
+}
+
+/* UDP */
+UDPpacket *SDLNet_UDP_AllocPacket(int size)
+{
+    return SDLNet_AllocPacket(size);
+}
+
+UDPsocket SDLNet_UDP_OpenShared(Uint16 port)
+{
+#if !defined(_WIN32) && defined(SO_REUSEPORT)
+    // SDL_net binds as it opens, so its socket is swapped for one that lets the port be shared,
+    // and the kernel spreads the flows to the port over every socket bound to it
+    UDPsocket udp_socket = SDLNet_UDP_Open(0);
+
+    if (!udp_socket)
+    {
+        return NULL;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int old_fd = SDLNet_GetSocketFD(udp_socket);
+    int one = 1;
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (fd == -1 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1 ||
+        bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        fcntl(fd, F_SETFL, fcntl(old_fd, F_GETFL)) == -1 ||
+        dup2(fd, old_fd) == -1)
+    {
+        SDLNet_SetError("Couldn't share UDP port %u: %s", port, strerror(errno));
+
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        SDLNet_UDP_Close(udp_socket);
+
+        return NULL;
+    }
+
+    close(fd);
+
+    return udp_socket;
+#else
+    SDLNet_SetError("Sharing a UDP port is not supported on this platform");
+
+    return NULL;
+#endif
+}
+
+int SDLNet_UDP_SendExt(UDPsocket socket, UDPpacket *packet, IPaddress address, void *data, int len)
+{
+    // copied into the packet's own buffer, replacing the pointer would leak it and hand the
+    // caller's memory to SDLNet_FreePacket, callers that encode straight into the packet skip the copy
+    if (len < 0 || len > packet->maxlen)
+    {
+        SDLNet_SetError("Datagram of %d bytes doesn't fit a packet of %d", len, packet->maxlen);
+
+        return 0;
+    }
+
+    if (data != packet->data)
+    {
+        memcpy(packet->data, data, len);
+    }
+
+    packet->address = address;
+    packet->len = len;
+
+    log_trace("UDP: Sending %d bytes", packet->len);
+
+    return SDLNet_UDP_Send(socket, -1, packet);
+}
+
+int SDLNet_UDP_RecvExt(UDPsocket socket, UDPpacket *packet)
+{
+    int recv = SDLNet_UDP_Recv(socket, packet);
+
+    if (recv == 1)
+    {
+        log_trace("UDP: Received %d bytes", packet->len);
+    }
+
+    return recv;
+}
+
+int SDLNet_UDP_RecvBatch(UDPsocket socket, UDPpacket **packets, int count)
+{
+#ifdef __linux__
+    struct mmsghdr messages[UDP_MAX_BATCH];
+    struct iovec iov[UDP_MAX_BATCH];
+    struct sockaddr_in addresses[UDP_MAX_BATCH];
+
+    if (count > UDP_MAX_BATCH)
+    {
+        count = UDP_MAX_BATCH;
+    }
+
+    memset(messages, 0, count * sizeof(struct mmsghdr));
+
+    for (int i = 0; i < count; i++)
+    {
+        iov[i].iov_base = packets[i]->data;
+        iov[i].iov_len = packets[i]->maxlen;
+
+        messages[i].msg_hdr.msg_iov = &iov[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_name = &addresses[i];
+        messages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+
+    // clear the ready flag like SDL_net's own receive functions do
+    ((SDLNet_GenericSocket)socket)->ready = 0;
+
+    int received = recvmmsg(SDLNet_GetSocketFD(socket), messages, count, MSG_DONTWAIT, NULL);
+
+    if (received == -1)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        {
+            return 0;
+        }
+
+        SDLNet_SetError("recvmmsg: %s", strerror(errno));
+
+        return -1;
+    }
+
+    for (int i = 0; i < received; i++)
+    {
+        // SDL_net keeps addresses in network byte order, just like sockaddr_in
+        packets[i]->channel = -1;
+        packets[i]->len = (int)messages[i].msg_len;
+        packets[i]->address.host = addresses[i].sin_addr.s_addr;
+        packets[i]->address.port = addresses[i].sin_port;
+    }
+#else
+    int received = 0;
+
+    while (received < count && SDLNet_UDP_Recv(socket, packets[received]) == 1)
+    {
+        received++;
+    }
+#endif
+
+    log_trace("UDP: Received %d packets", received);
+
+    return received;
+}
+
+int SDLNet_UDP_SendBatch(UDPsocket socket, UDPpacket **packets, int count)
+{
+#ifdef __linux__
+    struct mmsghdr messages[UDP_MAX_BATCH];
+    struct iovec iov[UDP_MAX_BATCH];
+    struct sockaddr_in addresses[UDP_MAX_BATCH];
+    int next = 0;
+    int sent = 0;
+    int failed = 0;
+
+    while (next < count)
+    {
+        int batch = count - next < UDP_MAX_BATCH ? count - next : UDP_MAX_BATCH;
+
+        memset(messages, 0, batch * sizeof(struct mmsghdr));
+        memset(addresses, 0, batch * sizeof(struct sockaddr_in));
+
+        for (int i = 0; i < batch; i++)
+        {
+            UDPpacket *packet = packets[next + i];
+
+            iov[i].iov_base = packet->data;
+            iov[i].iov_len = packet->len;
+
+            addresses[i].sin_family = AF_INET;
+            addresses[i].sin_addr.s_addr = packet->address.host;
+            addresses[i].sin_port = packet->address.port;
+
+            messages[i].msg_hdr.msg_iov = &iov[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_name = &addresses[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        }
+
+        int result = sendmmsg(SDLNet_GetSocketFD(socket), messages, batch, 0);
+
+        if (result == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        // the call stops at the first datagram that can't be sent, one bad address mustn't cost
+        // everyone after it theirs
+        if (result <= 0)
+        {
+            SDLNet_SetError("sendmmsg: %s", result == -1 ? strerror(errno) : "Nothing sent");
+            next++;
+            failed++;
+            continue;
+        }
+
+        next += result;
+        sent += result;
+    }
+
+    if (failed)
+    {
+        log_debug("UDP: %d of %d packets couldn't be sent, the last because of %s", failed, count, SDLNet_GetError());
+    }
+#else
+    int sent = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        sent += SDLNet_UDP_Send(socket, -1, packets[i]);
+    }
+#endif
+
+    log_trace("UDP: Sent %d packets", sent);
+
+    return sent;
 }
 
 void SDLNet_UDP_FreePacket(UDPpacket *packet)
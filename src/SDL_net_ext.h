@@ -1,25 +1,144 @@
 #ifndef SDL_NET_EXT_H
 #define SDL_NET_EXT_H
 
+#include <SDL2/SDL.h>
 #include <SDL2/SDL_net.h>
 
+/* Socket handles */
+
+// SDL_net doesn't expose the handles behind its sockets, which the poller, batched datagrams and
+// non-blocking writes need, so they are read from its private socket structures, this checks that
+// they are where they are expected against what the system says of sockets SDL_net opened, and
+// sets the error if they are not
+int SDLNet_CheckSocketHandles(void);
+
+/* Address */
+
+// long enough for "255.255.255.255:65535"
+#define ADDRESS_STRLEN 22
+
+char *SDLNet_FormatAddress(const IPaddress *address, char *buffer, int size);
+
 /* TCP */
+
+// every message on a TCP stream is prefixed with its length as a big-endian 16-bit integer
+#define TCP_HEADER_SIZE 2
+#define TCP_MAX_MESSAGE 0xFFFF
+
+// received bytes are accumulated in a ring buffer until a whole message is available,
+// at which point it is copied out into data/len
 typedef struct
 {
     Uint8 *data;
     int len;
     int maxlen;
+    Uint8 *buffer;
+    int size;
+    int head;
+    int count;
 } TCPpacket;
 
+// SDL_net only listens on every interface, this listens on the host of the address, or on every
+// interface if it is INADDR_ANY
+TCPsocket SDLNet_TCP_Listen(const IPaddress *address);
 TCPpacket *SDLNet_TCP_AllocPacket(int size);
 int SDLNet_TCP_SendExt(TCPsocket socket, void *data, int len);
 int SDLNet_TCP_RecvExt(TCPsocket socket, TCPpacket *packet);
+int SDLNet_TCP_NextPacket(TCPpacket *packet);
 void SDLNet_TCP_FreePacket(TCPpacket *packet);
 
+/* Pool */
+
+// fixed size blocks carved out of slabs that are never given back until the pool is freed, so once
+// it has grown to the working set acquiring and releasing a block never touches the heap, blocks can
+// be released from any thread but only the thread that owns the pool may acquire them
+typedef struct _SDLNet_Pool *SDLNet_Pool;
+
+SDLNet_Pool SDLNet_AllocPool(int block_size, int blocks_per_slab);
+void *SDLNet_PoolAcquire(SDLNet_Pool pool);
+void SDLNet_PoolRelease(SDLNet_Pool pool, void *block);
+int SDLNet_PoolBlockSize(SDLNet_Pool pool);
+void SDLNet_FreePool(SDLNet_Pool pool);
+
+/* TCP send queue */
+
+// an immutable framed message, shared by reference between every queue it is sent to,
+// the queues can belong to different threads so the count is atomic
+typedef struct
+{
+    SDL_atomic_t refcount;
+    SDLNet_Pool pool;
+    int len;
+    Uint8 data[];
+} TCPbuffer;
+
+// a bounded queue of references to buffers waiting to be written to a socket
+typedef struct
+{
+    TCPbuffer **buffers;
+    int capacity;
+    int head;
+    int count;
+    int offset;
+    int bytes;
+    int maxbytes;
+} TCPqueue;
+
+TCPbuffer *SDLNet_TCP_AllocBuffer(const void *data, int len);
+// a buffer of up to size bytes written as they are, without the length prefix, for protocols of their
+// own, the caller fills in the data and sets the length
+TCPbuffer *SDLNet_TCP_AllocRawBuffer(int size);
+TCPbuffer *SDLNet_TCP_AcquireBuffer(SDLNet_Pool pool, const void *data, int len);
+void SDLNet_TCP_RetainBuffer(TCPbuffer *buffer);
+void SDLNet_TCP_ReleaseBuffer(TCPbuffer *buffer);
+
+TCPqueue *SDLNet_TCP_AllocQueue(int maxbytes);
+int SDLNet_TCP_Enqueue(TCPqueue *queue, TCPbuffer *buffer);
+int SDLNet_TCP_Flush(TCPsocket socket, TCPqueue *queue);
+void SDLNet_TCP_FreeQueue(TCPqueue *queue);
+
+/* Poller */
+
+// waits for readability on many sockets at once without the FD_SETSIZE limit of socket sets
+typedef struct _SDLNet_Poller *SDLNet_Poller;
+
+SDLNet_Poller SDLNet_AllocPoller(void);
+int SDLNet_PollerAdd(SDLNet_Poller poller, void *socket, void *userdata);
+int SDLNet_PollerDel(SDLNet_Poller poller, void *socket);
+int SDLNet_PollerWatchWrite(SDLNet_Poller poller, void *socket, int enable);
+int SDLNet_PollerWait(SDLNet_Poller poller, Uint32 timeout);
+void *SDLNet_PollerReady(SDLNet_Poller poller, int index);
+void SDLNet_FreePoller(SDLNet_Poller poller);
+
+/* Wakeup */
+
+// interrupts a thread blocked on a poller from another thread, by sending a datagram to a
+// loopback socket that the poller watches
+typedef struct
+{
+    UDPsocket socket;
+    IPaddress address;
+    SDL_atomic_t pending;
+} SDLNet_Wakeup;
+
+SDLNet_Wakeup *SDLNet_AllocWakeup(void);
+void SDLNet_Wake(SDLNet_Wakeup *wakeup);
+void SDLNet_ClearWakeup(SDLNet_Wakeup *wakeup);
+void SDLNet_FreeWakeup(SDLNet_Wakeup *wakeup);
+
 /* UDP */
+
+// the most datagrams moved by a single batched system call
+#define UDP_MAX_BATCH 64
+
+UDPsocket SDLNet_UDP_OpenShared(Uint16 port);
 UDPpacket *SDLNet_UDP_AllocPacket(int size);
 int SDLNet_UDP_SendExt(UDPsocket socket, UDPpacket *packet, IPaddress address, void *data, int len);
 int SDLNet_UDP_RecvExt(UDPsocket socket, UDPpacket *packet);
+int SDLNet_UDP_RecvBatch(UDPsocket socket, UDPpacket **packets, int count);
+// a datagram that can't be sent is skipped, the rest still are, returns how many were sent and
+// sets the error for the last that wasn't
+int SDLNet_UDP_SendBatch(UDPsocket socket, UDPpacket **packets, int count);
 void SDLNet_UDP_FreePacket(UDPpacket *packet);
 
 #endif
@@ -0,0 +1,68 @@
+#include "alloc.h"
+
+#include <SDL2/SDL.h>
+
+// the functions SDL was using before, every call is passed on to them
+static SDL_malloc_func real_malloc;
+static SDL_calloc_func real_calloc;
+static SDL_realloc_func real_realloc;
+static SDL_free_func real_free;
+
+// bumped from whichever thread allocates, the byte total is too wide for an atomic so it takes a lock
+static SDL_atomic_t allocations;
+static SDL_SpinLock bytes_lock;
+static Uint64 bytes;
+
+static void add_allocation(size_t size)
+{
+    SDL_AtomicAdd(&allocations, 1);
+
+    SDL_AtomicLock(&bytes_lock);
+    bytes += size;
+    SDL_AtomicUnlock(&bytes_lock);
+}
+
+static void *count_malloc(size_t size)
+{
+    add_allocation(size);
+    return real_malloc(size);
+}
+
+static void *count_calloc(size_t count, size_t size)
+{
+    add_allocation(count * size);
+    return real_calloc(count, size);
+}
+
+static void *count_realloc(void *pointer, size_t size)
+{
+    add_allocation(size);
+    return real_realloc(pointer, size);
+}
+
+static void count_free(void *pointer)
+{
+    real_free(pointer);
+}
+
+bool alloc_count_install(void)
+{
+    SDL_GetMemoryFunctions(&real_malloc, &real_calloc, &real_realloc, &real_free);
+
+    return SDL_SetMemoryFunctions(count_malloc, count_calloc, count_realloc, count_free) == 0;
+}
+
+int alloc_count_take(void)
+{
+    return SDL_AtomicSet(&allocations, 0);
+}
+
+Uint64 alloc_bytes_take(void)
+{
+    SDL_AtomicLock(&bytes_lock);
+    Uint64 taken = bytes;
+    bytes = 0;
+    SDL_AtomicUnlock(&bytes_lock);
+
+    return taken;
+}
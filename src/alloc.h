@@ -0,0 +1,17 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+// routes SDL_malloc and friends, which this program and SDL_net allocate through, via counters,
+// has to be installed before SDL allocates anything
+bool alloc_count_install(void);
+
+// how many allocations and reallocations have been made since the last call
+int alloc_count_take(void);
+
+// how many bytes those asked for
+Uint64 alloc_bytes_take(void);
+
+#endif
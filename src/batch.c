@@ -0,0 +1,106 @@
+#include "batch.h"
+
+#include <string.h>
+
+// lengths up to this take one byte, the rest two
+#define BATCH_SHORT_LENGTH 0x80
+
+bool batch_add(struct batch *batch, int mtu, const unsigned char *message, int len)
+{
+    if (batch->count == 0)
+    {
+        batch->data[0] = DATA_TAG(DATA_BATCH);
+        batch->len = 1;
+    }
+
+    int prefix = len < BATCH_SHORT_LENGTH ? 1 : 2;
+    int limit = batch->count > 0 ? mtu : 1 + prefix + mtu;
+    if (batch->len + prefix + len > limit)
+    {
+        return false;
+    }
+
+    if (prefix == 1)
+    {
+        batch->data[batch->len++] = (unsigned char)len;
+    }
+    else
+    {
+        batch->data[batch->len++] = (unsigned char)(len | BATCH_SHORT_LENGTH);
+        batch->data[batch->len++] = (unsigned char)(len >> 7);
+    }
+
+    memcpy(batch->data + batch->len, message, len);
+    batch->len += len;
+    batch->count++;
+
+    return true;
+}
+
+int batch_flush(struct batch *batch, unsigned char *buffer)
+{
+    // a lone message doesn't need the tag or its length
+    int start = 0;
+    if (batch->count == 1)
+    {
+        start = batch->data[1] & BATCH_SHORT_LENGTH ? 3 : 2;
+    }
+
+    int len = batch->len - start;
+    memcpy(buffer, batch->data + start, len);
+
+    batch->len = 0;
+    batch->count = 0;
+
+    return len;
+}
+
+int batch_next(const unsigned char *datagram, int len, int *pos, const unsigned char **message)
+{
+    int type = data_peek_type(datagram, len);
+    if (type == -1)
+    {
+        return -1;
+    }
+
+    if (type != DATA_BATCH)
+    {
+        if (*pos > 0)
+        {
+            return 0;
+        }
+
+        *pos = len;
+        *message = datagram;
+        return len;
+    }
+
+    if (*pos == 0)
+    {
+        *pos = 1;
+    }
+
+    if (*pos >= len)
+    {
+        return 0;
+    }
+
+    int length = datagram[(*pos)++];
+    if (length & BATCH_SHORT_LENGTH)
+    {
+        if (*pos >= len || datagram[*pos] & BATCH_SHORT_LENGTH)
+        {
+            return -1;
+        }
+        length = (length & (BATCH_SHORT_LENGTH - 1)) | datagram[(*pos)++] << 7;
+    }
+
+    if (length == 0 || length > len - *pos)
+    {
+        return -1;
+    }
+
+    *message = datagram + *pos;
+    *pos += length;
+    return length;
+}
@@ -0,0 +1,38 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+
+#include "data.h"
+
+// what datagrams are kept to unless told otherwise, small enough to get through any path without
+// being fragmented
+#define BATCH_DEFAULT_MTU 1200
+
+// the least the MTU can be lowered to, what every IPv4 host must be able to take in after the
+// largest IP and the UDP headers
+#define BATCH_MIN_MTU 508
+
+// small messages for the same peer gathered into one datagram instead of each paying for its own
+// IP and UDP headers, a batch is the DATA_BATCH tag followed by every message prefixed with its
+// length as a one or two byte varint, except that a batch of one is sent as the bare message
+struct batch
+{
+    int len;
+    int count;
+    // room for the tag and a length ahead of a lone message as large as a datagram
+    unsigned char data[1 + 2 + PACKET_SIZE];
+};
+
+// returns false if the message doesn't fit in the MTU alongside what is already there, so the
+// batch has to be flushed first, or if it doesn't fit even on its own and has to be fragmented
+bool batch_add(struct batch *batch, int mtu, const unsigned char *message, int len);
+
+// writes out the datagram and empties the batch, returns its length
+int batch_flush(struct batch *batch, unsigned char *buffer);
+
+// the next message of a received datagram, which is the whole datagram if it isn't a batch,
+// pos starts at 0, returns the message's length, 0 after the last or -1 if the datagram is malformed
+int batch_next(const unsigned char *datagram, int len, int *pos, const unsigned char **message);
+
+#endif
@@ -0,0 +1,759 @@
+#include "bench.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_net.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "compress.h"
+#include "data.h"
+#include "fragment.h"
+#include "log.h"
+#include "loop.h"
+#include "metrics.h"
+#include "SDL_net_ext.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#define SERVER_HOST "127.0.0.1"
+#define SERVER_PORT 1000
+
+#define DEFAULT_CONNECTIONS 100
+#define DEFAULT_CHAT_RATE 1.0
+#define DEFAULT_MOUSE_RATE 10.0
+#define DEFAULT_DURATION 30
+
+// connections are opened a few at a time between servicing the ones already open, so the
+// connect time measured isn't how long the rest took to open
+#define CONNECTS_PER_WAKEUP 16
+
+// how often due traffic is sent, and statistics are reported
+#define TRAFFIC_INTERVAL 10
+#define REPORT_INTERVAL 5000
+
+// chats carry the time they were sent, so whoever the server relays them to can tell how long it took
+#define CHAT_PREFIX "bench "
+
+// a simulated client, with its own TCP connection and UDP socket like the real one
+struct connection
+{
+    int id;
+    TCPsocket tcp_socket;
+    TCPpacket *tcp_packet;
+    UDPsocket udp_socket;
+    Uint64 connect_start;
+    bool connected;
+    bool closed;
+    unsigned int acked;
+
+    // the poller can report both sockets, they are read together the first time
+    Uint64 serviced;
+
+    // unreliable messages, sent together with the traffic every interval
+    struct batch batch;
+
+    // and the messages that arrive in fragments, put back together
+    struct reassembly reassembly;
+};
+
+static struct connection *connections;
+static int num_opened;
+static int num_connected;
+static int num_closed;
+
+static UDPpacket *udp_packet;
+static IPaddress server_address;
+static Uint64 frequency;
+static int mtu = BATCH_DEFAULT_MTU;
+static int features = DATA_FEATURE_COMPRESSION;
+
+static struct histogram connect_times;
+static struct histogram join_times;
+static struct histogram latencies;
+static struct histogram total_latencies;
+
+static Uint64 chats_sent;
+static Uint64 mice_sent;
+static Uint64 chats_received;
+static Uint64 snapshots_received;
+static Uint64 datagrams_sent;
+static Uint64 datagram_messages_sent;
+static Uint64 datagrams_received;
+static Uint64 datagram_messages_received;
+static Uint64 messages_reassembled;
+static Uint64 messages_expired;
+
+// latencies are recorded in microseconds
+static void histogram_report(const char *name, const struct histogram *histogram)
+{
+    log_info("%s: %llu samples, p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, p99.9 %.2f ms, max %.2f ms",
+             name,
+             (unsigned long long)histogram->total,
+             histogram_percentile(histogram, 50) / 1000.0,
+             histogram_percentile(histogram, 90) / 1000.0,
+             histogram_percentile(histogram, 99) / 1000.0,
+             histogram_percentile(histogram, 99.9) / 1000.0,
+             histogram->max / 1000.0);
+}
+
+static Uint32 elapsed_us(Uint64 start, Uint64 end)
+{
+    Uint64 us = (end - start) * 1000000 / frequency;
+    return us > 0xFFFFFFFF ? 0xFFFFFFFF : (Uint32)us;
+}
+
+static void raise_descriptor_limit(void)
+{
+#ifndef _WIN32
+    // every simulated client needs two sockets, which soon runs into the default soft limit
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0)
+        {
+            log_debug("Couldn't raise the open file limit");
+        }
+    }
+#endif
+}
+
+static void send_tcp(struct connection *connection, const struct data *data)
+{
+    unsigned char buffer[DATA_MAX_ENCODED_SIZE];
+    int len = data_encode(data, buffer, sizeof(buffer));
+    SDLNet_TCP_SendExt(connection->tcp_socket, buffer, len);
+}
+
+static void flush_udp(struct connection *connection)
+{
+    if (connection->batch.count > 0)
+    {
+        datagrams_sent++;
+        datagram_messages_sent += connection->batch.count;
+
+        int len = batch_flush(&connection->batch, udp_packet->data);
+        SDLNet_UDP_SendExt(connection->udp_socket, udp_packet, server_address, udp_packet->data, len);
+    }
+}
+
+static void send_udp(struct connection *connection, const struct data *data)
+{
+    unsigned char buffer[DATA_MAX_ENCODED_SIZE];
+    int len = data_encode(data, buffer, sizeof(buffer));
+    if (!batch_add(&connection->batch, mtu, buffer, len))
+    {
+        flush_udp(connection);
+        batch_add(&connection->batch, mtu, buffer, len);
+    }
+}
+
+static void close_connection(SDLNet_Poller poller, struct connection *connection)
+{
+    SDLNet_PollerDel(poller, connection->udp_socket);
+    SDLNet_PollerDel(poller, connection->tcp_socket);
+    SDLNet_UDP_Close(connection->udp_socket);
+    SDLNet_TCP_Close(connection->tcp_socket);
+    SDLNet_TCP_FreePacket(connection->tcp_packet);
+
+    if (connection->connected)
+    {
+        num_connected--;
+    }
+
+    connection->connected = false;
+    connection->closed = true;
+    num_closed++;
+}
+
+static bool open_connection(SDLNet_Poller poller, struct connection *connection)
+{
+    connection->connect_start = SDL_GetPerformanceCounter();
+
+    connection->tcp_socket = SDLNet_TCP_Open(&server_address);
+    if (!connection->tcp_socket)
+    {
+        log_error("%s", SDLNet_GetError());
+        return false;
+    }
+
+    connection->tcp_packet = SDLNet_TCP_AllocPacket(PACKET_SIZE);
+    if (!connection->tcp_packet)
+    {
+        log_error("%s", SDLNet_GetError());
+        SDLNet_TCP_Close(connection->tcp_socket);
+        return false;
+    }
+
+    connection->udp_socket = SDLNet_UDP_Open(0);
+    if (!connection->udp_socket)
+    {
+        log_error("%s", SDLNet_GetError());
+        SDLNet_TCP_FreePacket(connection->tcp_packet);
+        SDLNet_TCP_Close(connection->tcp_socket);
+        return false;
+    }
+
+    SDLNet_PollerAdd(poller, connection->tcp_socket, connection);
+    SDLNet_PollerAdd(poller, connection->udp_socket, connection);
+
+    struct connect_data connect_data = connect_data_create(DATA_CONNECT_REQUEST, 0, features);
+    send_tcp(connection, &connect_data.data);
+
+    return true;
+}
+
+static void handle_chat(const struct chat_data *chat_data)
+{
+    chats_received++;
+
+    // chats from anything other than the load generator have no time to measure
+    int prefix = (int)strlen(CHAT_PREFIX);
+    char sent[32];
+    if (chat_data->length <= prefix ||
+        chat_data->length - prefix >= (int)sizeof(sent) ||
+        memcmp(chat_data->message, CHAT_PREFIX, prefix) != 0)
+    {
+        return;
+    }
+
+    memcpy(sent, chat_data->message + prefix, chat_data->length - prefix);
+    sent[chat_data->length - prefix] = '\0';
+
+    Uint32 latency = elapsed_us(strtoull(sent, NULL, 10), SDL_GetPerformanceCounter());
+    histogram_add(&latencies, latency);
+    histogram_add(&total_latencies, latency);
+}
+
+static void handle_message(SDLNet_Poller poller, struct connection *connection, const unsigned char *buffer, int len)
+{
+    unsigned char decompressed[DATA_MAX_ENCODED_SIZE];
+    len = decompress_received(&buffer, len, decompressed, sizeof(decompressed));
+
+    union data_any message;
+    if (len == -1 || data_decode(&message, buffer, len) == -1)
+    {
+        log_warn("Malformed message");
+        return;
+    }
+
+    struct data *data = &message.data;
+    switch (data->type)
+    {
+    case DATA_CONNECT_OK:
+    {
+        struct connect_data *connect_data = (struct connect_data *)data;
+        connection->id = connect_data->id;
+        connection->connected = true;
+        num_connected++;
+        histogram_add(&connect_times, elapsed_us(connection->connect_start, SDL_GetPerformanceCounter()));
+
+        // make a UDP "connection" to the server, with the token it sent
+        struct connect_data request = connect_data_create(DATA_UDP_CONNECT_REQUEST, connection->id, 0);
+        request.cookie = connect_data->cookie;
+        send_udp(connection, &request.data);
+    }
+    break;
+    case DATA_CONNECT_FULL:
+    {
+        log_warn("Server is full");
+        close_connection(poller, connection);
+    }
+    break;
+    case DATA_CHAT_BROADCAST:
+    {
+        handle_chat((struct chat_data *)data);
+    }
+    break;
+    case DATA_PING:
+    {
+        // the server pings over TCP until it knows the UDP address
+        struct ping_data *ping_data = (struct ping_data *)data;
+        struct ping_data pong_data = ping_data_create(DATA_PONG, connection->id, SDL_GetTicks(), ping_data->server_time);
+        send_tcp(connection, &pong_data.data);
+    }
+    break;
+    case DATA_CATCH_UP:
+    {
+        // joining takes until the last of the roster and chat history has arrived
+        struct catch_up_data *catch_up_data = (struct catch_up_data *)data;
+        if (!catch_up_data->more)
+        {
+            histogram_add(&join_times, elapsed_us(connection->connect_start, SDL_GetPerformanceCounter()));
+        }
+    }
+    break;
+    case DATA_CONNECT_BROADCAST:
+    case DATA_DISCONNECT_BROADCAST:
+        break;
+    default:
+    {
+        log_warn("Unknown message type");
+    }
+    break;
+    }
+}
+
+static void handle_datagram_message(struct connection *connection, const unsigned char *buffer, int len)
+{
+    union data_any message;
+    if (data_decode(&message, buffer, len) == -1)
+    {
+        log_warn("UDP: Malformed packet");
+        return;
+    }
+
+    // the contents don't matter, but acknowledging them keeps the server sending deltas like it would to a real client
+    struct data *data = &message.data;
+    unsigned int sequence;
+    switch (data->type)
+    {
+    case DATA_SNAPSHOT:
+    {
+        sequence = ((struct snapshot_data *)data)->sequence;
+    }
+    break;
+    case DATA_SNAPSHOT_DELTA:
+    {
+        sequence = ((struct delta_data *)data)->sequence;
+    }
+    break;
+    case DATA_PING:
+    {
+        // answered so the server doesn't time the simulated client out, and has a round trip to measure
+        struct ping_data *ping_data = (struct ping_data *)data;
+        struct ping_data pong_data = ping_data_create(DATA_PONG, connection->id, SDL_GetTicks(), ping_data->server_time);
+        send_udp(connection, &pong_data.data);
+        flush_udp(connection);
+        return;
+    }
+    default:
+    {
+        return;
+    }
+    }
+
+    snapshots_received++;
+
+    if (connection->connected && (int)(sequence - connection->acked) > 0)
+    {
+        connection->acked = sequence;
+        struct ack_data ack_data = ack_data_create(DATA_SNAPSHOT_ACK, connection->id, sequence);
+        send_udp(connection, &ack_data.data);
+    }
+}
+
+static void handle_datagram(struct connection *connection, const UDPpacket *packet)
+{
+    datagrams_received++;
+
+    // a fragment is held until the rest of its message arrives
+    const unsigned char *datagram = packet->data;
+    int datagram_len = packet->len;
+    if (data_peek_type(datagram, datagram_len) == DATA_FRAGMENT)
+    {
+        Uint64 expired = connection->reassembly.expired;
+        datagram_len = reassembly_add(&connection->reassembly, datagram, datagram_len, SDL_GetTicks(), &datagram);
+        messages_expired += connection->reassembly.expired - expired;
+        if (datagram_len == -1)
+        {
+            log_warn("UDP: Malformed packet");
+        }
+
+        if (datagram_len <= 0)
+        {
+            return;
+        }
+
+        messages_reassembled++;
+    }
+
+    int pos = 0;
+    const unsigned char *buffer;
+    int len;
+    while ((len = batch_next(datagram, datagram_len, &pos, &buffer)) > 0)
+    {
+        datagram_messages_received++;
+        handle_datagram_message(connection, buffer, len);
+    }
+
+    if (len != 0)
+    {
+        log_warn("UDP: Malformed packet");
+    }
+}
+
+static void service_connection(SDLNet_Poller poller, struct connection *connection, UDPpacket *recv_packet)
+{
+    if (SDLNet_SocketReady(connection->tcp_socket))
+    {
+        if (SDLNet_TCP_RecvExt(connection->tcp_socket, connection->tcp_packet) <= 0)
+        {
+            log_warn("Simulated client %d was disconnected", connection->id);
+            close_connection(poller, connection);
+            return;
+        }
+
+        // a single read can contain several messages, or only part of one
+        int next = 0;
+        while (!connection->closed && (next = SDLNet_TCP_NextPacket(connection->tcp_packet)) == 1)
+        {
+            handle_message(poller, connection, connection->tcp_packet->data, connection->tcp_packet->len);
+        }
+
+        if (connection->closed)
+        {
+            return;
+        }
+
+        if (next == -1)
+        {
+            log_error("%s", SDLNet_GetError());
+            close_connection(poller, connection);
+            return;
+        }
+    }
+
+    if (SDLNet_SocketReady(connection->udp_socket))
+    {
+        while (SDLNet_UDP_RecvExt(connection->udp_socket, recv_packet) == 1)
+        {
+            handle_datagram(connection, recv_packet);
+        }
+    }
+}
+
+static void send_traffic(double chat_rate, double mouse_rate, double seconds, double *chats_due, double *mice_due)
+{
+    static int next_chat;
+    static int next_mouse;
+
+    if (num_connected == 0)
+    {
+        return;
+    }
+
+    // spread the messages over the clients in turn, so the totals stay on the requested rates
+    // however the interval between calls varies
+    *chats_due += chat_rate * num_connected * seconds;
+    *mice_due += mouse_rate * num_connected * seconds;
+
+    for (; *chats_due >= 1; *chats_due -= 1)
+    {
+        struct connection *connection = &connections[next_chat++ % num_opened];
+        if (!connection->connected)
+        {
+            continue;
+        }
+
+        char message[32];
+        snprintf(message, sizeof(message), CHAT_PREFIX "%llu", (unsigned long long)SDL_GetPerformanceCounter());
+        struct chat_data chat_data = chat_data_create(DATA_CHAT_REQUEST, connection->id, message);
+        send_tcp(connection, &chat_data.data);
+        chats_sent++;
+    }
+
+    for (; *mice_due >= 1; *mice_due -= 1)
+    {
+        struct connection *connection = &connections[next_mouse++ % num_opened];
+        if (!connection->connected)
+        {
+            continue;
+        }
+
+        int step = (int)mice_sent;
+        struct mouse_data mouse_data = mouse_data_create(DATA_MOUSEDOWN_REQUEST, connection->id, step * 37 % WORLD_WIDTH, step * 23 % WORLD_HEIGHT);
+        send_udp(connection, &mouse_data.data);
+        mice_sent++;
+    }
+}
+
+int bench_main(int argc, char *argv[])
+{
+    // parse options
+    int num_connections = DEFAULT_CONNECTIONS;
+    double chat_rate = DEFAULT_CHAT_RATE;
+    double mouse_rate = DEFAULT_MOUSE_RATE;
+    int duration = DEFAULT_DURATION;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            break;
+        }
+
+        if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--connections") == 0)
+        {
+            int value = atoi(argv[++i]);
+            num_connections = SDL_max(1, value);
+        }
+        else if (strcmp(argv[i], "--chat-rate") == 0)
+        {
+            double value = atof(argv[++i]);
+            chat_rate = SDL_max(0.0, value);
+        }
+        else if (strcmp(argv[i], "--mouse-rate") == 0)
+        {
+            double value = atof(argv[++i]);
+            mouse_rate = SDL_max(0.0, value);
+        }
+        else if (strcmp(argv[i], "--duration") == 0)
+        {
+            int value = atoi(argv[++i]);
+            duration = SDL_max(1, value);
+        }
+        else if (strcmp(argv[i], "--mtu") == 0)
+        {
+            int value = atoi(argv[++i]);
+            mtu = SDL_max(BATCH_MIN_MTU, SDL_min(value, PACKET_SIZE));
+        }
+        else if (strcmp(argv[i], "--no-compress") == 0)
+        {
+            features &= ~DATA_FEATURE_COMPRESSION;
+        }
+    }
+
+    // init SDL, without video since nothing is drawn
+    if (SDL_Init(SDL_INIT_TIMER) != 0)
+    {
+        log_error("%s", SDL_GetError());
+        return 1;
+    }
+
+    // init SDL_net
+    if (SDLNet_Init() != 0)
+    {
+        log_error("%s", SDLNet_GetError());
+        return 1;
+    }
+
+    // the socket handles are read from SDL_net's own structures, so make sure that still works
+    if (SDLNet_CheckSocketHandles() != 0)
+    {
+        log_error("%s", SDLNet_GetError());
+        return 1;
+    }
+
+    raise_descriptor_limit();
+
+    // setup server info
+    if (SDLNet_ResolveHost(&server_address, SERVER_HOST, SERVER_PORT))
+    {
+        log_error("%s", SDLNet_GetError());
+        return 1;
+    }
+
+    connections = SDL_calloc(num_connections, sizeof(struct connection));
+    if (!connections)
+    {
+        log_error("Couldn't allocate connections");
+        return 1;
+    }
+
+    // allocate UDP packets, every simulated client sends from one and receives into the other
+    udp_packet = SDLNet_UDP_AllocPacket(PACKET_SIZE);
+    if (!udp_packet)
+    {
+        log_error("%s", SDLNet_GetError());
+        return 1;
+    }
+
+    UDPpacket *udp_recv_packet = SDLNet_UDP_AllocPacket(PACKET_SIZE);
+    if (!udp_recv_packet)
+    {
+        log_error("%s", SDLNet_GetError());
+        return 1;
+    }
+
+    // allocate poller
+    SDLNet_Poller poller = SDLNet_AllocPoller();
+    if (!poller)
+    {
+        log_error("%s", SDLNet_GetError());
+        return 1;
+    }
+
+    log_info("Bench: %d clients, %.2f chats/s and %.2f clicks/s each, for %d s",
+             num_connections, chat_rate, mouse_rate, duration);
+
+    // setup the event loop
+    struct loop loop;
+    loop_init(&loop, TRAFFIC_INTERVAL);
+
+    struct timer traffic_timer;
+    timer_init(&loop, &traffic_timer, TRAFFIC_INTERVAL);
+
+    struct timer report_timer;
+    timer_init(&loop, &report_timer, REPORT_INTERVAL);
+
+    frequency = SDL_GetPerformanceFrequency();
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint64 end = start + (Uint64)duration * frequency;
+    Uint64 last_traffic = start;
+    Uint64 last_report = start;
+    Uint64 all_connected = 0;
+    double chats_due = 0;
+    double mice_due = 0;
+    Uint64 wakeups = 0;
+
+    Uint64 total_chats_sent = 0;
+    Uint64 total_mice_sent = 0;
+    Uint64 total_chats_received = 0;
+
+    // main loop
+    while (SDL_GetPerformanceCounter() < end)
+    {
+        // ramp up the connections
+        for (int i = 0; i < CONNECTS_PER_WAKEUP && num_opened < num_connections; i++)
+        {
+            if (!open_connection(poller, &connections[num_opened]))
+            {
+                // stop ramping up, but keep loading the server with what did connect
+                num_connections = num_opened;
+                break;
+            }
+
+            num_opened++;
+        }
+
+        if (!all_connected && num_opened == num_connections && num_connected + num_closed == num_opened)
+        {
+            all_connected = SDL_GetPerformanceCounter();
+            log_info("Connected %d clients in %.2f s", num_connected, (double)(all_connected - start) / frequency);
+            histogram_report("Connect time", &connect_times);
+            histogram_report("Join time", &join_times);
+        }
+
+        // block until there are network events or it is time to send more
+        int ready = loop_wait(&loop, poller);
+        if (ready == -1)
+        {
+            log_error("%s", SDLNet_GetError());
+            break;
+        }
+
+        wakeups++;
+        for (int i = 0; i < ready; i++)
+        {
+            struct connection *connection = SDLNet_PollerReady(poller, i);
+            if (!connection || connection->closed || connection->serviced == wakeups)
+            {
+                continue;
+            }
+
+            connection->serviced = wakeups;
+            service_connection(poller, connection, udp_recv_packet);
+        }
+
+        if (timer_update(&loop, &traffic_timer))
+        {
+            Uint64 now = SDL_GetPerformanceCounter();
+            send_traffic(chat_rate, mouse_rate, (double)(now - last_traffic) / frequency, &chats_due, &mice_due);
+            last_traffic = now;
+
+            // like the real client, what each simulated client has to send goes out in one datagram per interval
+            for (int i = 0; i < num_opened; i++)
+            {
+                if (!connections[i].closed)
+                {
+                    flush_udp(&connections[i]);
+                }
+            }
+        }
+
+        // report how much traffic is getting through and how long chats take to be relayed
+        if (timer_update(&loop, &report_timer))
+        {
+            Uint64 now = SDL_GetPerformanceCounter();
+            double seconds = (double)(now - last_report) / frequency;
+            last_report = now;
+
+            log_info("Traffic: %d connected, sent %.0f chats/s and %.0f clicks/s, received %.0f chats/s and %.0f snapshots/s",
+                     num_connected,
+                     chats_sent / seconds,
+                     mice_sent / seconds,
+                     chats_received / seconds,
+                     snapshots_received / seconds);
+            histogram_report("Chat latency", &latencies);
+
+            log_info("Datagrams: %llu sent with %.2f messages each, %llu received with %.2f messages each",
+                     (unsigned long long)datagrams_sent,
+                     datagrams_sent > 0 ? (double)datagram_messages_sent / datagrams_sent : 0.0,
+                     (unsigned long long)datagrams_received,
+                     datagrams_received > 0 ? (double)datagram_messages_received / datagrams_received : 0.0);
+
+            log_info("Fragments: %llu messages reassembled, %llu given up on",
+                     (unsigned long long)messages_reassembled,
+                     (unsigned long long)messages_expired);
+
+            total_chats_sent += chats_sent;
+            total_mice_sent += mice_sent;
+            total_chats_received += chats_received;
+            chats_sent = 0;
+            mice_sent = 0;
+            chats_received = 0;
+            snapshots_received = 0;
+            datagrams_sent = 0;
+            datagram_messages_sent = 0;
+            datagrams_received = 0;
+            datagram_messages_received = 0;
+            messages_reassembled = 0;
+            messages_expired = 0;
+            memset(&latencies, 0, sizeof(latencies));
+        }
+    }
+
+    // summarize the whole run, from the moment everything was connected if it ever was
+    {
+        total_chats_sent += chats_sent;
+        total_mice_sent += mice_sent;
+        total_chats_received += chats_received;
+
+        Uint64 now = SDL_GetPerformanceCounter();
+        double seconds = (double)(now - start) / frequency;
+
+        if (!all_connected)
+        {
+            log_warn("Only %d of %d clients connected", num_connected, num_connections);
+            histogram_report("Connect time", &connect_times);
+            histogram_report("Join time", &join_times);
+        }
+
+        log_info("Sustained: %.0f messages/s sent, %.0f chats/s received over %.1f s",
+                 (total_chats_sent + total_mice_sent) / seconds,
+                 total_chats_received / seconds,
+                 seconds);
+        histogram_report("Chat latency", &total_latencies);
+    }
+
+    // disconnect everyone
+    for (int i = 0; i < num_opened; i++)
+    {
+        struct connection *connection = &connections[i];
+        if (connection->closed)
+        {
+            continue;
+        }
+
+        struct data data = data_create(DATA_DISCONNECT_REQUEST);
+        send_tcp(connection, &data);
+        close_connection(poller, connection);
+    }
+
+    // close SDL_net
+    SDLNet_FreePoller(poller);
+    SDLNet_UDP_FreePacket(udp_recv_packet);
+    SDLNet_UDP_FreePacket(udp_packet);
+    SDL_free(connections);
+    SDLNet_Quit();
+
+    // close SDL
+    SDL_Quit();
+
+    return 0;
+}
@@ -0,0 +1,435 @@
+#include "channel.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_net.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+struct channel *channel_alloc(int id, int backlog_size)
+{
+    struct channel *channel = SDL_calloc(1, sizeof(struct channel));
+
+    if (!channel)
+    {
+        SDLNet_SetError("Couldn't allocate channel");
+
+        return NULL;
+    }
+
+    channel->id = id;
+    channel->rto = CHANNEL_INITIAL_RTO;
+    channel->backlog_size = backlog_size;
+
+    return channel;
+}
+
+static bool window_full(const struct channel_stream *channel_stream)
+{
+    return (Uint16)(channel_stream->next_send - channel_stream->oldest) >= CHANNEL_WINDOW;
+}
+
+static void push_window(struct channel_stream *channel_stream, const void *data, int len)
+{
+    struct channel_message *message = &channel_stream->sent[channel_stream->next_send % CHANNEL_WINDOW];
+    message->id = channel_stream->next_send++;
+    message->used = true;
+    message->acked = false;
+    message->sent = false;
+    message->len = len;
+    memcpy(message->data, data, len);
+}
+
+static int push_backlog(struct channel *channel, struct channel_stream *channel_stream, const void *data, int len)
+{
+    if (channel->backlog_bytes + len > channel->backlog_size)
+    {
+        SDLNet_SetError("Channel backlog is full");
+
+        return -1;
+    }
+
+    if (channel_stream->backlog_len + 2 + len > channel_stream->backlog_capacity)
+    {
+        // move what is left to the front before growing
+        if (channel_stream->backlog_head > 0)
+        {
+            channel_stream->backlog_len -= channel_stream->backlog_head;
+            memmove(channel_stream->backlog,
+                    channel_stream->backlog + channel_stream->backlog_head,
+                    channel_stream->backlog_len);
+            channel_stream->backlog_head = 0;
+        }
+
+        if (channel_stream->backlog_len + 2 + len > channel_stream->backlog_capacity)
+        {
+            int capacity = SDL_max(channel_stream->backlog_capacity * 2, channel_stream->backlog_len + 2 + len);
+            Uint8 *backlog = SDL_realloc(channel_stream->backlog, capacity);
+            if (!backlog)
+            {
+                SDLNet_SetError("Couldn't allocate channel backlog");
+
+                return -1;
+            }
+            channel_stream->backlog = backlog;
+            channel_stream->backlog_capacity = capacity;
+        }
+    }
+
+    SDLNet_Write16((Uint16)len, channel_stream->backlog + channel_stream->backlog_len);
+    memcpy(channel_stream->backlog + channel_stream->backlog_len + 2, data, len);
+    channel_stream->backlog_len += 2 + len;
+    channel->backlog_bytes += len;
+
+    return 0;
+}
+
+static void pop_backlog(struct channel *channel, struct channel_stream *channel_stream)
+{
+    while (channel_stream->backlog_head != channel_stream->backlog_len && !window_full(channel_stream))
+    {
+        const Uint8 *record = channel_stream->backlog + channel_stream->backlog_head;
+        int len = SDLNet_Read16(record);
+        push_window(channel_stream, record + 2, len);
+        channel_stream->backlog_head += 2 + len;
+        channel->backlog_bytes -= len;
+    }
+
+    if (channel_stream->backlog_head == channel_stream->backlog_len)
+    {
+        channel_stream->backlog_head = 0;
+        channel_stream->backlog_len = 0;
+    }
+}
+
+int channel_send(struct channel *channel, int stream, const void *data, int len)
+{
+    struct channel_stream *channel_stream = &channel->streams[stream];
+
+    if (len > CHANNEL_MAX_MESSAGE)
+    {
+        SDLNet_SetError("Message is too large for a channel");
+
+        return -1;
+    }
+
+    // the receiver only buffers a window of messages ahead of the one it is waiting for, the rest
+    // wait their turn behind any already waiting
+    if (window_full(channel_stream) || channel_stream->backlog_head != channel_stream->backlog_len)
+    {
+        return push_backlog(channel, channel_stream, data, len);
+    }
+
+    push_window(channel_stream, data, len);
+
+    return 0;
+}
+
+static void update_rto(struct channel *channel, Uint32 sample)
+{
+    // the estimator from RFC 6298, in whole milliseconds
+    if (!channel->measured)
+    {
+        channel->rtt = sample;
+        channel->rtt_variance = sample / 2;
+        channel->measured = true;
+    }
+    else
+    {
+        Uint32 difference = channel->rtt > sample ? channel->rtt - sample : sample - channel->rtt;
+        channel->rtt_variance = (3 * channel->rtt_variance + difference) / 4;
+        channel->rtt = (7 * channel->rtt + sample) / 8;
+    }
+
+    Uint32 rto = channel->rtt + 4 * channel->rtt_variance;
+    channel->rto = SDL_max(CHANNEL_MIN_RTO, SDL_min(rto, CHANNEL_MAX_RTO));
+}
+
+static void ack_datagram(struct channel *channel, Uint16 sequence, Uint32 now)
+{
+    struct channel_datagram *datagram = &channel->datagrams[sequence % CHANNEL_WINDOW];
+    if (!datagram->used || datagram->sequence != sequence)
+    {
+        return;
+    }
+
+    // every datagram has its own sequence, so the sample is never confused by retransmits
+    datagram->used = false;
+    update_rto(channel, now - datagram->send_time);
+
+    for (int i = 0; i < datagram->num_messages; i++)
+    {
+        struct channel_stream *channel_stream = &channel->streams[datagram->streams[i]];
+        struct channel_message *message = &channel_stream->sent[datagram->ids[i] % CHANNEL_WINDOW];
+        if (message->used && message->id == datagram->ids[i])
+        {
+            message->acked = true;
+        }
+    }
+}
+
+static void advance_window(struct channel_stream *channel_stream)
+{
+    while (channel_stream->oldest != channel_stream->next_send)
+    {
+        struct channel_message *message = &channel_stream->sent[channel_stream->oldest % CHANNEL_WINDOW];
+        if (!message->acked)
+        {
+            break;
+        }
+
+        message->used = false;
+        channel_stream->oldest++;
+    }
+}
+
+int channel_write(struct channel *channel, Uint8 *buffer, int mtu, Uint32 now)
+{
+    struct channel_datagram *datagram = &channel->datagrams[channel->sequence % CHANNEL_WINDOW];
+    datagram->num_messages = 0;
+
+    // add every message that has not been sent yet or whose retransmit timeout has expired
+    int len = CHANNEL_HEADER_SIZE;
+    for (int stream = 0; stream < CHANNEL_STREAMS; stream++)
+    {
+        struct channel_stream *channel_stream = &channel->streams[stream];
+
+        for (Uint16 id = channel_stream->oldest; id != channel_stream->next_send; id++)
+        {
+            struct channel_message *message = &channel_stream->sent[id % CHANNEL_WINDOW];
+            if (message->acked || (message->sent && now - message->send_time < channel->rto))
+            {
+                continue;
+            }
+
+            if (datagram->num_messages == CHANNEL_MESSAGES_PER_DATAGRAM || len + 5 + message->len > mtu)
+            {
+                break;
+            }
+
+            if (message->sent)
+            {
+                channel->retransmits++;
+            }
+
+            // stream, message ID and length, then the message
+            buffer[len] = (Uint8)stream;
+            SDLNet_Write16(message->id, buffer + len + 1);
+            SDLNet_Write16((Uint16)message->len, buffer + len + 3);
+            memcpy(buffer + len + 5, message->data, message->len);
+            len += 5 + message->len;
+
+            message->sent = true;
+            message->send_time = now;
+
+            datagram->streams[datagram->num_messages] = (Uint8)stream;
+            datagram->ids[datagram->num_messages] = message->id;
+            datagram->num_messages++;
+        }
+    }
+
+    if (datagram->num_messages == 0 && !channel->ack_pending)
+    {
+        return 0;
+    }
+
+    // bit n of the ack bits is set if the datagram n before the acked one was received
+    buffer[0] = DATA_TAG(DATA_CHANNEL);
+    SDLNet_Write32((Uint32)channel->id, buffer + 1);
+    SDLNet_Write16(channel->sequence, buffer + 5);
+    SDLNet_Write16(channel->remote_sequence, buffer + 7);
+    SDLNet_Write32(channel->received_bits, buffer + 9);
+    buffer[13] = (Uint8)datagram->num_messages;
+
+    datagram->sequence = channel->sequence++;
+    datagram->used = datagram->num_messages > 0;
+    datagram->send_time = now;
+    channel->ack_pending = false;
+
+    log_trace("Channel: Sending datagram %u with %d messages", datagram->sequence, datagram->num_messages);
+
+    return len;
+}
+
+int channel_read(struct channel *channel, const Uint8 *buffer, int len, Uint32 now)
+{
+    if (len < CHANNEL_HEADER_SIZE || data_peek_type(buffer, len) != DATA_CHANNEL)
+    {
+        SDLNet_SetError("Malformed channel datagram");
+
+        return -1;
+    }
+
+    Uint16 sequence = SDLNet_Read16(buffer + 5);
+    Uint16 ack = SDLNet_Read16(buffer + 7);
+    Uint32 ack_bits = SDLNet_Read32(buffer + 9);
+    int num_messages = buffer[13];
+
+    // check the whole datagram before acting on any of it
+    int pos = CHANNEL_HEADER_SIZE;
+    for (int i = 0; i < num_messages; i++)
+    {
+        if (pos + 5 > len ||
+            buffer[pos] >= CHANNEL_STREAMS ||
+            SDLNet_Read16(buffer + pos + 3) > CHANNEL_MAX_MESSAGE ||
+            pos + 5 + SDLNet_Read16(buffer + pos + 3) > len)
+        {
+            SDLNet_SetError("Malformed channel datagram");
+
+            return -1;
+        }
+        pos += 5 + SDLNet_Read16(buffer + pos + 3);
+    }
+
+    // acknowledge what the peer has received
+    for (int i = 0; i < CHANNEL_WINDOW; i++)
+    {
+        if (ack_bits & (1u << i))
+        {
+            ack_datagram(channel, (Uint16)(ack - i), now);
+        }
+    }
+
+    // and let whatever was waiting for room in the window into it
+    for (int stream = 0; stream < CHANNEL_STREAMS; stream++)
+    {
+        advance_window(&channel->streams[stream]);
+        pop_backlog(channel, &channel->streams[stream]);
+    }
+
+    // record the datagram for our own acks
+    Sint16 ahead = (Sint16)(sequence - channel->remote_sequence);
+    if (!channel->received_any)
+    {
+        channel->received_any = true;
+        channel->remote_sequence = sequence;
+        channel->received_bits = 1;
+    }
+    else if (ahead > 0)
+    {
+        channel->received_bits = ahead < CHANNEL_WINDOW ? channel->received_bits << ahead | 1 : 1;
+        channel->remote_sequence = sequence;
+    }
+    else if (-ahead < CHANNEL_WINDOW)
+    {
+        channel->received_bits |= 1u << -ahead;
+    }
+
+    // buffer messages within the window, those already delivered are duplicates
+    pos = CHANNEL_HEADER_SIZE;
+    for (int i = 0; i < num_messages; i++)
+    {
+        struct channel_stream *channel_stream = &channel->streams[buffer[pos]];
+        Uint16 id = SDLNet_Read16(buffer + pos + 1);
+        int message_len = SDLNet_Read16(buffer + pos + 3);
+
+        Uint16 offset = (Uint16)(id - channel_stream->next_receive);
+        struct channel_message *message = &channel_stream->received[id % CHANNEL_WINDOW];
+        if (offset < CHANNEL_WINDOW && !message->used)
+        {
+            message->id = id;
+            message->used = true;
+            message->len = message_len;
+            memcpy(message->data, buffer + pos + 5, message_len);
+        }
+
+        pos += 5 + message_len;
+    }
+
+    // even duplicates are acked, the ack that would have stopped them may have been lost
+    if (num_messages > 0)
+    {
+        channel->ack_pending = true;
+    }
+
+    return 0;
+}
+
+int channel_next(struct channel *channel, const Uint8 **data, int *len)
+{
+    for (int stream = 0; stream < CHANNEL_STREAMS; stream++)
+    {
+        struct channel_stream *channel_stream = &channel->streams[stream];
+        struct channel_message *message = &channel_stream->received[channel_stream->next_receive % CHANNEL_WINDOW];
+
+        if (message->used && message->id == channel_stream->next_receive)
+        {
+            // the message stays in place until the next read, so it can be returned without a copy
+            message->used = false;
+            channel_stream->next_receive++;
+
+            *data = message->data;
+            *len = message->len;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+bool channel_idle(const struct channel *channel)
+{
+    if (channel->ack_pending)
+    {
+        return false;
+    }
+
+    for (int stream = 0; stream < CHANNEL_STREAMS; stream++)
+    {
+        if (channel->streams[stream].oldest != channel->streams[stream].next_send)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void channel_free(struct channel *channel)
+{
+    for (int stream = 0; stream < CHANNEL_STREAMS; stream++)
+    {
+        SDL_free(channel->streams[stream].backlog);
+    }
+    SDL_free(channel);
+}
+
+int channel_peek_id(const Uint8 *buffer, int len)
+{
+    if (len < CHANNEL_HEADER_SIZE || data_peek_type(buffer, len) != DATA_CHANNEL)
+    {
+        return -1;
+    }
+
+    return (int)(SDLNet_Read32(buffer + 1) & 0x7FFFFFFF);
+}
+
+int channel_peek_first(const Uint8 *buffer, int len, const Uint8 **data)
+{
+    if (len < CHANNEL_HEADER_SIZE || data_peek_type(buffer, len) != DATA_CHANNEL)
+    {
+        return -1;
+    }
+
+    int num_messages = buffer[13];
+    int pos = CHANNEL_HEADER_SIZE;
+    for (int i = 0; i < num_messages && pos + 5 <= len; i++)
+    {
+        int message_len = SDLNet_Read16(buffer + pos + 3);
+        if (message_len > CHANNEL_MAX_MESSAGE || pos + 5 + message_len > len)
+        {
+            return -1;
+        }
+
+        if (buffer[pos] == CHANNEL_CONTROL && SDLNet_Read16(buffer + pos + 1) == 0)
+        {
+            *data = buffer + pos + 5;
+            return message_len;
+        }
+
+        pos += 5 + message_len;
+    }
+
+    return -1;
+}
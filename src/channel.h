@@ -0,0 +1,120 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#include "data.h"
+
+// ordered streams that are delivered independently, so a lost chat message never holds up control messages
+#define CHANNEL_CONTROL 0
+#define CHANNEL_CHAT 1
+#define CHANNEL_STREAMS 2
+
+// how many datagrams an ack covers, and how many messages a stream can have unacknowledged
+#define CHANNEL_WINDOW 32
+
+// the bytes of messages a channel keeps waiting for room in the window, unless told otherwise
+#define CHANNEL_DEFAULT_BACKLOG (64 * 1024)
+
+// the largest reliable message is a catch-up, which always has room for a chat message, and with
+// the header and its own framing fits in a datagram of the smallest MTU
+#define CHANNEL_MAX_MESSAGE DATA_MAX_CATCH_UP_SIZE
+
+// keeps the per-datagram bookkeeping fixed size, far more than a chat burst needs
+#define CHANNEL_MESSAGES_PER_DATAGRAM 16
+
+// type tag, sender ID, sequence, ack, ack bits and message count
+#define CHANNEL_HEADER_SIZE (1 + 4 + 2 + 2 + 4 + 1)
+
+// retransmit timeout bounds in milliseconds, before any round trip has been measured the initial one is used
+#define CHANNEL_INITIAL_RTO 250
+#define CHANNEL_MIN_RTO 50
+#define CHANNEL_MAX_RTO 2000
+
+struct channel_message
+{
+    Uint16 id;
+    bool used;
+    bool acked;
+    bool sent;
+    Uint32 send_time;
+    int len;
+    Uint8 data[CHANNEL_MAX_MESSAGE];
+};
+
+struct channel_stream
+{
+    // messages waiting to be acknowledged, from the oldest unacknowledged ID up to the next ID
+    Uint16 next_send;
+    Uint16 oldest;
+    struct channel_message sent[CHANNEL_WINDOW];
+
+    // messages received ahead of the next one to deliver
+    Uint16 next_receive;
+    struct channel_message received[CHANNEL_WINDOW];
+
+    // messages sent while the window was full, each its 16-bit length then its bytes, from the head on
+    Uint8 *backlog;
+    int backlog_head;
+    int backlog_len;
+    int backlog_capacity;
+};
+
+// which messages a datagram carried, so they can be acknowledged along with it
+struct channel_datagram
+{
+    Uint16 sequence;
+    bool used;
+    Uint32 send_time;
+    int num_messages;
+    Uint8 streams[CHANNEL_MESSAGES_PER_DATAGRAM];
+    Uint16 ids[CHANNEL_MESSAGES_PER_DATAGRAM];
+};
+
+// a reliable, ordered message channel over unreliable datagrams, every datagram acknowledges
+// the peer's last CHANNEL_WINDOW datagrams and unacknowledged messages are resent after a timeout
+struct channel
+{
+    int id;
+
+    Uint16 sequence;
+    struct channel_datagram datagrams[CHANNEL_WINDOW];
+
+    bool received_any;
+    bool ack_pending;
+    Uint16 remote_sequence;
+    Uint32 received_bits;
+
+    struct channel_stream streams[CHANNEL_STREAMS];
+
+    // the bytes of messages waiting in the streams' backlogs, and the most there can be
+    int backlog_bytes;
+    int backlog_size;
+
+    // smoothed round trip time and its variation, in milliseconds
+    bool measured;
+    Uint32 rtt;
+    Uint32 rtt_variance;
+    Uint32 rto;
+
+    Uint64 retransmits;
+};
+
+struct channel *channel_alloc(int id, int backlog_size);
+// messages past the window wait in a backlog, this only fails once that holds backlog_size bytes
+int channel_send(struct channel *channel, int stream, const void *data, int len);
+// fills a datagram of at most mtu bytes, the buffer must be at least that large
+int channel_write(struct channel *channel, Uint8 *buffer, int mtu, Uint32 now);
+int channel_read(struct channel *channel, const Uint8 *buffer, int len, Uint32 now);
+int channel_next(struct channel *channel, const Uint8 **data, int *len);
+bool channel_idle(const struct channel *channel);
+void channel_free(struct channel *channel);
+
+int channel_peek_id(const Uint8 *buffer, int len);
+
+// the first message of a new channel's control stream, if the datagram carries it, without a channel
+// to read it into, returns its length or -1
+int channel_peek_first(const Uint8 *buffer, int len, const Uint8 **data);
+
+#endif
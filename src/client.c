@@ -4,23 +4,323 @@
 #include <SDL2/SDL_net.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "batch.h"
+#include "channel.h"
+#include "compress.h"
 #include "data.h"
+#include "fragment.h"
+#include "jitter.h"
+#include "log.h"
+#include "loop.h"
 #include "SDL_net_ext.h"
 
 #define WINDOW_TITLE "Client"
-#define WINDOW_WIDTH 800
-#define WINDOW_HEIGHT 600
+#define WINDOW_WIDTH WORLD_WIDTH
+#define WINDOW_HEIGHT WORLD_HEIGHT
 
 #define SERVER_HOST "127.0.0.1"
 #define SERVER_PORT 1000
 
+// upper bound on how long input handling can be delayed while waiting for the network
+#define MAX_WAIT 16
+
+// how often input is sent to the server, if it has changed
+#define INPUT_INTERVAL 16
+
+// how long to keep retrying a connection over UDP
+#define CONNECT_TIMEOUT 5000
+
+// how often the server's clock is sampled, frames are drawn and statistics are reported
+#define PING_INTERVAL 1000
+#define FRAME_INTERVAL 16
+#define REPORT_INTERVAL 10000
+
+// how long the server can go without sending anything before it is given up on, it pings every second
+#define SERVER_TIMEOUT 10000
+
+// how far behind the server's clock other clients are drawn, so there is a later snapshot to interpolate towards
+#define DEFAULT_INTERP_DELAY 100
+
+#define CURSOR_SIZE 8
+
+static void send_tcp(TCPsocket socket, const struct data *data)
+{
+    unsigned char buffer[DATA_MAX_ENCODED_SIZE];
+    int len = data_encode(data, buffer, sizeof(buffer));
+    SDLNet_TCP_SendExt(socket, buffer, len);
+}
+
+// unreliable messages are gathered into one datagram and sent with the input, once per input interval,
+// except pings and pongs, which take whatever is waiting with them straight away so their times are true
+static struct batch udp_batch;
+static int mtu = BATCH_DEFAULT_MTU;
+
+static void flush_udp(UDPsocket socket, UDPpacket *packet, IPaddress address)
+{
+    if (udp_batch.count > 0)
+    {
+        int len = batch_flush(&udp_batch, packet->data);
+        SDLNet_UDP_SendExt(socket, packet, address, packet->data, len);
+    }
+}
+
+static void send_udp(UDPsocket socket, UDPpacket *packet, IPaddress address, const struct data *data)
+{
+    unsigned char buffer[DATA_MAX_ENCODED_SIZE];
+    int len = data_encode(data, buffer, sizeof(buffer));
+    if (!batch_add(&udp_batch, mtu, buffer, len))
+    {
+        flush_udp(socket, packet, address);
+        batch_add(&udp_batch, mtu, buffer, len);
+    }
+}
+
+static void send_reliable(TCPsocket tcp_socket, struct channel *channel, const struct data *data)
+{
+    if (!channel)
+    {
+        send_tcp(tcp_socket, data);
+        return;
+    }
+
+    // chat gets its own stream so a lost chat message never delays anything else
+    unsigned char buffer[DATA_MAX_ENCODED_SIZE];
+    int len = data_encode(data, buffer, sizeof(buffer));
+    int stream = data->type == DATA_CHAT_REQUEST ? CHANNEL_CHAT : CHANNEL_CONTROL;
+    if (channel_send(channel, stream, buffer, len) == -1)
+    {
+        log_warn("%s", SDLNet_GetError());
+    }
+}
+
+static void flush_channel(UDPsocket socket, UDPpacket *packet, IPaddress address, struct channel *channel)
+{
+    // sends new messages, retransmits and acks, more than one datagram if they don't fit
+    int len;
+    while ((len = channel_write(channel, packet->data, mtu, SDL_GetTicks())) > 0)
+    {
+        SDLNet_UDP_SendExt(socket, packet, address, packet->data, len);
+    }
+}
+
+static int handle_connect_response(const unsigned char *buffer, int len, unsigned int *token)
+{
+    union data_any message;
+    if (data_decode(&message, buffer, len) == -1)
+    {
+        log_error("Malformed server response");
+        return -1;
+    }
+
+    struct data *data = &message.data;
+    switch (data->type)
+    {
+    case DATA_CONNECT_OK:
+    {
+        struct connect_data *connect_data = (struct connect_data *)data;
+        log_info("Server assigned ID: %d", connect_data->id);
+        *token = connect_data->cookie;
+        if (connect_data->features & DATA_FEATURE_COMPRESSION)
+        {
+            log_info("Server compresses larger messages");
+        }
+        return connect_data->id;
+    }
+    break;
+    case DATA_CONNECT_FULL:
+    {
+        log_error("Server is full");
+        return -1;
+    }
+    break;
+    default:
+    {
+        log_error("Unknown server response");
+        return -1;
+    }
+    break;
+    }
+}
+
+static int connect_channel(UDPsocket socket, UDPpacket *packet, UDPpacket *recv_packet, IPaddress address, struct channel *channel, SDLNet_Poller poller, int features)
+{
+    // the server only takes a slot for a request with the cookie it sends for our address, which is
+    // asked for until it arrives, then the channel resends the request until the server acknowledges it
+    struct challenge_data challenge_data = challenge_data_create(DATA_CHALLENGE, 0);
+    unsigned char challenge[DATA_MAX_ENCODED_SIZE];
+    int challenge_len = data_encode(&challenge_data.data, challenge, sizeof(challenge));
+    bool challenged = false;
+
+    // a channel client's address is what it is known by, it has no UDP connect to make with the token
+    unsigned int token;
+
+    Uint32 start = SDL_GetTicks();
+    while (SDL_GetTicks() - start < CONNECT_TIMEOUT)
+    {
+        if (challenged)
+        {
+            flush_channel(socket, packet, address, channel);
+        }
+        else
+        {
+            SDLNet_UDP_SendExt(socket, packet, address, challenge, challenge_len);
+        }
+
+        if (SDLNet_PollerWait(poller, CHANNEL_MIN_RTO) == -1)
+        {
+            log_error("%s", SDLNet_GetError());
+            return -1;
+        }
+
+        while (SDLNet_UDP_RecvExt(socket, recv_packet) == 1)
+        {
+            // a full server has no channel to reply on, snapshots may already be arriving too
+            if (data_peek_type(recv_packet->data, recv_packet->len) != DATA_CHANNEL)
+            {
+                if (data_peek_type(recv_packet->data, recv_packet->len) == DATA_CONNECT_FULL)
+                {
+                    return handle_connect_response(recv_packet->data, recv_packet->len, &token);
+                }
+
+                union data_any message;
+                if (!challenged &&
+                    data_decode(&message, recv_packet->data, recv_packet->len) != -1 &&
+                    message.data.type == DATA_CHALLENGE)
+                {
+                    struct connect_data connect_data = connect_data_create(DATA_CONNECT_REQUEST, 0, features);
+                    connect_data.cookie = message.challenge_data.cookie;
+                    send_reliable(NULL, channel, &connect_data.data);
+                    flush_channel(socket, packet, address, channel);
+                    challenged = true;
+                }
+                continue;
+            }
+
+            if (channel_read(channel, recv_packet->data, recv_packet->len, SDL_GetTicks()) == -1)
+            {
+                log_warn("UDP: %s", SDLNet_GetError());
+                continue;
+            }
+
+            // anything sent after the response stays queued in the channel for the main loop
+            const unsigned char *buffer;
+            int len;
+            if (channel_next(channel, &buffer, &len))
+            {
+                channel->id = handle_connect_response(buffer, len, &token);
+                return channel->id;
+            }
+        }
+    }
+
+    log_error("Server did not respond");
+    return -1;
+}
+
+static void handle_message(TCPsocket tcp_socket, struct channel *channel, const unsigned char *buffer, int len)
+{
+    // the server compresses larger messages if we said we could take them
+    unsigned char decompressed[DATA_MAX_ENCODED_SIZE];
+    len = decompress_received(&buffer, len, decompressed, sizeof(decompressed));
+
+    union data_any message;
+    if (len == -1 || data_decode(&message, buffer, len) == -1)
+    {
+        log_warn("Malformed message");
+        return;
+    }
+
+    struct data *data = &message.data;
+    switch (data->type)
+    {
+    case DATA_CONNECT_BROADCAST:
+    {
+        struct id_data *id_data = (struct id_data *)data;
+        log_info("Client with ID %d has joined", id_data->id);
+    }
+    break;
+    case DATA_DISCONNECT_BROADCAST:
+    {
+        struct id_data *id_data = (struct id_data *)data;
+        log_info("Client with ID %d has disconnected", id_data->id);
+    }
+    break;
+    case DATA_CHAT_BROADCAST:
+    {
+        struct chat_data *chat_data = (struct chat_data *)data;
+        log_info("Client %d: %.*s", chat_data->id, chat_data->length, chat_data->message);
+    }
+    break;
+    case DATA_CATCH_UP:
+    {
+        // who was already here and what was said before we joined
+        struct catch_up_data *catch_up_data = (struct catch_up_data *)data;
+        for (int i = 0; i < catch_up_data->num_clients; i++)
+        {
+            log_info("Client with ID %d is connected", catch_up_data->clients[i]);
+        }
+        for (int i = 0; i < catch_up_data->num_chats; i++)
+        {
+            const struct chat_data *chat_data = &catch_up_data->chats[i];
+            log_info("Client %d: %.*s", chat_data->id, chat_data->length, chat_data->message);
+        }
+    }
+    break;
+    case DATA_PING:
+    {
+        // the server pings over the reliable connection until it knows our UDP address
+        struct ping_data *ping_data = (struct ping_data *)data;
+        struct ping_data pong_data = ping_data_create(DATA_PONG, ping_data->id, SDL_GetTicks(), ping_data->server_time);
+        send_reliable(tcp_socket, channel, &pong_data.data);
+    }
+    break;
+    default:
+    {
+        log_warn("Unknown message type");
+    }
+    break;
+    }
+}
+
 int client_main(int argc, char *argv[])
 {
+    // parse options
+    Uint32 max_wait = MAX_WAIT;
+    bool udp_only = false;
+    Uint32 interp_delay = DEFAULT_INTERP_DELAY;
+    int features = DATA_FEATURE_COMPRESSION;
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--max-wait") == 0) && i + 1 < argc)
+        {
+            max_wait = (Uint32)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "--udp") == 0)
+        {
+            udp_only = true;
+        }
+        else if ((strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--interp-delay") == 0) && i + 1 < argc)
+        {
+            interp_delay = (Uint32)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--mtu") == 0 && i + 1 < argc)
+        {
+            int value = atoi(argv[++i]);
+            mtu = SDL_max(BATCH_MIN_MTU, SDL_min(value, PACKET_SIZE));
+        }
+        else if (strcmp(argv[i], "--no-compress") == 0)
+        {
+            features &= ~DATA_FEATURE_COMPRESSION;
+        }
+    }
+
     // init SDL
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
     {
-        printf("Error: %s\n", SDL_GetError());
+        log_error("%s", SDL_GetError());
         return 1;
     }
 
@@ -35,14 +335,29 @@ int client_main(int argc, char *argv[])
 
     if (!window)
     {
-        printf("Error: %s\n", SDL_GetError());
+        log_error("%s", SDL_GetError());
+        return 1;
+    }
+
+    // create renderer, frames are paced by the loop rather than vsync so it never blocks on the display
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    if (!renderer)
+    {
+        log_error("%s", SDL_GetError());
         return 1;
     }
 
     // init SDL_net
     if (SDLNet_Init() != 0)
     {
-        printf("Error: %s\n", SDLNet_GetError());
+        log_error("%s", SDLNet_GetError());
+        return 1;
+    }
+
+    // the socket handles are read from SDL_net's own structures, so make sure that still works
+    if (SDLNet_CheckSocketHandles() != 0)
+    {
+        log_error("%s", SDLNet_GetError());
         return 1;
     }
 
@@ -51,96 +366,192 @@ int client_main(int argc, char *argv[])
 
     if (SDLNet_ResolveHost(&server_address, SERVER_HOST, SERVER_PORT))
     {
-        printf("Error: %s\n", SDLNet_GetError());
+        log_error("%s", SDLNet_GetError());
         return 1;
     }
 
-    // open TCP socket
-    TCPsocket tcp_socket = SDLNet_TCP_Open(&server_address);
+    // reliable messages go either over a TCP connection or a channel on the UDP socket
+    TCPsocket tcp_socket = NULL;
+    TCPpacket *tcp_packet = NULL;
+    struct channel *channel = NULL;
 
-    if (!tcp_socket)
+    if (udp_only)
     {
-        printf("Error: %s\n", SDLNet_GetError());
-        return 1;
+        // the server assigns the ID used in the channel header once connected
+        channel = channel_alloc(0, CHANNEL_DEFAULT_BACKLOG);
+        if (!channel)
+        {
+            log_error("%s", SDLNet_GetError());
+            return 1;
+        }
     }
-
+    else
     {
-        const char *host = SDLNet_ResolveIP(&server_address);
-        unsigned short port = SDLNet_Read16(&server_address.port);
-        printf("TCP: Connected to %s:%i", host, port);
-    }
+        // open TCP socket
+        tcp_socket = SDLNet_TCP_Open(&server_address);
 
-    // allocate TCP packet
-    TCPpacket *tcp_packet = SDLNet_TCP_AllocPacket(PACKET_SIZE);
-    if (!tcp_packet)
-    {
-        printf("Error: %s\n", SDLNet_GetError());
-        return 1;
+        if (!tcp_socket)
+        {
+            log_error("%s", SDLNet_GetError());
+            return 1;
+        }
+
+        {
+            char address[ADDRESS_STRLEN];
+            log_info("TCP: Connected to %s", SDLNet_FormatAddress(&server_address, address, sizeof(address)));
+        }
+
+        // allocate TCP packet
+        tcp_packet = SDLNet_TCP_AllocPacket(PACKET_SIZE);
+        if (!tcp_packet)
+        {
+            log_error("%s", SDLNet_GetError());
+            return 1;
+        }
     }
 
     // open UDP socket
     UDPsocket udp_socket = SDLNet_UDP_Open(0);
     if (!udp_socket)
     {
-        printf("Error: %s\n", SDLNet_GetError());
+        log_error("%s", SDLNet_GetError());
         return 1;
     }
 
-    // allocate UDP packet
+    // allocate UDP packets, one to encode into and one to receive into
     UDPpacket *udp_packet = SDLNet_UDP_AllocPacket(PACKET_SIZE);
     if (!udp_packet)
     {
-        printf("Error: %s\n", SDLNet_GetError());
+        log_error("%s", SDLNet_GetError());
+        return 1;
+    }
+
+    UDPpacket *udp_recv_packet = SDLNet_UDP_AllocPacket(PACKET_SIZE);
+    if (!udp_recv_packet)
+    {
+        log_error("%s", SDLNet_GetError());
         return 1;
     }
 
-    // allocate socket set
-    SDLNet_SocketSet socket_set = SDLNet_AllocSocketSet(2);
-    if (!socket_set)
+    // allocate poller
+    SDLNet_Poller poller = SDLNet_AllocPoller();
+    if (!poller)
     {
-        printf("Error: %s\n", SDLNet_GetError());
+        log_error("%s", SDLNet_GetError());
         return 1;
     }
 
-    // add TCP and UDP sockets to socket set
-    SDLNet_TCP_AddSocket(socket_set, tcp_socket);
-    SDLNet_UDP_AddSocket(socket_set, udp_socket);
+    // add TCP and UDP sockets to poller
+    if (tcp_socket)
+    {
+        SDLNet_PollerAdd(poller, tcp_socket, NULL);
+    }
+    SDLNet_PollerAdd(poller, udp_socket, NULL);
 
     // keep track of unique client ID given by server
     int client_id = -1;
+    int next;
 
-    // check the server's response to the connection
-    if (SDLNet_TCP_RecvExt(tcp_socket, tcp_packet) == 1)
+    if (channel)
     {
-        struct data *data = (struct data *)tcp_packet->data;
-        switch (data->type)
+        client_id = connect_channel(udp_socket, udp_packet, udp_recv_packet, server_address, channel, poller, features);
+        if (client_id == -1)
         {
-        case DATA_CONNECT_OK:
+            return 1;
+        }
+
+        // handle whatever arrived along with the response
+        const unsigned char *buffer;
+        int len;
+        while (channel_next(channel, &buffer, &len))
+        {
+            handle_message(tcp_socket, channel, buffer, len);
+        }
+    }
+    else
+    {
+        // ask to join, saying what we can take
+        struct connect_data connect_data = connect_data_create(DATA_CONNECT_REQUEST, 0, features);
+        send_tcp(tcp_socket, &connect_data.data);
+
+        // wait for the server's response to the connection
+        while ((next = SDLNet_TCP_NextPacket(tcp_packet)) == 0)
         {
-            struct id_data *id_data = (struct id_data *)data;
-            printf("Server assigned ID: %d\n", id_data->id);
-            client_id = id_data->id;
+            if (SDLNet_TCP_RecvExt(tcp_socket, tcp_packet) <= 0)
+            {
+                log_error("%s", SDLNet_GetError());
+                return 1;
+            }
         }
-        break;
-        case DATA_CONNECT_FULL:
+
+        if (next == -1)
         {
-            printf("Error: Server is full\n");
+            log_error("%s", SDLNet_GetError());
             return 1;
         }
-        break;
-        default:
+
+        unsigned int token;
+        client_id = handle_connect_response(tcp_packet->data, tcp_packet->len, &token);
+        if (client_id == -1)
         {
-            printf("Error: Unknown server response\n");
             return 1;
         }
-        break;
+
+        // handle whatever arrived along with the response, the socket won't be ready for it again
+        while ((next = SDLNet_TCP_NextPacket(tcp_packet)) == 1)
+        {
+            handle_message(tcp_socket, channel, tcp_packet->data, tcp_packet->len);
+        }
+
+        if (next == -1)
+        {
+            log_error("%s", SDLNet_GetError());
+            return 1;
         }
+
+        // make a UDP "connection" to the server, with the token it sent to show the request is ours
+        struct connect_data udp_connect_data = connect_data_create(DATA_UDP_CONNECT_REQUEST, client_id, 0);
+        udp_connect_data.cookie = token;
+        send_udp(udp_socket, udp_packet, server_address, &udp_connect_data.data);
     }
 
-    // make a UDP "connection" to the server
+    // setup the event loop
+    struct loop loop;
+    loop_init(&loop, max_wait);
+
+    struct timer input_timer;
+    timer_init(&loop, &input_timer, INPUT_INTERVAL);
+
+    struct timer ping_timer;
+    timer_init(&loop, &ping_timer, PING_INTERVAL);
+
+    struct timer frame_timer;
+    timer_init(&loop, &frame_timer, FRAME_INTERVAL);
+
+    struct timer report_timer;
+    timer_init(&loop, &report_timer, REPORT_INTERVAL);
+
+    // the last input sent
+    struct input_data input = input_data_create(DATA_INPUT_REQUEST, client_id, -1, -1, 0);
+
+    // received snapshots are drawn at a steady delay behind the server's clock rather than as they arrive
+    struct clock_sync clock_sync;
+    clock_sync_init(&clock_sync);
+
+    static struct jitter_buffer jitter_buffer;
+    jitter_buffer_init(&jitter_buffer);
+
+    // messages too large for one datagram are put back together from their fragments
+    static struct reassembly reassembly;
+
+    // when anything last arrived from the server
+    Uint32 heard = SDL_GetTicks();
+
+    // sample the clock right away instead of waiting for the first interval
     {
-        struct id_data id_data = id_data_create(DATA_UDP_CONNECT_REQUEST, client_id);
-        SDLNet_UDP_SendExt(udp_socket, udp_packet, server_address, &id_data, sizeof(id_data));
+        struct ping_data ping_data = ping_data_create(DATA_PING, client_id, SDL_GetTicks(), 0);
+        send_udp(udp_socket, udp_packet, server_address, &ping_data.data);
+        flush_udp(udp_socket, udp_packet, server_address);
     }
 
     // main loop
@@ -176,7 +587,7 @@ int client_main(int argc, char *argv[])
                 case SDLK_RETURN:
                 {
                     struct chat_data chat_data = chat_data_create(DATA_CHAT_REQUEST, client_id, "Hello, World!");
-                    SDLNet_TCP_SendExt(tcp_socket, &chat_data, sizeof(chat_data));
+                    send_reliable(tcp_socket, channel, &chat_data.data);
                 }
                 break;
                 }
@@ -185,7 +596,7 @@ int client_main(int argc, char *argv[])
             case SDL_MOUSEBUTTONDOWN:
             {
                 struct mouse_data mouse_data = mouse_data_create(DATA_MOUSEDOWN_REQUEST, client_id, event.button.x, event.button.y);
-                SDLNet_UDP_SendExt(udp_socket, udp_packet, server_address, &mouse_data, sizeof(mouse_data));
+                send_udp(udp_socket, udp_packet, server_address, &mouse_data.data);
             }
             break;
             case SDL_QUIT:
@@ -196,81 +607,281 @@ int client_main(int argc, char *argv[])
             }
         }
 
-        // handle network events
-        while (SDLNet_CheckSockets(socket_set, 0) > 0)
+        // send input at a fixed rate, but only when it has changed, along with the acks and clicks since the last
+        if (timer_update(&loop, &input_timer))
+        {
+            if (input.x != mouse_x || input.y != mouse_y || input.buttons != (int)mouse)
+            {
+                input = input_data_create(DATA_INPUT_REQUEST, client_id, mouse_x, mouse_y, (int)mouse);
+                send_udp(udp_socket, udp_packet, server_address, &input.data);
+            }
+
+            flush_udp(udp_socket, udp_packet, server_address);
+        }
+
+        if (timer_update(&loop, &ping_timer))
+        {
+            struct ping_data ping_data = ping_data_create(DATA_PING, client_id, SDL_GetTicks(), 0);
+            send_udp(udp_socket, udp_packet, server_address, &ping_data.data);
+            flush_udp(udp_socket, udp_packet, server_address);
+        }
+
+        // block until there are network events or it is time to handle input again
+        if (loop_wait(&loop, poller) > 0)
         {
+            heard = SDL_GetTicks();
+
             // handle TCP messages
-            if (SDLNet_SocketReady(tcp_socket))
+            if (tcp_socket && SDLNet_SocketReady(tcp_socket))
             {
-                // accept new clients
-                if (SDLNet_TCP_RecvExt(tcp_socket, tcp_packet) == 1)
+                if (SDLNet_TCP_RecvExt(tcp_socket, tcp_packet) <= 0)
                 {
-                    struct data *data = (struct data *)tcp_packet->data;
-                    switch (data->type)
-                    {
-                    case DATA_CONNECT_BROADCAST:
-                    {
-                        struct id_data *id_data = (struct id_data *)data;
-                        printf("Client with ID %d has joined\n", id_data->id);
-                    }
+                    log_error("%s", SDLNet_GetError());
+                    quit = true;
+                    break;
+                }
+
+                // a single read can contain several messages, or only part of one
+                while ((next = SDLNet_TCP_NextPacket(tcp_packet)) == 1)
+                {
+                    handle_message(tcp_socket, channel, tcp_packet->data, tcp_packet->len);
+                }
+
+                if (next == -1)
+                {
+                    log_error("%s", SDLNet_GetError());
+                    quit = true;
                     break;
-                    case DATA_DISCONNECT_BROADCAST:
+                }
+            }
+
+            // handle UDP messages
+            if (SDLNet_SocketReady(udp_socket))
+            {
+                union data_any message;
+                while (SDLNet_UDP_RecvExt(udp_socket, udp_recv_packet) == 1)
+                {
+                    // reliable messages arrive wrapped in channel datagrams
+                    if (data_peek_type(udp_recv_packet->data, udp_recv_packet->len) == DATA_CHANNEL)
                     {
-                        struct id_data *id_data = (struct id_data *)data;
-                        printf("Client with ID %d has disconnected\n", id_data->id);
+                        if (!channel || channel_read(channel, udp_recv_packet->data, udp_recv_packet->len, SDL_GetTicks()) == -1)
+                        {
+                            log_warn("UDP: Malformed packet");
+                            continue;
+                        }
+
+                        const unsigned char *buffer;
+                        int len;
+                        while (channel_next(channel, &buffer, &len))
+                        {
+                            handle_message(tcp_socket, channel, buffer, len);
+                        }
+                        continue;
                     }
-                    break;
-                    case DATA_CHAT_BROADCAST:
+
+                    // a fragment is held until the rest of its message arrives, which is then handled
+                    // as if it had come in one datagram
+                    const unsigned char *datagram = udp_recv_packet->data;
+                    int datagram_len = udp_recv_packet->len;
+                    if (data_peek_type(datagram, datagram_len) == DATA_FRAGMENT)
                     {
-                        struct chat_data *chat_data = (struct chat_data *)data;
-                        printf("Client %d: %s\n", chat_data->id, chat_data->message);
+                        datagram_len = reassembly_add(&reassembly, datagram, datagram_len, SDL_GetTicks(), &datagram);
+                        if (datagram_len == -1)
+                        {
+                            log_warn("UDP: Malformed packet");
+                        }
+
+                        if (datagram_len <= 0)
+                        {
+                            continue;
+                        }
                     }
-                    break;
-                    default:
+
+                    // a batch is handled message by message, a bare message is a batch of one
+                    int pos = 0;
+                    const unsigned char *buffer;
+                    int len;
+                    while ((len = batch_next(datagram, datagram_len, &pos, &buffer)) > 0)
                     {
-                        printf("TCP: Unknown packet type\n");
+                        if (data_decode(&message, buffer, len) == -1)
+                        {
+                            break;
+                        }
+
+                        struct data *data = &message.data;
+                        const struct snapshot_data *received = NULL;
+                        struct snapshot_data applied;
+                        switch (data->type)
+                        {
+                        case DATA_SNAPSHOT:
+                        {
+                            received = (struct snapshot_data *)data;
+                        }
+                        break;
+                        case DATA_SNAPSHOT_DELTA:
+                        {
+                            // without the baseline the delta is useless, the server resends in full once acks stop
+                            struct delta_data *delta_data = (struct delta_data *)data;
+                            const struct snapshot_data *baseline = jitter_buffer_find(&jitter_buffer, delta_data->baseline);
+                            if (!baseline)
+                            {
+                                log_debug("Snapshot %u: Missing baseline %u", delta_data->sequence, delta_data->baseline);
+                                break;
+                            }
+
+                            if (snapshot_apply(&applied, baseline, delta_data) == -1)
+                            {
+                                log_warn("UDP: Invalid snapshot delta");
+                                break;
+                            }
+
+                            received = &applied;
+                        }
+                        break;
+                        case DATA_PING:
+                        {
+                            // answered straight away, the server measures the round trip from its own clock
+                            struct ping_data *ping_data = (struct ping_data *)data;
+                            struct ping_data pong_data = ping_data_create(DATA_PONG, client_id, SDL_GetTicks(), ping_data->server_time);
+                            send_udp(udp_socket, udp_packet, server_address, &pong_data.data);
+                            flush_udp(udp_socket, udp_packet, server_address);
+                        }
+                        break;
+                        case DATA_PONG:
+                        {
+                            struct ping_data *ping_data = (struct ping_data *)data;
+                            clock_sync_sample(&clock_sync, ping_data->client_time, ping_data->server_time, SDL_GetTicks());
+                        }
+                        break;
+                        default:
+                        {
+                            log_warn("UDP: Unknown packet type");
+                        }
+                        break;
+                        }
+
+                        // datagrams can arrive out of order, only the newest snapshot is acknowledged
+                        if (received && jitter_buffer_add(&jitter_buffer, received, SDL_GetTicks()))
+                        {
+                            log_trace("Snapshot %u: %d clients", received->sequence, received->num_clients);
+
+                            struct ack_data ack_data = ack_data_create(DATA_SNAPSHOT_ACK, client_id, received->sequence);
+                            send_udp(udp_socket, udp_packet, server_address, &ack_data.data);
+                        }
                     }
-                    break;
+
+                    if (len != 0)
+                    {
+                        log_warn("UDP: Malformed packet");
                     }
                 }
             }
+        }
 
-            // handle UDP messages
-            if (SDLNet_SocketReady(udp_socket))
+        // the server pings every second, so silence means it or the network has gone
+        if (SDL_GetTicks() - heard > SERVER_TIMEOUT)
+        {
+            log_error("Server stopped responding");
+            quit = true;
+            break;
+        }
+
+        // send new reliable messages and acks, and retransmit what has timed out
+        if (channel)
+        {
+            flush_channel(udp_socket, udp_packet, server_address, channel);
+        }
+
+        // draw the other clients where they were a fixed delay ago on the server's clock
+        if (timer_update(&loop, &frame_timer))
+        {
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+            SDL_RenderClear(renderer);
+
+            if (clock_sync.synced)
             {
-                if (SDLNet_UDP_RecvExt(udp_socket, udp_packet) == 1)
+                struct snapshot_data frame;
+                jitter_buffer_sample(&jitter_buffer, clock_sync_server_time(&clock_sync, SDL_GetTicks()) - interp_delay, &frame);
+
+                for (int i = 0; i < frame.num_clients; i++)
                 {
-                    struct data *data = (struct data *)udp_packet->data;
-                    switch (data->type)
-                    {
-                    default:
+                    struct client_state *state = &frame.clients[i];
+                    if (state->id == client_id)
                     {
-                        printf("UDP: Unknown packet type\n");
-                    }
-                    break;
+                        continue;
                     }
+
+                    SDL_Rect rect = {state->x - CURSOR_SIZE / 2, state->y - CURSOR_SIZE / 2, CURSOR_SIZE, CURSOR_SIZE};
+                    SDL_SetRenderDrawColor(renderer, 255, state->buttons ? 0 : 255, state->buttons ? 0 : 255, 255);
+                    SDL_RenderFillRect(renderer, &rect);
                 }
             }
+
+            // our own cursor is drawn from local input, it doesn't need to wait for the server
+            SDL_Rect rect = {mouse_x - CURSOR_SIZE / 2, mouse_y - CURSOR_SIZE / 2, CURSOR_SIZE, CURSOR_SIZE};
+            SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255);
+            SDL_RenderFillRect(renderer, &rect);
+
+            SDL_RenderPresent(renderer);
+        }
+
+        // report how far behind the server's clock is being drawn and how steadily snapshots arrive
+        if (timer_update(&loop, &report_timer))
+        {
+            Uint32 now = SDL_GetTicks();
+            Uint32 render_time = clock_sync_server_time(&clock_sync, now) - interp_delay;
+
+            log_info("Clock: offset %d ms, rtt %u ms, drift %.2f ms/min",
+                     (int)clock_sync.offset,
+                     (unsigned int)clock_sync.rtt,
+                     clock_sync_drift(&clock_sync, now));
+
+            log_info("Jitter buffer: %d snapshots buffered, %.1f ms jitter, %llu interpolated, %llu extrapolated, %llu held frames",
+                     jitter_buffer_depth(&jitter_buffer, render_time),
+                     jitter_buffer.jitter,
+                     (unsigned long long)jitter_buffer.interpolated,
+                     (unsigned long long)jitter_buffer.extrapolated,
+                     (unsigned long long)jitter_buffer.held);
+
+            jitter_buffer.interpolated = 0;
+            jitter_buffer.extrapolated = 0;
+            jitter_buffer.held = 0;
         }
     }
 
-    // send a disconnect message
+    // send a disconnect message, over a channel it is not retransmitted since nothing is left to do it
     {
         struct data data = data_create(DATA_DISCONNECT_REQUEST);
-        SDLNet_TCP_SendExt(tcp_socket, &data, sizeof(data));
+        send_reliable(tcp_socket, channel, &data);
+        if (channel)
+        {
+            flush_channel(udp_socket, udp_packet, server_address, channel);
+        }
     }
 
     // close SDL_net
-    SDLNet_UDP_DelSocket(socket_set, udp_socket);
-    SDLNet_TCP_DelSocket(socket_set, tcp_socket);
-    SDLNet_FreeSocketSet(socket_set);
+    SDLNet_PollerDel(poller, udp_socket);
+    if (tcp_socket)
+    {
+        SDLNet_PollerDel(poller, tcp_socket);
+    }
+    SDLNet_FreePoller(poller);
+    SDLNet_UDP_FreePacket(udp_recv_packet);
     SDLNet_UDP_FreePacket(udp_packet);
     SDLNet_UDP_Close(udp_socket);
-    SDLNet_TCP_FreePacket(tcp_packet);
-    SDLNet_TCP_Close(tcp_socket);
+    if (channel)
+    {
+        channel_free(channel);
+    }
+    else
+    {
+        SDLNet_TCP_FreePacket(tcp_packet);
+        SDLNet_TCP_Close(tcp_socket);
+    }
     SDLNet_Quit();
 
     // close SDL
+    SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
 
@@ -0,0 +1,290 @@
+#include "compress.h"
+
+#include <SDL2/SDL_net.h>
+#include <string.h>
+
+// matches are at least this long, and literal and match lengths that don't fit in their half of the
+// token carry on in bytes of 255
+#define COMPRESS_MIN_MATCH 4
+#define COMPRESS_TOKEN_MAX 15
+
+// text that turns up in chat, what the client and the load generator send and the most common words
+// of English, matched against like it came before every message so even a short one finds something
+static const char dictionary[] =
+    "the be to of and a in that have I it for not on with he as you do at this but his by from they "
+    "we say her she or an will my one all would there their what so up out if about who get which go "
+    "me when make can like time no just him know take people into year your good some could them see "
+    "other than then now look only come its over think also back after use two how our work first "
+    "well way even new want because any these give day most us is are was were has had been does did "
+    "ok okay yes yeah thanks thank hi hey hello bye lol what's where why here anyone everyone "
+    "The I'm I'll don't can't it's that's you're let's "
+    "Hello, World! bench 0123456789";
+
+#define DICTIONARY_SIZE ((int)sizeof(dictionary) - 1)
+
+static int hash(const unsigned char *p)
+{
+    Uint32 value = (Uint32)p[0] | (Uint32)p[1] << 8 | (Uint32)p[2] << 16 | (Uint32)p[3] << 24;
+    return (int)((value * 2654435761u) >> (32 - COMPRESS_HASH_BITS));
+}
+
+struct compressor *compressor_alloc(void)
+{
+    struct compressor *compressor = SDL_malloc(sizeof(struct compressor) + DICTIONARY_SIZE + DATA_MAX_ENCODED_SIZE);
+    if (!compressor)
+    {
+        SDLNet_SetError("Couldn't allocate compressor");
+        return NULL;
+    }
+
+    // every message starts from the dictionary's positions, so they are only hashed once
+    memcpy(compressor->window, dictionary, DICTIONARY_SIZE);
+    memset(compressor->dictionary_table, 0, sizeof(compressor->dictionary_table));
+    for (int i = 0; i + COMPRESS_MIN_MATCH <= DICTIONARY_SIZE; i++)
+    {
+        compressor->dictionary_table[hash(compressor->window + i)] = (Uint16)i;
+    }
+
+    return compressor;
+}
+
+void compressor_free(struct compressor *compressor)
+{
+    SDL_free(compressor);
+}
+
+static int write_length(unsigned char *buffer, int pos, int size, int length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        if (pos == size)
+        {
+            return -1;
+        }
+        buffer[pos++] = 255;
+    }
+
+    if (pos == size)
+    {
+        return -1;
+    }
+    buffer[pos++] = (unsigned char)length;
+
+    return pos;
+}
+
+// a run of literals, then a match unless this is the end
+static int write_sequence(unsigned char *buffer, int pos, int size, const unsigned char *literals, int num_literals, int offset, int match)
+{
+    if (pos == size)
+    {
+        return -1;
+    }
+
+    int token = pos++;
+    buffer[token] = (unsigned char)(SDL_min(num_literals, COMPRESS_TOKEN_MAX) << 4);
+    if (num_literals >= COMPRESS_TOKEN_MAX &&
+        (pos = write_length(buffer, pos, size, num_literals - COMPRESS_TOKEN_MAX)) == -1)
+    {
+        return -1;
+    }
+
+    if (num_literals > size - pos)
+    {
+        return -1;
+    }
+    memcpy(buffer + pos, literals, num_literals);
+    pos += num_literals;
+
+    if (match == 0)
+    {
+        return pos;
+    }
+
+    if (size - pos < 2)
+    {
+        return -1;
+    }
+    buffer[pos++] = (unsigned char)offset;
+    buffer[pos++] = (unsigned char)(offset >> 8);
+
+    match -= COMPRESS_MIN_MATCH;
+    buffer[token] |= (unsigned char)SDL_min(match, COMPRESS_TOKEN_MAX);
+    if (match >= COMPRESS_TOKEN_MAX &&
+        (pos = write_length(buffer, pos, size, match - COMPRESS_TOKEN_MAX)) == -1)
+    {
+        return -1;
+    }
+
+    return pos;
+}
+
+int compress_message(struct compressor *compressor, const unsigned char *message, int len, unsigned char *buffer, int size)
+{
+    if (len < 2 || len > DATA_MAX_ENCODED_SIZE || len > 0xFFFF)
+    {
+        return -1;
+    }
+
+    // anything that isn't shorter is sent as it is
+    size = SDL_min(size, len - 1);
+    if (size < COMPRESS_HEADER_SIZE)
+    {
+        return -1;
+    }
+
+    buffer[0] = DATA_TAG(DATA_COMPRESSED);
+    buffer[1] = message[0];
+    SDLNet_Write16((Uint16)len, buffer + 2);
+    int pos = COMPRESS_HEADER_SIZE;
+
+    // greedy matching against the last position each hash was seen at, the dictionary's to start with
+    unsigned char *window = compressor->window;
+    memcpy(window + DICTIONARY_SIZE, message, len);
+    memcpy(compressor->table, compressor->dictionary_table, sizeof(compressor->table));
+
+    int end = DICTIONARY_SIZE + len;
+    int anchor = DICTIONARY_SIZE + 1;
+    int i = anchor;
+    while (i + COMPRESS_MIN_MATCH <= end)
+    {
+        int h = hash(window + i);
+        int candidate = compressor->table[h];
+        compressor->table[h] = (Uint16)i;
+
+        if (memcmp(window + candidate, window + i, COMPRESS_MIN_MATCH) != 0)
+        {
+            i++;
+            continue;
+        }
+
+        int match = COMPRESS_MIN_MATCH;
+        while (i + match < end && window[candidate + match] == window[i + match])
+        {
+            match++;
+        }
+
+        pos = write_sequence(buffer, pos, size, window + anchor, i - anchor, i - candidate, match);
+        if (pos == -1)
+        {
+            return -1;
+        }
+
+        i += match;
+        anchor = i;
+    }
+
+    if (anchor < end)
+    {
+        pos = write_sequence(buffer, pos, size, window + anchor, end - anchor, 0, 0);
+    }
+
+    return pos;
+}
+
+static int read_length(const unsigned char *compressed, int len, int *pos, int *length)
+{
+    int byte;
+    do
+    {
+        if (*pos >= len)
+        {
+            return -1;
+        }
+        byte = compressed[(*pos)++];
+        *length += byte;
+    } while (byte == 255);
+
+    return 0;
+}
+
+int decompress_message(const unsigned char *compressed, int len, unsigned char *buffer, int size)
+{
+    if (len < COMPRESS_HEADER_SIZE || data_peek_type(compressed, len) != DATA_COMPRESSED)
+    {
+        return -1;
+    }
+
+    int total = SDLNet_Read16(compressed + 2);
+    if (total < 1 || total > size)
+    {
+        return -1;
+    }
+
+    buffer[0] = compressed[1];
+    int out = 1;
+    int pos = COMPRESS_HEADER_SIZE;
+    while (pos < len)
+    {
+        int token = compressed[pos++];
+
+        int num_literals = token >> 4;
+        if (num_literals == COMPRESS_TOKEN_MAX && read_length(compressed, len, &pos, &num_literals) == -1)
+        {
+            return -1;
+        }
+
+        if (num_literals > len - pos || num_literals > total - out)
+        {
+            return -1;
+        }
+        memcpy(buffer + out, compressed + pos, num_literals);
+        pos += num_literals;
+        out += num_literals;
+
+        // the last sequence has no match
+        if (pos == len)
+        {
+            break;
+        }
+
+        if (len - pos < 2)
+        {
+            return -1;
+        }
+        int offset = compressed[pos] | compressed[pos + 1] << 8;
+        pos += 2;
+
+        int match = token & COMPRESS_TOKEN_MAX;
+        if (match == COMPRESS_TOKEN_MAX && read_length(compressed, len, &pos, &match) == -1)
+        {
+            return -1;
+        }
+        match += COMPRESS_MIN_MATCH;
+
+        if (offset == 0 || offset > out + DICTIONARY_SIZE || match > total - out)
+        {
+            return -1;
+        }
+
+        // byte by byte, a match can overlap what it is copying, or start in the dictionary
+        for (int i = 0; i < match; i++, out++)
+        {
+            int from = out - offset;
+            buffer[out] = from >= 0 ? buffer[from] : (unsigned char)dictionary[DICTIONARY_SIZE + from];
+        }
+    }
+
+    return out == total ? total : -1;
+}
+
+int decompress_received(const unsigned char **message, int len, unsigned char *buffer, int size)
+{
+    if (data_peek_type(*message, len) != DATA_COMPRESSED)
+    {
+        return len;
+    }
+
+    len = decompress_message(*message, len, buffer, size);
+    if (len != -1)
+    {
+        *message = buffer;
+    }
+    return len;
+}
+
+int compress_peek_type(const unsigned char *buffer, int len)
+{
+    int type = data_peek_type(buffer, len);
+    return type == DATA_COMPRESSED && len > 1 ? data_peek_type(buffer + 1, len - 1) : type;
+}
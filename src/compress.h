@@ -0,0 +1,43 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <SDL2/SDL.h>
+
+#include "data.h"
+
+// messages at least this long are compressed for clients that can take it, unless told otherwise
+#define COMPRESS_DEFAULT_THRESHOLD 128
+
+// a compressed message is the DATA_COMPRESSED tag, the first byte of the original so its type can
+// still be told, the original's length, then LZ4 style sequences of the rest: a token of literal and
+// match lengths, the literals, and a match's 16-bit offset back into what came before it, which
+// starts with the preset dictionary
+#define COMPRESS_HEADER_SIZE (1 + 1 + 2)
+#define COMPRESS_HASH_BITS 10
+
+// what the dictionary and a message are searched in, the dictionary is loaded once and every message
+// is copied in after it
+struct compressor
+{
+    Uint16 dictionary_table[1 << COMPRESS_HASH_BITS];
+    Uint16 table[1 << COMPRESS_HASH_BITS];
+    unsigned char window[];
+};
+
+struct compressor *compressor_alloc(void);
+void compressor_free(struct compressor *compressor);
+
+// returns the compressed length, or -1 if it wouldn't be any shorter than the message
+int compress_message(struct compressor *compressor, const unsigned char *message, int len, unsigned char *buffer, int size);
+
+// returns the original length, or -1 if the compressed message is malformed
+int decompress_message(const unsigned char *compressed, int len, unsigned char *buffer, int size);
+
+// points the message at its decompressed bytes in the buffer if it came compressed, returns its
+// length, or -1 if it is malformed
+int decompress_received(const unsigned char **message, int len, unsigned char *buffer, int size);
+
+// the type of a message, looking inside it if it is compressed
+int compress_peek_type(const unsigned char *buffer, int len);
+
+#endif
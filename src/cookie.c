@@ -0,0 +1,89 @@
+#include "cookie.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_net.h>
+#include <stdio.h>
+
+#define ROTATE(x, b) ((x) << (b) | (x) >> (64 - (b)))
+
+#define SIP_ROUND(v0, v1, v2, v3) \
+    do                            \
+    {                             \
+        v0 += v1;                 \
+        v1 = ROTATE(v1, 13);      \
+        v1 ^= v0;                 \
+        v0 = ROTATE(v0, 32);      \
+        v2 += v3;                 \
+        v3 = ROTATE(v3, 16);      \
+        v3 ^= v2;                 \
+        v0 += v3;                 \
+        v3 = ROTATE(v3, 21);      \
+        v3 ^= v0;                 \
+        v2 += v1;                 \
+        v1 = ROTATE(v1, 17);      \
+        v1 ^= v2;                 \
+        v2 = ROTATE(v2, 32);      \
+    } while (0)
+
+// SipHash-2-4 of two words, so a cookie can't be made from the ones seen without the key
+static Uint64 sip_hash(const struct cookie_key *key, Uint64 m0, Uint64 m1)
+{
+    Uint64 v0 = key->k0 ^ 0x736f6d6570736575ull;
+    Uint64 v1 = key->k1 ^ 0x646f72616e646f6dull;
+    Uint64 v2 = key->k0 ^ 0x6c7967656e657261ull;
+    Uint64 v3 = key->k1 ^ 0x7465646279746573ull;
+
+    Uint64 words[3] = {m0, m1, (Uint64)16 << 56};
+    for (int i = 0; i < 3; i++)
+    {
+        v3 ^= words[i];
+        SIP_ROUND(v0, v1, v2, v3);
+        SIP_ROUND(v0, v1, v2, v3);
+        v0 ^= words[i];
+    }
+
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; i++)
+    {
+        SIP_ROUND(v0, v1, v2, v3);
+    }
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+void cookie_key_init(struct cookie_key *key)
+{
+    FILE *random = fopen("/dev/urandom", "rb");
+    if (random)
+    {
+        size_t read = fread(key, sizeof(*key), 1, random);
+        fclose(random);
+        if (read == 1)
+        {
+            return;
+        }
+    }
+
+    // without one the key is only as unpredictable as when the process started
+    key->k0 = SDL_GetPerformanceCounter() ^ (Uint64)(uintptr_t)key;
+    key->k1 = (Uint64)SDL_GetTicks() << 32 ^ sip_hash(key, key->k0, (Uint64)(uintptr_t)&random);
+}
+
+Uint32 cookie_make(const struct cookie_key *key, const IPaddress *address, Uint32 now)
+{
+    Uint64 endpoint = (Uint64)address->host << 16 | address->port;
+    return (Uint32)sip_hash(key, endpoint, now / COOKIE_LIFETIME);
+}
+
+bool cookie_check(const struct cookie_key *key, const IPaddress *address, Uint32 cookie, Uint32 now)
+{
+    // one made just before the lifetime rolled over still counts
+    return cookie == cookie_make(key, address, now) ||
+           cookie == cookie_make(key, address, now - COOKIE_LIFETIME);
+}
+
+Uint32 cookie_make_id(const struct cookie_key *key, int id)
+{
+    // the second word is never a time, so these can't be mistaken for an address's
+    return (Uint32)sip_hash(key, (Uint32)id, ~0ull);
+}
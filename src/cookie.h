@@ -0,0 +1,28 @@
+#ifndef COOKIE_H
+#define COOKIE_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_net.h>
+#include <stdbool.h>
+
+// a cookie is good for at least this long in milliseconds, and at most twice it
+#define COOKIE_LIFETIME 10000
+
+// a peer that echoes the cookie it was sent for its address shows it receives what is sent there,
+// the cookie is a keyed hash of the address and the time, so only the holder of the key can make one
+struct cookie_key
+{
+    Uint64 k0;
+    Uint64 k1;
+};
+
+// from the system's random source where there is one
+void cookie_key_init(struct cookie_key *key);
+
+Uint32 cookie_make(const struct cookie_key *key, const IPaddress *address, Uint32 now);
+bool cookie_check(const struct cookie_key *key, const IPaddress *address, Uint32 cookie, Uint32 now);
+
+// for a client ID rather than an address, good for as long as the key
+Uint32 cookie_make_id(const struct cookie_key *key, int id);
+
+#endif
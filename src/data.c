@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include <string.h>
 
 #include "data.h"
@@ -17,6 +18,16 @@ struct id_data id_data_create(enum data_type type, int id)
     return id_data;
 }
 
+struct connect_data connect_data_create(enum data_type type, int id, int features)
+{
+    struct connect_data connect_data;
+    connect_data.data = data_create(type);
+    connect_data.id = id;
+    connect_data.features = features;
+    connect_data.cookie = 0;
+    return connect_data;
+}
+
 struct mouse_data mouse_data_create(enum data_type type, int id, int x, int y)
 {
     struct mouse_data mouse_data;
@@ -27,11 +38,840 @@ struct mouse_data mouse_data_create(enum data_type type, int id, int x, int y)
     return mouse_data;
 }
 
-struct chat_data chat_data_create(enum data_type type, int id, char *message)
+struct chat_data chat_data_create(enum data_type type, int id, const char *message)
 {
     struct chat_data chat_data;
     chat_data.data = data_create(type);
     chat_data.id = id;
-    strcpy(chat_data.message, message);
+    const char *end = memchr(message, '\0', MAX_STRLEN - 1);
+    chat_data.message = message;
+    chat_data.length = end ? (int)(end - message) : MAX_STRLEN - 1;
     return chat_data;
 }
+
+struct input_data input_data_create(enum data_type type, int id, int x, int y, int buttons)
+{
+    struct input_data input_data;
+    input_data.data = data_create(type);
+    input_data.id = id;
+    input_data.x = x;
+    input_data.y = y;
+    input_data.buttons = buttons;
+    return input_data;
+}
+
+struct snapshot_data snapshot_data_create(enum data_type type, unsigned int sequence, unsigned int time)
+{
+    struct snapshot_data snapshot_data;
+    snapshot_data.data = data_create(type);
+    snapshot_data.sequence = sequence;
+    snapshot_data.time = time;
+    snapshot_data.num_clients = 0;
+    return snapshot_data;
+}
+
+static const struct client_state *find_state(const struct snapshot_data *snapshot, int id)
+{
+    for (int i = 0; i < snapshot->num_clients; i++)
+    {
+        if (snapshot->clients[i].id == id)
+        {
+            return &snapshot->clients[i];
+        }
+    }
+    return NULL;
+}
+
+struct delta_data delta_data_create(enum data_type type, const struct snapshot_data *baseline, const struct snapshot_data *snapshot)
+{
+    struct delta_data delta_data;
+    delta_data.data = data_create(type);
+    delta_data.sequence = snapshot->sequence;
+    delta_data.baseline = baseline->sequence;
+    delta_data.time = snapshot->time;
+    delta_data.num_changed = 0;
+    delta_data.num_removed = 0;
+
+    // clients new since the baseline carry every field, the rest only what changed
+    for (int i = 0; i < snapshot->num_clients; i++)
+    {
+        const struct client_state *state = &snapshot->clients[i];
+        const struct client_state *previous = find_state(baseline, state->id);
+
+        int fields = DELTA_ALL;
+        if (previous)
+        {
+            fields = (state->x != previous->x ? DELTA_X : 0) |
+                     (state->y != previous->y ? DELTA_Y : 0) |
+                     (state->buttons != previous->buttons ? DELTA_BUTTONS : 0);
+        }
+
+        if (fields)
+        {
+            struct client_delta *client_delta = &delta_data.changed[delta_data.num_changed++];
+            client_delta->fields = fields;
+            client_delta->state = *state;
+        }
+    }
+
+    for (int i = 0; i < baseline->num_clients; i++)
+    {
+        if (!find_state(snapshot, baseline->clients[i].id))
+        {
+            delta_data.removed[delta_data.num_removed++] = baseline->clients[i].id;
+        }
+    }
+
+    return delta_data;
+}
+
+struct ack_data ack_data_create(enum data_type type, int id, unsigned int sequence)
+{
+    struct ack_data ack_data;
+    ack_data.data = data_create(type);
+    ack_data.id = id;
+    ack_data.sequence = sequence;
+    return ack_data;
+}
+
+struct ping_data ping_data_create(enum data_type type, int id, unsigned int client_time, unsigned int server_time)
+{
+    struct ping_data ping_data;
+    ping_data.data = data_create(type);
+    ping_data.id = id;
+    ping_data.client_time = client_time;
+    ping_data.server_time = server_time;
+    return ping_data;
+}
+
+struct challenge_data challenge_data_create(enum data_type type, unsigned int cookie)
+{
+    struct challenge_data challenge_data;
+    challenge_data.data = data_create(type);
+    challenge_data.cookie = cookie;
+    return challenge_data;
+}
+
+struct catch_up_data catch_up_data_create(enum data_type type)
+{
+    struct catch_up_data catch_up_data;
+    catch_up_data.data = data_create(type);
+    catch_up_data.more = false;
+    catch_up_data.num_clients = 0;
+    catch_up_data.num_chats = 0;
+    return catch_up_data;
+}
+
+const char *data_type_name(enum data_type type)
+{
+    // in the order of the enum
+    static const char *names[DATA_NUM_TYPES] = {
+        "connect_ok",
+        "connect_full",
+        "connect_broadcast",
+        "udp_connect_request",
+        "mousedown_request",
+        "mousedown_broadcast",
+        "chat_request",
+        "chat_broadcast",
+        "disconnect_request",
+        "disconnect_broadcast",
+        "input_request",
+        "snapshot",
+        "snapshot_delta",
+        "snapshot_ack",
+        "connect_request",
+        "channel",
+        "ping",
+        "pong",
+        "batch",
+        "fragment",
+        "catch_up",
+        "compressed",
+        "challenge"};
+
+    return type >= 0 && type < DATA_NUM_TYPES ? names[type] : "unknown";
+}
+
+int snapshot_apply(struct snapshot_data *snapshot, const struct snapshot_data *baseline, const struct delta_data *delta)
+{
+    *snapshot = snapshot_data_create(DATA_SNAPSHOT, delta->sequence, delta->time);
+
+    // carry over the clients that were not removed
+    for (int i = 0; i < baseline->num_clients; i++)
+    {
+        const struct client_state *state = &baseline->clients[i];
+
+        bool removed = false;
+        for (int j = 0; j < delta->num_removed && !removed; j++)
+        {
+            removed = delta->removed[j] == state->id;
+        }
+
+        if (!removed)
+        {
+            snapshot->clients[snapshot->num_clients++] = *state;
+        }
+    }
+
+    for (int i = 0; i < delta->num_changed; i++)
+    {
+        const struct client_delta *client_delta = &delta->changed[i];
+        struct client_state *state = (struct client_state *)find_state(snapshot, client_delta->state.id);
+
+        if (!state)
+        {
+            // a client missing from the baseline has to be sent in full
+            if (client_delta->fields != DELTA_ALL || snapshot->num_clients == SNAPSHOT_MAX_CLIENTS)
+            {
+                return -1;
+            }
+            state = &snapshot->clients[snapshot->num_clients++];
+            state->id = client_delta->state.id;
+        }
+
+        if (client_delta->fields & DELTA_X)
+        {
+            state->x = client_delta->state.x;
+        }
+        if (client_delta->fields & DELTA_Y)
+        {
+            state->y = client_delta->state.y;
+        }
+        if (client_delta->fields & DELTA_BUTTONS)
+        {
+            state->buttons = client_delta->state.buttons;
+        }
+    }
+
+    return 0;
+}
+
+/* Wire format */
+
+// messages are a bit stream, most significant bit first: a type tag of DATA_TYPE_BITS followed by
+// the fields of that type, fixed width where the range is known and varints of groups of bits
+// (each followed by a continuation bit) where it isn't, strings are their varint length then
+// their bytes, starting on a byte boundary so they can be pointed into
+struct writer
+{
+    unsigned char *buffer;
+    int size;
+    int len;
+
+    // bits not yet written out, in the low end
+    unsigned long long bits;
+    int num_bits;
+};
+
+struct reader
+{
+    const unsigned char *buffer;
+    int len;
+    int pos;
+
+    // bits of the bytes read ahead that haven't been consumed yet, in the low end, and garbage
+    // above them
+    unsigned long long bits;
+    int num_bits;
+};
+
+static void write_byte(struct writer *writer, unsigned char value)
+{
+    if (writer->len < writer->size)
+    {
+        writer->buffer[writer->len] = value;
+    }
+    writer->len++;
+}
+
+static void write_flush(struct writer *writer)
+{
+    while (writer->num_bits >= 8)
+    {
+        writer->num_bits -= 8;
+        write_byte(writer, (unsigned char)(writer->bits >> writer->num_bits));
+    }
+}
+
+// at most 24 bits at a time, bytes are only written out once there are four of them
+static void write_bits(struct writer *writer, unsigned int value, int count)
+{
+    writer->bits = (writer->bits << count) | (value & ((1u << count) - 1));
+    writer->num_bits += count;
+    if (writer->num_bits >= 32)
+    {
+        write_flush(writer);
+    }
+}
+
+static void write_align(struct writer *writer)
+{
+    writer->bits <<= (8 - writer->num_bits % 8) % 8;
+    writer->num_bits += (8 - writer->num_bits % 8) % 8;
+    write_flush(writer);
+}
+
+static void write_varint(struct writer *writer, unsigned int value, int group)
+{
+    while (value >> group)
+    {
+        write_bits(writer, (1u << group) | (value & ((1u << group) - 1)), group + 1);
+        value >>= group;
+    }
+    write_bits(writer, value, group + 1);
+}
+
+static void write_id(struct writer *writer, int id)
+{
+    write_bits(writer, (unsigned int)id, DATA_ID_SLOT_BITS);
+    write_varint(writer, (unsigned int)id >> DATA_ID_SLOT_BITS, 3);
+}
+
+// cookies are random to whoever can't make them, so they're sent in full rather than as a varint
+static void write_cookie(struct writer *writer, unsigned int cookie)
+{
+    write_bits(writer, cookie >> 16, 16);
+    write_bits(writer, cookie & 0xFFFF, 16);
+}
+
+static void write_coordinate(struct writer *writer, int value, int max)
+{
+    write_bits(writer, (unsigned int)(value < 0 ? 0 : value > max ? max : value), DATA_COORDINATE_BITS);
+}
+
+static void write_string(struct writer *writer, const char *value, int len)
+{
+    write_varint(writer, (unsigned int)len, 7);
+    write_align(writer);
+    for (int i = 0; i < len; i++)
+    {
+        write_byte(writer, (unsigned char)value[i]);
+    }
+}
+
+// at most 24 bits at a time, reading ahead as many bytes as fit
+static int read_bits(struct reader *reader, int count, unsigned int *value)
+{
+    if (reader->num_bits < count)
+    {
+        while (reader->num_bits <= 56 && reader->pos < reader->len)
+        {
+            reader->bits = (reader->bits << 8) | reader->buffer[reader->pos++];
+            reader->num_bits += 8;
+        }
+        if (reader->num_bits < count)
+        {
+            return -1;
+        }
+    }
+    reader->num_bits -= count;
+    *value = (unsigned int)(reader->bits >> reader->num_bits) & ((1u << count) - 1);
+    return 0;
+}
+
+// the bytes read ahead are given back, and whatever is left of the current byte is padding
+static void read_align(struct reader *reader)
+{
+    reader->pos -= reader->num_bits / 8;
+    reader->num_bits = 0;
+}
+
+static int read_varint(struct reader *reader, unsigned int *value, int group)
+{
+    *value = 0;
+    for (int shift = 0; shift < 32; shift += group)
+    {
+        unsigned int bits;
+        if (read_bits(reader, group + 1, &bits) == -1)
+        {
+            return -1;
+        }
+        // the last group can only carry what's left of the 32 bits
+        unsigned int payload = bits & ((1u << group) - 1);
+        if (shift + group > 32 && payload >> (32 - shift))
+        {
+            return -1;
+        }
+        *value |= payload << shift;
+        if (!(bits >> group))
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int read_id(struct reader *reader, int *value)
+{
+    unsigned int slot, generation;
+    if (read_bits(reader, DATA_ID_SLOT_BITS, &slot) == -1 ||
+        read_varint(reader, &generation, 3) == -1 ||
+        generation > 0x7FFFFFFFu >> DATA_ID_SLOT_BITS)
+    {
+        return -1;
+    }
+    *value = (int)(generation << DATA_ID_SLOT_BITS | slot);
+    return 0;
+}
+
+static int read_cookie(struct reader *reader, unsigned int *cookie)
+{
+    unsigned int high, low;
+    if (read_bits(reader, 16, &high) == -1 ||
+        read_bits(reader, 16, &low) == -1)
+    {
+        return -1;
+    }
+    *cookie = high << 16 | low;
+    return 0;
+}
+
+static int read_field(struct reader *reader, int count, int *value)
+{
+    unsigned int bits;
+    if (read_bits(reader, count, &bits) == -1)
+    {
+        return -1;
+    }
+    *value = (int)bits;
+    return 0;
+}
+
+// points into the buffer being decoded rather than copying out of it
+static int read_string(struct reader *reader, const char **value, int *len, int max)
+{
+    unsigned int length;
+    if (read_varint(reader, &length, 7) == -1)
+    {
+        return -1;
+    }
+
+    read_align(reader);
+
+    if (length >= (unsigned int)max || length > (unsigned int)(reader->len - reader->pos))
+    {
+        return -1;
+    }
+    *value = (const char *)reader->buffer + reader->pos;
+    *len = (int)length;
+    reader->pos += length;
+    return 0;
+}
+
+static void write_state(struct writer *writer, const struct client_state *state, int fields)
+{
+    if (fields & DELTA_X)
+    {
+        write_coordinate(writer, state->x, WORLD_WIDTH - 1);
+    }
+    if (fields & DELTA_Y)
+    {
+        write_coordinate(writer, state->y, WORLD_HEIGHT - 1);
+    }
+    if (fields & DELTA_BUTTONS)
+    {
+        write_bits(writer, (unsigned int)state->buttons, DATA_BUTTONS_BITS);
+    }
+}
+
+static int read_state(struct reader *reader, struct client_state *state, int fields)
+{
+    if (((fields & DELTA_X) && read_field(reader, DATA_COORDINATE_BITS, &state->x) == -1) ||
+        ((fields & DELTA_Y) && read_field(reader, DATA_COORDINATE_BITS, &state->y) == -1) ||
+        ((fields & DELTA_BUTTONS) && read_field(reader, DATA_BUTTONS_BITS, &state->buttons) == -1))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+int data_id_bits(int id)
+{
+    int bits = DATA_ID_SLOT_BITS + 4;
+    for (unsigned int generation = (unsigned int)id >> DATA_ID_SLOT_BITS; generation >> 3; generation >>= 3)
+    {
+        bits += 4;
+    }
+    return bits;
+}
+
+int data_peek_type(const unsigned char *buffer, int len)
+{
+    return len > 0 ? buffer[0] >> (8 - DATA_TYPE_BITS) : -1;
+}
+
+int data_encode(const struct data *data, unsigned char *buffer, int size)
+{
+    struct writer writer = {buffer, size, 0, 0, 0};
+
+    write_bits(&writer, (unsigned int)data->type, DATA_TYPE_BITS);
+
+    switch (data->type)
+    {
+    case DATA_CONNECT_FULL:
+    case DATA_DISCONNECT_REQUEST:
+        break;
+    case DATA_CONNECT_REQUEST:
+    {
+        const struct connect_data *connect_data = (const struct connect_data *)data;
+        write_bits(&writer, (unsigned int)connect_data->features, DATA_FEATURE_BITS);
+        write_cookie(&writer, connect_data->cookie);
+    }
+    break;
+    case DATA_CONNECT_OK:
+    {
+        const struct connect_data *connect_data = (const struct connect_data *)data;
+        write_id(&writer, connect_data->id);
+        write_bits(&writer, (unsigned int)connect_data->features, DATA_FEATURE_BITS);
+        write_cookie(&writer, connect_data->cookie);
+    }
+    break;
+    case DATA_UDP_CONNECT_REQUEST:
+    {
+        const struct connect_data *connect_data = (const struct connect_data *)data;
+        write_id(&writer, connect_data->id);
+        write_cookie(&writer, connect_data->cookie);
+    }
+    break;
+    case DATA_CONNECT_BROADCAST:
+    case DATA_DISCONNECT_BROADCAST:
+    {
+        const struct id_data *id_data = (const struct id_data *)data;
+        write_id(&writer, id_data->id);
+    }
+    break;
+    case DATA_MOUSEDOWN_REQUEST:
+    case DATA_MOUSEDOWN_BROADCAST:
+    {
+        const struct mouse_data *mouse_data = (const struct mouse_data *)data;
+        write_id(&writer, mouse_data->id);
+        write_coordinate(&writer, mouse_data->x, WORLD_WIDTH - 1);
+        write_coordinate(&writer, mouse_data->y, WORLD_HEIGHT - 1);
+    }
+    break;
+    case DATA_CHAT_REQUEST:
+    case DATA_CHAT_BROADCAST:
+    {
+        const struct chat_data *chat_data = (const struct chat_data *)data;
+        write_id(&writer, chat_data->id);
+        write_string(&writer, chat_data->message, chat_data->length);
+    }
+    break;
+    case DATA_INPUT_REQUEST:
+    {
+        const struct input_data *input_data = (const struct input_data *)data;
+        struct client_state state = {input_data->id, input_data->x, input_data->y, input_data->buttons};
+        write_id(&writer, input_data->id);
+        write_state(&writer, &state, DELTA_ALL);
+    }
+    break;
+    case DATA_SNAPSHOT:
+    {
+        const struct snapshot_data *snapshot_data = (const struct snapshot_data *)data;
+        write_varint(&writer, snapshot_data->sequence, 7);
+        write_varint(&writer, snapshot_data->time, 7);
+        write_bits(&writer, (unsigned int)snapshot_data->num_clients, DATA_COUNT_BITS);
+        for (int i = 0; i < snapshot_data->num_clients; i++)
+        {
+            const struct client_state *state = &snapshot_data->clients[i];
+            write_id(&writer, state->id);
+            write_state(&writer, state, DELTA_ALL);
+        }
+    }
+    break;
+    case DATA_SNAPSHOT_DELTA:
+    {
+        // each changed client is its ID, the DELTA_* flags and only the flagged fields
+        const struct delta_data *delta_data = (const struct delta_data *)data;
+        write_varint(&writer, delta_data->sequence, 7);
+        write_varint(&writer, delta_data->baseline, 7);
+        write_varint(&writer, delta_data->time, 7);
+        write_bits(&writer, (unsigned int)delta_data->num_changed, DATA_COUNT_BITS);
+        for (int i = 0; i < delta_data->num_changed; i++)
+        {
+            const struct client_delta *client_delta = &delta_data->changed[i];
+            write_id(&writer, client_delta->state.id);
+            write_bits(&writer, (unsigned int)client_delta->fields, DATA_FIELDS_BITS);
+            write_state(&writer, &client_delta->state, client_delta->fields);
+        }
+        write_bits(&writer, (unsigned int)delta_data->num_removed, DATA_COUNT_BITS);
+        for (int i = 0; i < delta_data->num_removed; i++)
+        {
+            write_id(&writer, delta_data->removed[i]);
+        }
+    }
+    break;
+    case DATA_SNAPSHOT_ACK:
+    {
+        const struct ack_data *ack_data = (const struct ack_data *)data;
+        write_id(&writer, ack_data->id);
+        write_varint(&writer, ack_data->sequence, 7);
+    }
+    break;
+    case DATA_PING:
+    case DATA_PONG:
+    {
+        const struct ping_data *ping_data = (const struct ping_data *)data;
+        write_id(&writer, ping_data->id);
+        write_varint(&writer, ping_data->client_time, 7);
+        write_varint(&writer, ping_data->server_time, 7);
+    }
+    break;
+    case DATA_CHALLENGE:
+    {
+        // a request is as large as its answer
+        const struct challenge_data *challenge_data = (const struct challenge_data *)data;
+        write_cookie(&writer, challenge_data->cookie);
+    }
+    break;
+    case DATA_CATCH_UP:
+    {
+        const struct catch_up_data *catch_up_data = (const struct catch_up_data *)data;
+        write_bits(&writer, catch_up_data->more, 1);
+        write_bits(&writer, (unsigned int)catch_up_data->num_clients, DATA_COUNT_BITS);
+        for (int i = 0; i < catch_up_data->num_clients; i++)
+        {
+            write_id(&writer, catch_up_data->clients[i]);
+        }
+        write_bits(&writer, (unsigned int)catch_up_data->num_chats, DATA_COUNT_BITS);
+        for (int i = 0; i < catch_up_data->num_chats; i++)
+        {
+            write_id(&writer, catch_up_data->chats[i].id);
+            write_string(&writer, catch_up_data->chats[i].message, catch_up_data->chats[i].length);
+        }
+    }
+    break;
+    default:
+        return -1;
+    }
+
+    write_align(&writer);
+
+    // the writer keeps counting past the end so overflow is detected once here
+    return writer.len <= size ? writer.len : -1;
+}
+
+int data_decode(union data_any *data, const unsigned char *buffer, int len)
+{
+    struct reader reader = {buffer, len, 0, 0, 0};
+
+    unsigned int type;
+    if (read_bits(&reader, DATA_TYPE_BITS, &type) == -1)
+    {
+        return -1;
+    }
+
+    data->data = data_create((enum data_type)type);
+
+    switch (data->data.type)
+    {
+    case DATA_CONNECT_FULL:
+    case DATA_DISCONNECT_REQUEST:
+        break;
+    case DATA_CONNECT_REQUEST:
+    {
+        data->connect_data.id = 0;
+        if (read_field(&reader, DATA_FEATURE_BITS, &data->connect_data.features) == -1 ||
+            read_cookie(&reader, &data->connect_data.cookie) == -1)
+        {
+            return -1;
+        }
+    }
+    break;
+    case DATA_CONNECT_OK:
+    {
+        if (read_id(&reader, &data->connect_data.id) == -1 ||
+            read_field(&reader, DATA_FEATURE_BITS, &data->connect_data.features) == -1 ||
+            read_cookie(&reader, &data->connect_data.cookie) == -1)
+        {
+            return -1;
+        }
+    }
+    break;
+    case DATA_UDP_CONNECT_REQUEST:
+    {
+        data->connect_data.features = 0;
+        if (read_id(&reader, &data->connect_data.id) == -1 ||
+            read_cookie(&reader, &data->connect_data.cookie) == -1)
+        {
+            return -1;
+        }
+    }
+    break;
+    case DATA_CONNECT_BROADCAST:
+    case DATA_DISCONNECT_BROADCAST:
+    {
+        if (read_id(&reader, &data->id_data.id) == -1)
+        {
+            return -1;
+        }
+    }
+    break;
+    case DATA_MOUSEDOWN_REQUEST:
+    case DATA_MOUSEDOWN_BROADCAST:
+    {
+        if (read_id(&reader, &data->mouse_data.id) == -1 ||
+            read_field(&reader, DATA_COORDINATE_BITS, &data->mouse_data.x) == -1 ||
+            read_field(&reader, DATA_COORDINATE_BITS, &data->mouse_data.y) == -1)
+        {
+            return -1;
+        }
+    }
+    break;
+    case DATA_CHAT_REQUEST:
+    case DATA_CHAT_BROADCAST:
+    {
+        if (read_id(&reader, &data->chat_data.id) == -1 ||
+            read_string(&reader, &data->chat_data.message, &data->chat_data.length, MAX_STRLEN) == -1)
+        {
+            return -1;
+        }
+    }
+    break;
+    case DATA_INPUT_REQUEST:
+    {
+        struct client_state state;
+        if (read_id(&reader, &data->input_data.id) == -1 ||
+            read_state(&reader, &state, DELTA_ALL) == -1)
+        {
+            return -1;
+        }
+        data->input_data.x = state.x;
+        data->input_data.y = state.y;
+        data->input_data.buttons = state.buttons;
+    }
+    break;
+    case DATA_SNAPSHOT:
+    {
+        unsigned int num_clients;
+        if (read_varint(&reader, &data->snapshot_data.sequence, 7) == -1 ||
+            read_varint(&reader, &data->snapshot_data.time, 7) == -1 ||
+            read_bits(&reader, DATA_COUNT_BITS, &num_clients) == -1 ||
+            num_clients > SNAPSHOT_MAX_CLIENTS)
+        {
+            return -1;
+        }
+        data->snapshot_data.num_clients = (int)num_clients;
+        for (unsigned int i = 0; i < num_clients; i++)
+        {
+            struct client_state *state = &data->snapshot_data.clients[i];
+            if (read_id(&reader, &state->id) == -1 ||
+                read_state(&reader, state, DELTA_ALL) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    break;
+    case DATA_SNAPSHOT_DELTA:
+    {
+        struct delta_data *delta_data = &data->delta_data;
+        unsigned int num_changed, num_removed;
+        if (read_varint(&reader, &delta_data->sequence, 7) == -1 ||
+            read_varint(&reader, &delta_data->baseline, 7) == -1 ||
+            read_varint(&reader, &delta_data->time, 7) == -1 ||
+            read_bits(&reader, DATA_COUNT_BITS, &num_changed) == -1 ||
+            num_changed > SNAPSHOT_MAX_CLIENTS)
+        {
+            return -1;
+        }
+        delta_data->num_changed = (int)num_changed;
+        for (unsigned int i = 0; i < num_changed; i++)
+        {
+            struct client_delta *client_delta = &delta_data->changed[i];
+            if (read_id(&reader, &client_delta->state.id) == -1 ||
+                read_field(&reader, DATA_FIELDS_BITS, &client_delta->fields) == -1 ||
+                read_state(&reader, &client_delta->state, client_delta->fields) == -1)
+            {
+                return -1;
+            }
+        }
+        if (read_bits(&reader, DATA_COUNT_BITS, &num_removed) == -1 ||
+            num_removed > SNAPSHOT_MAX_CLIENTS)
+        {
+            return -1;
+        }
+        delta_data->num_removed = (int)num_removed;
+        for (unsigned int i = 0; i < num_removed; i++)
+        {
+            if (read_id(&reader, &delta_data->removed[i]) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    break;
+    case DATA_SNAPSHOT_ACK:
+    {
+        if (read_id(&reader, &data->ack_data.id) == -1 ||
+            read_varint(&reader, &data->ack_data.sequence, 7) == -1)
+        {
+            return -1;
+        }
+    }
+    break;
+    case DATA_PING:
+    case DATA_PONG:
+    {
+        if (read_id(&reader, &data->ping_data.id) == -1 ||
+            read_varint(&reader, &data->ping_data.client_time, 7) == -1 ||
+            read_varint(&reader, &data->ping_data.server_time, 7) == -1)
+        {
+            return -1;
+        }
+    }
+    break;
+    case DATA_CHALLENGE:
+    {
+        if (read_cookie(&reader, &data->challenge_data.cookie) == -1)
+        {
+            return -1;
+        }
+    }
+    break;
+    case DATA_CATCH_UP:
+    {
+        struct catch_up_data *catch_up_data = &data->catch_up_data;
+        unsigned int more, num_clients, num_chats;
+        if (read_bits(&reader, 1, &more) == -1 ||
+            read_bits(&reader, DATA_COUNT_BITS, &num_clients) == -1 ||
+            num_clients > CATCH_UP_MAX_CLIENTS)
+        {
+            return -1;
+        }
+        catch_up_data->more = more;
+        catch_up_data->num_clients = (int)num_clients;
+        for (unsigned int i = 0; i < num_clients; i++)
+        {
+            if (read_id(&reader, &catch_up_data->clients[i]) == -1)
+            {
+                return -1;
+            }
+        }
+        if (read_bits(&reader, DATA_COUNT_BITS, &num_chats) == -1 ||
+            num_chats > CHAT_HISTORY)
+        {
+            return -1;
+        }
+        catch_up_data->num_chats = (int)num_chats;
+        for (unsigned int i = 0; i < num_chats; i++)
+        {
+            struct chat_data *chat_data = &catch_up_data->chats[i];
+            chat_data->data = data_create(DATA_CHAT_BROADCAST);
+            if (read_id(&reader, &chat_data->id) == -1 ||
+                read_string(&reader, &chat_data->message, &chat_data->length, MAX_STRLEN) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    break;
+    default:
+        return -1;
+    }
+
+    read_align(&reader);
+
+    return reader.pos;
+}
@@ -1,9 +1,64 @@
 #ifndef DATA_H
 #define DATA_H
 
-#define PACKET_SIZE 1024
+#include <stdbool.h>
+
+// the most a datagram carries, what fits in an Ethernet frame after the IP and UDP headers
+#define PACKET_SIZE 1472
 #define MAX_STRLEN 256
 
+// the coordinate space shared by every client's window
+#define WORLD_WIDTH 800
+#define WORLD_HEIGHT 600
+
+// the most client states carried by one snapshot, a crowded view can take more than one datagram
+// and is sent in fragments
+#define SNAPSHOT_MAX_CLIENTS 256
+
+// how many recent snapshots are kept to delta against, a power of two
+#define SNAPSHOT_HISTORY 32
+
+// the most recent chat messages a joining client is sent
+#define CHAT_HISTORY 32
+
+// a catch-up is kept to this many bytes so every reliable path can carry it, even a channel datagram
+// of the smallest MTU, a roster or history that doesn't fit is spread over several, and decoding one
+// takes more clients than ever fit
+#define DATA_MAX_CATCH_UP_SIZE 488
+#define CATCH_UP_MAX_CLIENTS 256
+
+// what a client can do beyond the basics, offered in its connect request and agreed to in the
+// response, and how many bits of them are sent
+#define DATA_FEATURE_COMPRESSION 0x1
+#define DATA_FEATURE_BITS 4
+
+// which fields of a client state a delta carries
+#define DELTA_X 0x1
+#define DELTA_Y 0x2
+#define DELTA_BUTTONS 0x4
+#define DELTA_ALL (DELTA_X | DELTA_Y | DELTA_BUTTONS)
+
+// messages are packed into as few bits as their fields need, the type tag takes the top bits of the
+// first byte so a message's type can be told without decoding the rest
+#define DATA_TYPE_BITS 5
+#define DATA_TAG(type) ((unsigned char)((type) << (8 - DATA_TYPE_BITS)))
+
+// an ID's slot is sized to the most clients the server can hold, the generation after it is a varint
+#define DATA_ID_SLOT_BITS 16
+#define DATA_ID_MAX_BITS (DATA_ID_SLOT_BITS + 5 * 4)
+
+// coordinates are clamped to the world and sent in enough bits to cover it, buttons are SDL's five
+#define DATA_COORDINATE_BITS 10
+#define DATA_BUTTONS_BITS 5
+#define DATA_FIELDS_BITS 3
+#define DATA_COUNT_BITS 9
+
+// a type tag, two varints and a full snapshot, the largest message there is
+// (a delta that would not fit is never smaller than the full snapshot, so it is not sent)
+#define DATA_MAX_ENCODED_SIZE \
+    ((DATA_TYPE_BITS + 2 * 40 + DATA_COUNT_BITS + \
+      SNAPSHOT_MAX_CLIENTS * (DATA_ID_MAX_BITS + 2 * DATA_COORDINATE_BITS + DATA_BUTTONS_BITS) + 7) / 8)
+
 enum data_type
 {
     DATA_CONNECT_OK,
@@ -15,7 +70,23 @@ enum data_type
     DATA_CHAT_REQUEST,
     DATA_CHAT_BROADCAST,
     DATA_DISCONNECT_REQUEST,
-    DATA_DISCONNECT_BROADCAST
+    DATA_DISCONNECT_BROADCAST,
+    DATA_INPUT_REQUEST,
+    DATA_SNAPSHOT,
+    DATA_SNAPSHOT_DELTA,
+    DATA_SNAPSHOT_ACK,
+    DATA_CONNECT_REQUEST,
+    DATA_CHANNEL,
+    DATA_PING,
+    DATA_PONG,
+    DATA_BATCH,
+    DATA_FRAGMENT,
+    DATA_CATCH_UP,
+    DATA_COMPRESSED,
+    DATA_CHALLENGE,
+
+    // how many types there are, never sent
+    DATA_NUM_TYPES
 };
 
 struct data
@@ -29,6 +100,17 @@ struct id_data
     int id;
 };
 
+// the ID is only set in the response, the cookie is the one a request over a channel was sent for
+// its address, or in the response the one a TCP client's UDP connect request has to carry, which
+// is a connect_data of its own with the client's ID
+struct connect_data
+{
+    struct data data;
+    int id;
+    int features;
+    unsigned int cookie;
+};
+
 struct mouse_data
 {
     struct data data;
@@ -37,16 +119,142 @@ struct mouse_data
     int y;
 };
 
+// the message points into whatever the chat was created from or decoded out of, so it is only
+// valid for as long as that buffer is, and isn't NUL terminated
 struct chat_data
 {
     struct data data;
     int id;
-    char message[MAX_STRLEN];
+    const char *message;
+    int length;
+};
+
+struct input_data
+{
+    struct data data;
+    int id;
+    int x;
+    int y;
+    int buttons;
+};
+
+struct client_state
+{
+    int id;
+    int x;
+    int y;
+    int buttons;
+};
+
+// the time is the server's clock in milliseconds when the snapshot was taken
+struct snapshot_data
+{
+    struct data data;
+    unsigned int sequence;
+    unsigned int time;
+    int num_clients;
+    struct client_state clients[SNAPSHOT_MAX_CLIENTS];
+};
+
+struct client_delta
+{
+    int fields;
+    struct client_state state;
+};
+
+// the changes from the baseline snapshot to the one with the given sequence
+struct delta_data
+{
+    struct data data;
+    unsigned int sequence;
+    unsigned int baseline;
+    unsigned int time;
+    int num_changed;
+    struct client_delta changed[SNAPSHOT_MAX_CLIENTS];
+    int num_removed;
+    int removed[SNAPSHOT_MAX_CLIENTS];
+};
+
+struct ack_data
+{
+    struct data data;
+    int id;
+    unsigned int sequence;
+};
+
+// either side can ping, the clock of whichever sent it when it did, and the other's when it answered
+struct ping_data
+{
+    struct data data;
+    int id;
+    unsigned int client_time;
+    unsigned int server_time;
+};
+
+// a client about to connect over a channel asks for a cookie with one of 0, and is sent the one for
+// its address, both are the same size so the answer is never larger than what was asked
+struct challenge_data
+{
+    struct data data;
+    unsigned int cookie;
+};
+
+// what a joining client missed, the other clients connected and the recent chat, oldest first,
+// more is set while another catch-up follows with the rest
+struct catch_up_data
+{
+    struct data data;
+    bool more;
+    int num_clients;
+    int clients[CATCH_UP_MAX_CLIENTS];
+    int num_chats;
+    struct chat_data chats[CHAT_HISTORY];
+};
+
+// large enough to decode any message into
+union data_any
+{
+    struct data data;
+    struct id_data id_data;
+    struct connect_data connect_data;
+    struct mouse_data mouse_data;
+    struct chat_data chat_data;
+    struct input_data input_data;
+    struct snapshot_data snapshot_data;
+    struct delta_data delta_data;
+    struct ack_data ack_data;
+    struct ping_data ping_data;
+    struct challenge_data challenge_data;
+    struct catch_up_data catch_up_data;
 };
 
 struct data data_create(enum data_type type);
 struct id_data id_data_create(enum data_type type, int id);
+struct connect_data connect_data_create(enum data_type type, int id, int features);
 struct mouse_data mouse_data_create(enum data_type type, int id, int x, int y);
-struct chat_data chat_data_create(enum data_type type, int id, char *message);
+struct chat_data chat_data_create(enum data_type type, int id, const char *message);
+struct input_data input_data_create(enum data_type type, int id, int x, int y, int buttons);
+struct snapshot_data snapshot_data_create(enum data_type type, unsigned int sequence, unsigned int time);
+struct delta_data delta_data_create(enum data_type type, const struct snapshot_data *baseline, const struct snapshot_data *snapshot);
+struct ack_data ack_data_create(enum data_type type, int id, unsigned int sequence);
+struct ping_data ping_data_create(enum data_type type, int id, unsigned int client_time, unsigned int server_time);
+struct challenge_data challenge_data_create(enum data_type type, unsigned int cookie);
+struct catch_up_data catch_up_data_create(enum data_type type);
+
+// a lowercase name without the prefix, for reporting
+const char *data_type_name(enum data_type type);
+
+// how many bits an ID takes in any message, for filling one up to a size without encoding it
+int data_id_bits(int id);
+
+// the type of an encoded message, or -1 if the buffer is empty
+int data_peek_type(const unsigned char *buffer, int len);
+
+int snapshot_apply(struct snapshot_data *snapshot, const struct snapshot_data *baseline, const struct delta_data *delta);
+
+int data_encode(const struct data *data, unsigned char *buffer, int size);
+
+// variable length fields are left in the buffer, so it has to outlive the decoded message
+int data_decode(union data_any *data, const unsigned char *buffer, int len);
 
 #endif
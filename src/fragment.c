@@ -0,0 +1,126 @@
+#include "fragment.h"
+
+#include <SDL2/SDL_net.h>
+#include <string.h>
+
+static int chunk_size(int len, int count)
+{
+    return (len + count - 1) / count;
+}
+
+int fragment_count(int len, int mtu)
+{
+    if (len <= mtu)
+    {
+        return 1;
+    }
+
+    int chunk = mtu - FRAGMENT_HEADER_SIZE;
+    return (len + chunk - 1) / chunk;
+}
+
+int fragment_write(unsigned char *buffer, Uint16 id, int index, int count, const unsigned char *message, int len)
+{
+    int chunk = chunk_size(len, count);
+    int start = index * chunk;
+    int size = SDL_min(chunk, len - start);
+
+    buffer[0] = DATA_TAG(DATA_FRAGMENT);
+    SDLNet_Write16(id, buffer + 1);
+    buffer[3] = (unsigned char)index;
+    buffer[4] = (unsigned char)count;
+    SDLNet_Write16((Uint16)len, buffer + 5);
+    memcpy(buffer + FRAGMENT_HEADER_SIZE, message + start, size);
+
+    return FRAGMENT_HEADER_SIZE + size;
+}
+
+int reassembly_add(struct reassembly *reassembly, const unsigned char *fragment, int len, Uint32 now, const unsigned char **message)
+{
+    if (len <= FRAGMENT_HEADER_SIZE || data_peek_type(fragment, len) != DATA_FRAGMENT)
+    {
+        return -1;
+    }
+
+    Uint16 id = SDLNet_Read16(fragment + 1);
+    int index = fragment[3];
+    int count = fragment[4];
+    int total = SDLNet_Read16(fragment + 5);
+    if (count < 2 || count > FRAGMENT_MAX_COUNT || index >= count || total > DATA_MAX_ENCODED_SIZE)
+    {
+        return -1;
+    }
+
+    int chunk = chunk_size(total, count);
+    int start = index * chunk;
+    int size = len - FRAGMENT_HEADER_SIZE;
+    if (start >= total || size != SDL_min(chunk, total - start))
+    {
+        return -1;
+    }
+
+    // find the message's slot, or else the free or oldest one to start it in
+    struct fragment_slot *slot = NULL;
+    struct fragment_slot *oldest = NULL;
+    for (int i = 0; i < FRAGMENT_SLOTS; i++)
+    {
+        struct fragment_slot *candidate = &reassembly->slots[i];
+        if (candidate->used && now - candidate->time > FRAGMENT_TIMEOUT)
+        {
+            candidate->used = false;
+            reassembly->expired++;
+        }
+
+        if (candidate->used && candidate->id == id)
+        {
+            slot = candidate;
+            break;
+        }
+
+        if (!oldest || (oldest->used && (!candidate->used || now - candidate->time > now - oldest->time)))
+        {
+            oldest = candidate;
+        }
+    }
+
+    if (slot && (slot->count != count || slot->len != total))
+    {
+        return -1;
+    }
+
+    if (!slot)
+    {
+        slot = oldest;
+        if (slot->used)
+        {
+            reassembly->expired++;
+        }
+
+        slot->used = true;
+        slot->id = id;
+        slot->time = now;
+        slot->count = count;
+        slot->len = total;
+        slot->received = 0;
+    }
+
+    Uint32 bit = (Uint32)1 << index;
+    if (slot->received & bit)
+    {
+        return 0;
+    }
+
+    memcpy(slot->data + start, fragment + FRAGMENT_HEADER_SIZE, size);
+    slot->received |= bit;
+
+    Uint32 all = count == 32 ? 0xffffffff : ((Uint32)1 << count) - 1;
+    if (slot->received != all)
+    {
+        return 0;
+    }
+
+    // the message stays in the slot until another fragment needs it
+    slot->used = false;
+    *message = slot->data;
+    return slot->len;
+}
@@ -0,0 +1,49 @@
+#ifndef FRAGMENT_H
+#define FRAGMENT_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#include "data.h"
+
+// a message too large for the MTU is split into fragments, each the DATA_FRAGMENT tag, the
+// message's ID, the fragment's index, how many there are and the message's length, then an
+// equal share of the message's bytes, except for the last which has what is left
+#define FRAGMENT_HEADER_SIZE (1 + 2 + 1 + 1 + 2)
+#define FRAGMENT_MAX_COUNT 32
+
+// messages being put back together at once for each peer, in slots allocated up front so a peer can
+// never hold more than this, and how long one waits for its missing fragments before it is given up on
+#define FRAGMENT_SLOTS 2
+#define FRAGMENT_TIMEOUT 1000
+
+struct fragment_slot
+{
+    bool used;
+    Uint16 id;
+    Uint32 time;
+    int count;
+    int len;
+    Uint32 received;
+    unsigned char data[DATA_MAX_ENCODED_SIZE];
+};
+
+struct reassembly
+{
+    struct fragment_slot slots[FRAGMENT_SLOTS];
+
+    // messages that never got all their fragments, because they timed out or their slot was needed
+    Uint64 expired;
+};
+
+// how many fragments a message of the given length takes, 1 if it fits the MTU as it is
+int fragment_count(int len, int mtu);
+
+// writes the fragment with the given index into the buffer, and returns its length
+int fragment_write(unsigned char *buffer, Uint16 id, int index, int count, const unsigned char *message, int len);
+
+// takes a received fragment, and returns the length of the message it completes, 0 if it didn't
+// complete one, or -1 if it is malformed
+int reassembly_add(struct reassembly *reassembly, const unsigned char *fragment, int len, Uint32 now, const unsigned char **message);
+
+#endif
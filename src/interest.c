@@ -0,0 +1,122 @@
+#include "interest.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_net.h>
+#include <string.h>
+
+static int clamp(int value, int min, int max)
+{
+    return value < min ? min : value > max ? max : value;
+}
+
+int interest_cell(int x, int y)
+{
+    int column = clamp(x / INTEREST_CELL_SIZE, 0, INTEREST_COLUMNS - 1);
+    int row = clamp(y / INTEREST_CELL_SIZE, 0, INTEREST_ROWS - 1);
+
+    return row * INTEREST_COLUMNS + column;
+}
+
+bool interest_grid_build(struct interest_grid *grid, const struct client_state *states, int count)
+{
+    if (count > grid->capacity)
+    {
+        int *order = SDL_realloc(grid->order, count * sizeof(int));
+        if (!order)
+        {
+            SDLNet_SetError("Couldn't allocate interest grid");
+
+            return false;
+        }
+
+        grid->order = order;
+        grid->capacity = count;
+    }
+
+    // count the states in each cell, then turn the counts into where each cell ends
+    memset(grid->starts, 0, sizeof(grid->starts));
+    for (int i = 0; i < count; i++)
+    {
+        grid->starts[interest_cell(states[i].x, states[i].y)]++;
+    }
+
+    for (int i = 1; i < INTEREST_CELLS; i++)
+    {
+        grid->starts[i] += grid->starts[i - 1];
+    }
+    grid->starts[INTEREST_CELLS] = count;
+
+    // filled from the back, which leaves each start where its cell begins and keeps the states in order
+    for (int i = count - 1; i >= 0; i--)
+    {
+        int cell = interest_cell(states[i].x, states[i].y);
+        grid->order[--grid->starts[cell]] = i;
+    }
+
+    return true;
+}
+
+static int gather_cell(const struct interest_grid *grid,
+                       int cell,
+                       const struct client_state *states,
+                       struct client_state *out,
+                       int count,
+                       int max)
+{
+    for (int i = grid->starts[cell]; i < grid->starts[cell + 1] && count < max; i++)
+    {
+        out[count++] = states[grid->order[i]];
+    }
+
+    return count;
+}
+
+int interest_gather(const struct interest_grid *grid,
+                    int cell,
+                    const struct client_state *states,
+                    struct client_state *out,
+                    int max)
+{
+    int count = gather_cell(grid, cell, states, out, 0, max);
+
+    int column = cell % INTEREST_COLUMNS;
+    int row = cell / INTEREST_COLUMNS;
+    for (int y = SDL_max(row - INTEREST_RADIUS, 0); y <= SDL_min(row + INTEREST_RADIUS, INTEREST_ROWS - 1); y++)
+    {
+        for (int x = SDL_max(column - INTEREST_RADIUS, 0); x <= SDL_min(column + INTEREST_RADIUS, INTEREST_COLUMNS - 1); x++)
+        {
+            int neighbour = y * INTEREST_COLUMNS + x;
+            if (neighbour != cell)
+            {
+                count = gather_cell(grid, neighbour, states, out, count, max);
+            }
+        }
+    }
+
+    return count;
+}
+
+int interest_count(const struct interest_grid *grid, int cell)
+{
+    int count = 0;
+
+    int column = cell % INTEREST_COLUMNS;
+    int row = cell / INTEREST_COLUMNS;
+    for (int y = SDL_max(row - INTEREST_RADIUS, 0); y <= SDL_min(row + INTEREST_RADIUS, INTEREST_ROWS - 1); y++)
+    {
+        for (int x = SDL_max(column - INTEREST_RADIUS, 0); x <= SDL_min(column + INTEREST_RADIUS, INTEREST_COLUMNS - 1); x++)
+        {
+            int neighbour = y * INTEREST_COLUMNS + x;
+            count += grid->starts[neighbour + 1] - grid->starts[neighbour];
+        }
+    }
+
+    return count;
+}
+
+void interest_grid_free(struct interest_grid *grid)
+{
+    SDL_free(grid->order);
+    grid->order = NULL;
+    grid->capacity = 0;
+}
@@ -0,0 +1,46 @@
+#ifndef INTEREST_H
+#define INTEREST_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#include "data.h"
+
+// the world is covered by square cells, and a client only hears about the others in the cells
+// within a radius of its own
+#define INTEREST_CELL_SIZE 100
+#define INTEREST_RADIUS 1
+#define INTEREST_COLUMNS ((WORLD_WIDTH + INTEREST_CELL_SIZE - 1) / INTEREST_CELL_SIZE)
+#define INTEREST_ROWS ((WORLD_HEIGHT + INTEREST_CELL_SIZE - 1) / INTEREST_CELL_SIZE)
+#define INTEREST_CELLS (INTEREST_COLUMNS * INTEREST_ROWS)
+
+// client states bucketed by cell, rebuilt from scratch with a counting sort whenever they have
+// moved, so nothing has to be kept up to date as each one does
+struct interest_grid
+{
+    // where each cell's entries start in the order, the last is the end of the final cell
+    int starts[INTEREST_CELLS + 1];
+
+    // indices of the states, cell by cell
+    int *order;
+    int capacity;
+};
+
+int interest_cell(int x, int y);
+
+bool interest_grid_build(struct interest_grid *grid, const struct client_state *states, int count);
+
+// copies the states around a cell into out, the cell's own first so the nearest are kept when
+// there are more than fit, and returns how many were copied
+int interest_gather(const struct interest_grid *grid,
+                    int cell,
+                    const struct client_state *states,
+                    struct client_state *out,
+                    int max);
+
+// how many states are around a cell, which is more than gathering copies when they don't all fit
+int interest_count(const struct interest_grid *grid, int cell);
+
+void interest_grid_free(struct interest_grid *grid);
+
+#endif
@@ -0,0 +1,809 @@
+#include "io.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_net.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+#define IO_INITIAL_SLOTS 8
+
+// how long to wait for sockets, or for the logic thread to make room for messages, at most
+#define IO_MAX_WAIT 1000
+
+struct io_connection
+{
+    int id;
+    int slot;
+    TCPsocket socket;
+    TCPpacket *packet;
+    TCPqueue *queue;
+    int pending_index;
+    int backlog_index;
+    bool writing;
+};
+
+static bool grow_slots(struct io_thread *io, int slot)
+{
+    int num_slots = io->num_slots ? io->num_slots : IO_INITIAL_SLOTS;
+    while (num_slots <= slot)
+    {
+        num_slots *= 2;
+    }
+
+    struct io_connection **connections = SDL_realloc(io->connections, num_slots * sizeof(struct io_connection *));
+    if (!connections)
+    {
+        SDLNet_SetError("Couldn't allocate connection list");
+        return false;
+    }
+    io->connections = connections;
+
+    // a connection is only ever on each list once, so they never need to be longer than the table
+    struct io_connection **pending = SDL_realloc(io->pending, num_slots * sizeof(struct io_connection *));
+    if (!pending)
+    {
+        SDLNet_SetError("Couldn't allocate connection list");
+        return false;
+    }
+    io->pending = pending;
+
+    struct io_connection **backlogged = SDL_realloc(io->backlogged, num_slots * sizeof(struct io_connection *));
+    if (!backlogged)
+    {
+        SDLNet_SetError("Couldn't allocate connection list");
+        return false;
+    }
+    io->backlogged = backlogged;
+
+    for (int i = io->num_slots; i < num_slots; i++)
+    {
+        io->connections[i] = NULL;
+    }
+    io->num_slots = num_slots;
+
+    return true;
+}
+
+static struct io_connection *find_connection(struct io_thread *io, int id, int slot)
+{
+    if (slot >= io->num_slots || !io->connections[slot] || io->connections[slot]->id != id)
+    {
+        return NULL;
+    }
+
+    return io->connections[slot];
+}
+
+static void mark_pending(struct io_thread *io, struct io_connection *connection)
+{
+    if (connection->pending_index == -1)
+    {
+        connection->pending_index = io->num_pending;
+        io->pending[io->num_pending++] = connection;
+    }
+}
+
+static void remove_pending(struct io_thread *io, struct io_connection *connection)
+{
+    struct io_connection *last = io->pending[--io->num_pending];
+    io->pending[connection->pending_index] = last;
+    last->pending_index = connection->pending_index;
+    connection->pending_index = -1;
+}
+
+static void mark_backlogged(struct io_thread *io, struct io_connection *connection)
+{
+    if (connection->backlog_index == -1)
+    {
+        connection->backlog_index = io->num_backlogged;
+        io->backlogged[io->num_backlogged++] = connection;
+    }
+}
+
+static void remove_backlogged(struct io_thread *io, struct io_connection *connection)
+{
+    struct io_connection *last = io->backlogged[--io->num_backlogged];
+    io->backlogged[connection->backlog_index] = last;
+    last->backlog_index = connection->backlog_index;
+    connection->backlog_index = -1;
+}
+
+static void report_closed(struct io_thread *io, int id)
+{
+    // the logic thread has to hear about every close, so they are kept until there is room to tell it
+    if (io->num_closed == io->closed_capacity)
+    {
+        int capacity = io->closed_capacity ? io->closed_capacity * 2 : IO_INITIAL_SLOTS;
+        int *closed = SDL_realloc(io->closed, capacity * sizeof(int));
+        if (!closed)
+        {
+            log_error("Couldn't allocate closed list");
+            return;
+        }
+        io->closed = closed;
+        io->closed_capacity = capacity;
+    }
+
+    io->closed[io->num_closed++] = id;
+}
+
+static void close_connection(struct io_thread *io, struct io_connection *connection, bool report)
+{
+    if (connection->pending_index != -1)
+    {
+        remove_pending(io, connection);
+    }
+
+    if (connection->backlog_index != -1)
+    {
+        remove_backlogged(io, connection);
+    }
+
+    SDLNet_PollerDel(io->poller, connection->socket);
+    SDLNet_TCP_Close(connection->socket);
+    SDLNet_TCP_FreePacket(connection->packet);
+    SDLNet_TCP_FreeQueue(connection->queue);
+
+    io->connections[connection->slot] = NULL;
+    io->num_connections--;
+
+    if (report)
+    {
+        report_closed(io, connection->id);
+    }
+
+    SDL_free(connection);
+}
+
+static void open_connection(struct io_thread *io, const struct io_command *command)
+{
+    struct io_connection *connection = NULL;
+
+    if (command->slot < io->num_slots || grow_slots(io, command->slot))
+    {
+        connection = SDL_calloc(1, sizeof(struct io_connection));
+        if (!connection)
+        {
+            SDLNet_SetError("Couldn't allocate connection");
+        }
+    }
+
+    // allocate a reassembly buffer for the client's stream and a queue for what we send it
+    if (connection)
+    {
+        connection->packet = SDLNet_TCP_AllocPacket(PACKET_SIZE);
+        connection->queue = SDLNet_TCP_AllocQueue(io->send_queue_size);
+    }
+
+    if (!connection ||
+        !connection->packet ||
+        !connection->queue ||
+        SDLNet_PollerAdd(io->poller, command->socket, connection) == -1)
+    {
+        log_error("%s", SDLNet_GetError());
+
+        if (connection && connection->packet)
+        {
+            SDLNet_TCP_FreePacket(connection->packet);
+        }
+        if (connection && connection->queue)
+        {
+            SDLNet_TCP_FreeQueue(connection->queue);
+        }
+        SDL_free(connection);
+        SDLNet_TCP_Close(command->socket);
+        report_closed(io, command->id);
+        return;
+    }
+
+    connection->id = command->id;
+    connection->slot = command->slot;
+    connection->socket = command->socket;
+    connection->pending_index = -1;
+    connection->backlog_index = -1;
+    connection->writing = false;
+
+    io->connections[command->slot] = connection;
+    io->num_connections++;
+}
+
+static void send_buffer(struct io_thread *io, const struct io_command *command)
+{
+    // the connection may have closed before the logic thread heard about it
+    struct io_connection *connection = find_connection(io, command->id, command->slot);
+    if (!connection)
+    {
+        return;
+    }
+
+    if (SDLNet_TCP_Enqueue(connection->queue, command->buffer) == -1)
+    {
+        SDL_AtomicAdd(&io->overflows, 1);
+
+        if (io->overflow_policy == OVERFLOW_DROP)
+        {
+            log_debug("Dropping %d bytes for slow client %d", command->buffer->len, connection->id);
+            return;
+        }
+
+        log_info("Client %d is not keeping up", connection->id);
+        close_connection(io, connection, true);
+        return;
+    }
+
+    mark_pending(io, connection);
+}
+
+static void handle_commands(struct io_thread *io)
+{
+    struct io_command *command;
+    while ((command = ring_peek(io->commands)))
+    {
+        switch (command->type)
+        {
+        case IO_COMMAND_OPEN:
+        {
+            open_connection(io, command);
+        }
+        break;
+        case IO_COMMAND_SEND:
+        {
+            send_buffer(io, command);
+            SDLNet_TCP_ReleaseBuffer(command->buffer);
+        }
+        break;
+        case IO_COMMAND_CLOSE:
+        {
+            struct io_connection *connection = find_connection(io, command->id, command->slot);
+            if (connection)
+            {
+                close_connection(io, connection, false);
+            }
+        }
+        break;
+        }
+
+        ring_release(io->commands);
+    }
+}
+
+static void read_messages(struct io_thread *io, struct io_connection *connection)
+{
+    // a single read can contain several messages, or only part of one
+    TCPpacket *packet = connection->packet;
+    struct io_event *event;
+    int next = 0;
+    while ((event = ring_reserve(io->events)) && (next = SDLNet_TCP_NextPacket(packet)) == 1)
+    {
+        // the packet is reused by the next message, so the event keeps its bytes
+        event->len = packet->len;
+        memcpy(event->data, packet->data, packet->len);
+        event->type = IO_EVENT_MESSAGE;
+        event->id = connection->id;
+        event->time = SDL_GetPerformanceCounter();
+        ring_commit(io->events);
+        io->notify = true;
+    }
+
+    // the logic thread is behind, the rest stays in the packet until there is room for it
+    if (!event)
+    {
+        mark_backlogged(io, connection);
+        return;
+    }
+
+    if (connection->backlog_index != -1)
+    {
+        remove_backlogged(io, connection);
+    }
+
+    // drop clients that send malformed frames
+    if (next == -1)
+    {
+        log_error("%s", SDLNet_GetError());
+        close_connection(io, connection, true);
+    }
+}
+
+static void read_datagram(struct io_thread *io, UDPpacket *packet)
+{
+    // there is always room, no more were received than could be handed over
+    struct io_event *event = ring_reserve(io->events);
+    event->type = IO_EVENT_DATAGRAM;
+    event->id = 0;
+    event->address = packet->address;
+    event->len = packet->len;
+    memcpy(event->data, packet->data, packet->len);
+    event->time = SDL_GetPerformanceCounter();
+    ring_commit(io->events);
+    io->notify = true;
+}
+
+static void read_datagrams(struct io_thread *io)
+{
+    io->udp_blocked = false;
+
+    for (int batch = 0; batch < UDP_BATCHES_PER_WAKEUP; batch++)
+    {
+        // only receive what there is room to hand over, the rest waits in the socket's buffer
+        int space = ring_space(io->events);
+        int count = SDL_min(space, UDP_MAX_BATCH);
+        if (count == 0)
+        {
+            io->udp_blocked = true;
+            return;
+        }
+
+        int received = SDLNet_UDP_RecvBatch(io->udp_socket, io->udp_packets, count);
+
+        for (int i = 0; i < received; i++)
+        {
+            read_datagram(io, io->udp_packets[i]);
+        }
+
+        if (received > 0)
+        {
+            SDL_AtomicAdd(&io->datagrams, received);
+        }
+
+        if (received < count)
+        {
+            break;
+        }
+    }
+}
+
+static void report_closed_connections(struct io_thread *io)
+{
+    int reported = 0;
+    struct io_event *event;
+    while (reported < io->num_closed && (event = ring_reserve(io->events)))
+    {
+        event->type = IO_EVENT_CLOSED;
+        event->id = io->closed[reported++];
+        event->time = SDL_GetPerformanceCounter();
+        ring_commit(io->events);
+        io->notify = true;
+    }
+
+    io->num_closed -= reported;
+    memmove(io->closed, io->closed + reported, io->num_closed * sizeof(int));
+}
+
+static void flush_connections(struct io_thread *io)
+{
+    int queued_bytes = 0;
+    int max_queued_bytes = 0;
+
+    // removing a connection moves the last pending one into its place
+    int i = 0;
+    while (i < io->num_pending)
+    {
+        struct io_connection *connection = io->pending[i];
+
+        // the most the queue held, before this flush takes from it
+        max_queued_bytes = SDL_max(max_queued_bytes, connection->queue->bytes);
+
+        int sent = SDLNet_TCP_Flush(connection->socket, connection->queue);
+
+        if (sent == -1)
+        {
+            log_error("%s", SDLNet_GetError());
+            close_connection(io, connection, true);
+            continue;
+        }
+
+        SDL_AtomicAdd(&io->bytes_sent, sent);
+
+        // only ask to be woken for writability while there is something left to write
+        bool writing = connection->queue->bytes > 0;
+        if (writing != connection->writing)
+        {
+            SDLNet_PollerWatchWrite(io->poller, connection->socket, writing);
+            connection->writing = writing;
+        }
+
+        if (!writing)
+        {
+            remove_pending(io, connection);
+            continue;
+        }
+
+        queued_bytes += connection->queue->bytes;
+        i++;
+    }
+
+    // only connections with something queued are pending, so the gauges cost nothing while clients keep up
+    SDL_AtomicSet(&io->queued_bytes, queued_bytes);
+    if (max_queued_bytes > SDL_AtomicGet(&io->max_queued_bytes))
+    {
+        SDL_AtomicSet(&io->max_queued_bytes, max_queued_bytes);
+    }
+}
+
+static void wait_for_room(struct io_thread *io)
+{
+    // room made between the last look and the flag being set would have no one to tell, so look again
+    SDL_AtomicSet(&io->blocked, 1);
+    if (ring_space(io->events) == 0 && SDLNet_PollerWait(io->wakeup_poller, IO_MAX_WAIT) == -1)
+    {
+        log_error("%s", SDLNet_GetError());
+    }
+    SDL_AtomicSet(&io->blocked, 0);
+}
+
+static int io_main(void *data)
+{
+    struct io_thread *io = data;
+
+    while (!SDL_AtomicGet(&io->quit))
+    {
+        // while the logic thread has no room for more messages there is no point reading any, only
+        // commands and the logic thread making room wake the thread
+        int ready = 0;
+        if (io->num_backlogged > 0 || io->udp_blocked)
+        {
+            wait_for_room(io);
+        }
+        else if ((ready = SDLNet_PollerWait(io->poller, IO_MAX_WAIT)) == -1)
+        {
+            log_error("%s", SDLNet_GetError());
+            ready = 0;
+        }
+
+        SDLNet_ClearWakeup(io->wakeup);
+
+        handle_commands(io);
+
+        // finish messages left over from before, removing one moves the last into its place
+        for (int i = io->num_backlogged - 1; i >= 0; i--)
+        {
+            read_messages(io, io->backlogged[i]);
+        }
+
+        for (int i = 0; i < ready; i++)
+        {
+            // the wakeup and UDP sockets have no connection, and wakeups for writability are handled by the flush
+            struct io_connection *connection = SDLNet_PollerReady(io->poller, i);
+            if (!connection || !SDLNet_SocketReady(connection->socket) || connection->backlog_index != -1)
+            {
+                continue;
+            }
+
+            if (SDLNet_TCP_RecvExt(connection->socket, connection->packet) <= 0)
+            {
+                close_connection(io, connection, true);
+                continue;
+            }
+
+            read_messages(io, connection);
+        }
+
+        // datagrams on this thread's share of the UDP port, retried without waiting while they don't fit
+        if (io->udp_socket && (io->udp_blocked || SDLNet_SocketReady(io->udp_socket)))
+        {
+            read_datagrams(io);
+        }
+
+        report_closed_connections(io);
+
+        // write out everything queued during this iteration
+        flush_connections(io);
+
+        if (io->notify)
+        {
+            io->notify = false;
+            SDLNet_Wake(io->logic_wakeup);
+        }
+    }
+
+    return 0;
+}
+
+static void free_io(struct io_thread *io)
+{
+    if (io->poller)
+    {
+        if (io->wakeup)
+        {
+            SDLNet_PollerDel(io->poller, io->wakeup->socket);
+        }
+        if (io->udp_socket)
+        {
+            SDLNet_PollerDel(io->poller, io->udp_socket);
+        }
+        SDLNet_FreePoller(io->poller);
+    }
+    if (io->wakeup_poller)
+    {
+        if (io->wakeup)
+        {
+            SDLNet_PollerDel(io->wakeup_poller, io->wakeup->socket);
+        }
+        SDLNet_FreePoller(io->wakeup_poller);
+    }
+    if (io->udp_packets)
+    {
+        SDLNet_FreePacketV(io->udp_packets);
+    }
+    if (io->wakeup)
+    {
+        SDLNet_FreeWakeup(io->wakeup);
+    }
+    if (io->commands)
+    {
+        ring_free(io->commands);
+    }
+    SDL_free(io->deferred);
+    SDL_free(io->deferred_bytes);
+    if (io->events)
+    {
+        ring_free(io->events);
+    }
+
+    SDL_free(io->connections);
+    SDL_free(io->pending);
+    SDL_free(io->backlogged);
+    SDL_free(io->closed);
+    SDL_free(io);
+}
+
+struct io_thread *io_start(int index,
+                           int send_queue_size,
+                           enum overflow_policy overflow_policy,
+                           SDLNet_Wakeup *logic_wakeup,
+                           UDPsocket udp_socket)
+{
+    struct io_thread *io = SDL_calloc(1, sizeof(struct io_thread));
+
+    if (!io)
+    {
+        SDLNet_SetError("Couldn't allocate I/O thread");
+
+        return NULL;
+    }
+
+    io->index = index;
+    io->send_queue_size = send_queue_size;
+    io->overflow_policy = overflow_policy;
+    io->logic_wakeup = logic_wakeup;
+    io->udp_socket = udp_socket;
+
+    io->events = ring_alloc(IO_EVENT_QUEUE, sizeof(struct io_event));
+    io->commands = ring_alloc(IO_COMMAND_QUEUE, sizeof(struct io_command));
+    io->wakeup = SDLNet_AllocWakeup();
+    io->poller = SDLNet_AllocPoller();
+    io->wakeup_poller = SDLNet_AllocPoller();
+
+    if (!io->events ||
+        !io->commands ||
+        !io->wakeup ||
+        !io->poller ||
+        !io->wakeup_poller ||
+        !grow_slots(io, 0) ||
+        SDLNet_PollerAdd(io->poller, io->wakeup->socket, NULL) == -1 ||
+        SDLNet_PollerAdd(io->wakeup_poller, io->wakeup->socket, NULL) == -1)
+    {
+        free_io(io);
+
+        return NULL;
+    }
+
+    // the socket itself stays the caller's, it is only read here
+    if (udp_socket &&
+        (!(io->udp_packets = SDLNet_AllocPacketV(UDP_MAX_BATCH, PACKET_SIZE)) ||
+         SDLNet_PollerAdd(io->poller, udp_socket, NULL) == -1))
+    {
+        free_io(io);
+
+        return NULL;
+    }
+
+    char name[16];
+    snprintf(name, sizeof(name), "io%d", index);
+
+    io->thread = SDL_CreateThread(io_main, name, io);
+
+    if (!io->thread)
+    {
+        SDLNet_SetError("%s", SDL_GetError());
+
+        free_io(io);
+
+        return NULL;
+    }
+
+    return io;
+}
+
+static bool reserve_deferred(struct io_thread *io, int count)
+{
+    // always room for a close for every connection opened, so closing never fails
+    int needed = io->num_deferred - io->deferred_head + io->num_opened + count;
+    if (needed <= io->deferred_capacity)
+    {
+        return true;
+    }
+
+    int capacity = SDL_max(io->deferred_capacity * 2, needed);
+    struct io_command *deferred = SDL_realloc(io->deferred, capacity * sizeof(struct io_command));
+    if (!deferred)
+    {
+        SDLNet_SetError("Couldn't allocate command list");
+        return false;
+    }
+
+    io->deferred = deferred;
+    io->deferred_capacity = capacity;
+
+    return true;
+}
+
+static void defer_command(struct io_thread *io, const struct io_command *command)
+{
+    // the room is reserved, but may be in front of the commands already pushed
+    if (io->num_deferred == io->deferred_capacity)
+    {
+        io->num_deferred -= io->deferred_head;
+        memmove(io->deferred, io->deferred + io->deferred_head, io->num_deferred * sizeof(struct io_command));
+        io->deferred_head = 0;
+    }
+
+    io->deferred[io->num_deferred++] = *command;
+}
+
+static bool push_deferred(struct io_thread *io)
+{
+    // in order, so a connection is never written to before it is opened or after it is closed
+    while (io->deferred_head < io->num_deferred)
+    {
+        // the I/O thread can release a buffer as soon as it is pushed, so its length is read first
+        struct io_command *command = &io->deferred[io->deferred_head];
+        int len = command->type == IO_COMMAND_SEND ? command->buffer->len : 0;
+        if (!ring_push(io->commands, command))
+        {
+            return false;
+        }
+
+        io->deferred_bytes[command->slot] -= len;
+        io->deferred_head++;
+        io->commanded = true;
+    }
+
+    io->deferred_head = 0;
+    io->num_deferred = 0;
+
+    return true;
+}
+
+static void push_command(struct io_thread *io, const struct io_command *command)
+{
+    if (!push_deferred(io) || !ring_push(io->commands, command))
+    {
+        defer_command(io, command);
+        return;
+    }
+
+    io->commanded = true;
+}
+
+bool io_open(struct io_thread *io, int id, int slot, TCPsocket socket)
+{
+    if (slot >= io->num_deferred_slots)
+    {
+        int num_slots = io->num_deferred_slots ? io->num_deferred_slots : IO_INITIAL_SLOTS;
+        while (num_slots <= slot)
+        {
+            num_slots *= 2;
+        }
+
+        int *deferred_bytes = SDL_realloc(io->deferred_bytes, num_slots * sizeof(int));
+        if (!deferred_bytes)
+        {
+            SDLNet_SetError("Couldn't allocate command list");
+            return false;
+        }
+
+        for (int i = io->num_deferred_slots; i < num_slots; i++)
+        {
+            deferred_bytes[i] = 0;
+        }
+        io->deferred_bytes = deferred_bytes;
+        io->num_deferred_slots = num_slots;
+    }
+
+    // the open and the close that ends it
+    if (!reserve_deferred(io, 2))
+    {
+        return false;
+    }
+    io->num_opened++;
+
+    struct io_command command = {IO_COMMAND_OPEN, id, slot, socket, NULL};
+    push_command(io, &command);
+
+    return true;
+}
+
+bool io_send(struct io_thread *io, int id, int slot, TCPbuffer *buffer)
+{
+    // the I/O thread releases the reference once the buffer is queued
+    SDLNet_TCP_RetainBuffer(buffer);
+
+    struct io_command command = {IO_COMMAND_SEND, id, slot, NULL, buffer};
+    if (push_deferred(io) && ring_push(io->commands, &command))
+    {
+        io->commanded = true;
+        return true;
+    }
+
+    // the logic thread never waits for the I/O thread to make room, up to a send queue's worth is kept
+    // for each connection until it has, more than that is the client's overflow
+    if (io->deferred_bytes[slot] + buffer->len > io->send_queue_size || !reserve_deferred(io, 1))
+    {
+        SDLNet_TCP_ReleaseBuffer(buffer);
+        return false;
+    }
+
+    defer_command(io, &command);
+    io->deferred_bytes[slot] += buffer->len;
+
+    return true;
+}
+
+void io_close(struct io_thread *io, int id, int slot)
+{
+    io->num_opened--;
+
+    struct io_command command = {IO_COMMAND_CLOSE, id, slot, NULL, NULL};
+    push_command(io, &command);
+}
+
+void io_flush(struct io_thread *io)
+{
+    push_deferred(io);
+
+    // one wakeup for everything pushed since the last one
+    if (io->commanded)
+    {
+        io->commanded = false;
+        SDLNet_Wake(io->wakeup);
+    }
+}
+
+void io_drained(struct io_thread *io)
+{
+    // only the one that clears the flag wakes the thread, and only while it waits
+    if (SDL_AtomicCAS(&io->blocked, 1, 0))
+    {
+        SDLNet_Wake(io->wakeup);
+    }
+}
+
+void io_stop(struct io_thread *io)
+{
+    SDL_AtomicSet(&io->quit, 1);
+    SDLNet_Wake(io->wakeup);
+    SDL_WaitThread(io->thread, NULL);
+
+    // the thread is gone, so whatever was still on its way to it is cleaned up here
+    handle_commands(io);
+    while (io->num_deferred > io->deferred_head)
+    {
+        push_deferred(io);
+        handle_commands(io);
+    }
+
+    for (int slot = 0; slot < io->num_slots; slot++)
+    {
+        if (io->connections[slot])
+        {
+            close_connection(io, io->connections[slot], false);
+        }
+    }
+
+    free_io(io);
+}
@@ -0,0 +1,147 @@
+#ifndef IO_H
+#define IO_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_net.h>
+#include <stdbool.h>
+
+#include "data.h"
+#include "ring.h"
+#include "SDL_net_ext.h"
+
+#define IO_MAX_THREADS 16
+
+// messages for the logic thread, and commands from it, that can be in flight per I/O thread
+#define IO_EVENT_QUEUE 512
+#define IO_COMMAND_QUEUE 8192
+
+// limits how long a flood of datagrams can keep a thread from servicing anything else
+#define UDP_BATCHES_PER_WAKEUP 16
+
+// what to do with a client whose send queue is full
+enum overflow_policy
+{
+    OVERFLOW_DISCONNECT,
+    OVERFLOW_DROP
+};
+
+enum io_event_type
+{
+    IO_EVENT_MESSAGE,
+    IO_EVENT_CLOSED,
+    IO_EVENT_DATAGRAM
+};
+
+// from an I/O thread to the logic thread
+struct io_event
+{
+    enum io_event_type type;
+    int id;
+
+    // the performance counter when it was handed over, to measure how long it waited
+    Uint64 time;
+
+    // where a datagram came from, and the bytes of the message, or of the whole datagram, which the
+    // logic thread decodes, so an event is no larger than the bytes it carries
+    IPaddress address;
+    int len;
+    Uint8 data[PACKET_SIZE];
+};
+
+enum io_command_type
+{
+    IO_COMMAND_OPEN,
+    IO_COMMAND_SEND,
+    IO_COMMAND_CLOSE
+};
+
+// from the logic thread to an I/O thread, connections are looked up by the slot of the client ID
+struct io_command
+{
+    enum io_command_type type;
+    int id;
+    int slot;
+    TCPsocket socket;
+    TCPbuffer *buffer;
+};
+
+struct io_connection;
+
+// a thread that owns a share of the TCP connections and optionally of the UDP port, it reads and
+// frames their messages for the logic thread and writes out what the logic thread sends them,
+// so the client table is only ever touched by the logic thread
+struct io_thread
+{
+    int index;
+    SDL_Thread *thread;
+    SDL_atomic_t quit;
+
+    struct ring *events;
+    struct ring *commands;
+    SDLNet_Wakeup *wakeup;
+    SDLNet_Wakeup *logic_wakeup;
+
+    // only used by the logic thread, whether there are commands the I/O thread hasn't been woken for,
+    // and the commands waiting in order for room in the ring, with the bytes each slot has waiting
+    bool commanded;
+    struct io_command *deferred;
+    int deferred_head;
+    int num_deferred;
+    int deferred_capacity;
+    int num_opened;
+    int *deferred_bytes;
+    int num_deferred_slots;
+
+    // set by the I/O thread while it has stopped reading until there is room for events, for the
+    // logic thread to wake it once it has taken some
+    SDL_atomic_t blocked;
+
+    // only used by the I/O thread, the second poller only watches the wakeup
+    SDLNet_Poller poller;
+    SDLNet_Poller wakeup_poller;
+    int send_queue_size;
+    enum overflow_policy overflow_policy;
+    UDPsocket udp_socket;
+    UDPpacket **udp_packets;
+    bool udp_blocked;
+    struct io_connection **connections;
+    int num_slots;
+    int num_connections;
+    struct io_connection **pending;
+    int num_pending;
+    struct io_connection **backlogged;
+    int num_backlogged;
+    int *closed;
+    int num_closed;
+    int closed_capacity;
+    bool notify;
+
+    SDL_atomic_t bytes_sent;
+    SDL_atomic_t datagrams;
+    SDL_atomic_t overflows;
+
+    // what is waiting in the send queues after each flush, and the most any one queue held since
+    // the logic thread last took it
+    SDL_atomic_t queued_bytes;
+    SDL_atomic_t max_queued_bytes;
+};
+
+struct io_thread *io_start(int index,
+                           int send_queue_size,
+                           enum overflow_policy overflow_policy,
+                           SDLNet_Wakeup *logic_wakeup,
+                           UDPsocket udp_socket);
+
+// never wait for the I/O thread, commands it has no room for are kept until a later flush, a send
+// returns false once a send queue's worth is kept for the connection and is left to the overflow
+// policy, and an open only fails if there is no memory to keep it
+bool io_open(struct io_thread *io, int id, int slot, TCPsocket socket);
+bool io_send(struct io_thread *io, int id, int slot, TCPbuffer *buffer);
+void io_close(struct io_thread *io, int id, int slot);
+void io_flush(struct io_thread *io);
+void io_stop(struct io_thread *io);
+
+// called by the logic thread after taking events, to wake the I/O thread if it is waiting for room
+void io_drained(struct io_thread *io);
+
+#endif
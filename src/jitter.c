@@ -0,0 +1,211 @@
+#include "jitter.h"
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <string.h>
+
+void clock_sync_init(struct clock_sync *clock_sync)
+{
+    memset(clock_sync, 0, sizeof(*clock_sync));
+}
+
+void clock_sync_sample(struct clock_sync *clock_sync, Uint32 client_time, Uint32 server_time, Uint32 now)
+{
+    // the server's clock was read about halfway through the round trip
+    Uint32 rtt = now - client_time;
+    Sint32 offset = (Sint32)(server_time + rtt / 2 - now);
+
+    struct clock_sample *sample = &clock_sync->samples[clock_sync->next_sample];
+    sample->rtt = rtt;
+    sample->offset = offset;
+    clock_sync->next_sample = (clock_sync->next_sample + 1) % CLOCK_SAMPLES;
+    if (clock_sync->num_samples < CLOCK_SAMPLES)
+    {
+        clock_sync->num_samples++;
+    }
+
+    const struct clock_sample *best = &clock_sync->samples[0];
+    for (int i = 1; i < clock_sync->num_samples; i++)
+    {
+        if (clock_sync->samples[i].rtt < best->rtt)
+        {
+            best = &clock_sync->samples[i];
+        }
+    }
+
+    clock_sync->offset = best->offset;
+    clock_sync->rtt = clock_sync->synced ? (7 * clock_sync->rtt + rtt) / 8 : rtt;
+
+    if (!clock_sync->synced)
+    {
+        clock_sync->synced = true;
+        clock_sync->first_offset = offset;
+        clock_sync->first_time = now;
+    }
+}
+
+Uint32 clock_sync_server_time(const struct clock_sync *clock_sync, Uint32 now)
+{
+    return now + (Uint32)clock_sync->offset;
+}
+
+float clock_sync_drift(const struct clock_sync *clock_sync, Uint32 now)
+{
+    // in milliseconds per minute, once there has been long enough to tell
+    Uint32 elapsed = now - clock_sync->first_time;
+    if (!clock_sync->synced || elapsed < 1000)
+    {
+        return 0.0f;
+    }
+
+    return (float)(clock_sync->offset - clock_sync->first_offset) * 60000.0f / (float)elapsed;
+}
+
+void jitter_buffer_init(struct jitter_buffer *jitter_buffer)
+{
+    memset(jitter_buffer, 0, sizeof(*jitter_buffer));
+}
+
+const struct snapshot_data *jitter_buffer_find(const struct jitter_buffer *jitter_buffer, unsigned int sequence)
+{
+    // sequence 0 is never sent, so it marks an empty entry
+    const struct snapshot_data *snapshot = &jitter_buffer->snapshots[sequence % SNAPSHOT_HISTORY];
+    if (sequence == 0 || snapshot->sequence != sequence)
+    {
+        return NULL;
+    }
+
+    return snapshot;
+}
+
+bool jitter_buffer_add(struct jitter_buffer *jitter_buffer, const struct snapshot_data *snapshot, Uint32 now)
+{
+    jitter_buffer->snapshots[snapshot->sequence % SNAPSHOT_HISTORY] = *snapshot;
+
+    // the clock offset is part of every transit time, so it cancels out of the differences
+    Sint32 transit = (Sint32)(now - snapshot->time);
+    if (jitter_buffer->has_transit)
+    {
+        Sint32 difference = abs(transit - jitter_buffer->transit);
+        jitter_buffer->jitter += ((float)difference - jitter_buffer->jitter) / 16.0f;
+    }
+    jitter_buffer->transit = transit;
+    jitter_buffer->has_transit = true;
+
+    // datagrams can arrive out of order
+    if (jitter_buffer->newest == 0 || (int)(snapshot->sequence - jitter_buffer->newest) > 0)
+    {
+        jitter_buffer->newest = snapshot->sequence;
+        return true;
+    }
+
+    return false;
+}
+
+static int lerp(int from, int to, float t)
+{
+    return from + (int)SDL_floorf((float)(to - from) * t + 0.5f);
+}
+
+static void blend(struct snapshot_data *snapshot, const struct snapshot_data *from, const struct snapshot_data *to, float t)
+{
+    // clients that joined since the earlier snapshot appear at their first known position
+    snapshot->num_clients = 0;
+    for (int i = 0; i < to->num_clients; i++)
+    {
+        struct client_state state = to->clients[i];
+
+        for (int j = 0; j < from->num_clients; j++)
+        {
+            if (from->clients[j].id == state.id)
+            {
+                int x = lerp(from->clients[j].x, to->clients[i].x, t);
+                int y = lerp(from->clients[j].y, to->clients[i].y, t);
+                state.x = SDL_max(0, SDL_min(x, WORLD_WIDTH - 1));
+                state.y = SDL_max(0, SDL_min(y, WORLD_HEIGHT - 1));
+                state.buttons = t < 1.0f ? from->clients[j].buttons : to->clients[i].buttons;
+                break;
+            }
+        }
+
+        snapshot->clients[snapshot->num_clients++] = state;
+    }
+}
+
+void jitter_buffer_sample(struct jitter_buffer *jitter_buffer, Uint32 render_time, struct snapshot_data *snapshot)
+{
+    *snapshot = snapshot_data_create(DATA_SNAPSHOT, 0, render_time);
+
+    // walk back from the newest snapshot to the pair around the render time
+    const struct snapshot_data *from = NULL;
+    const struct snapshot_data *to = NULL;
+    for (unsigned int i = 0; i < SNAPSHOT_HISTORY; i++)
+    {
+        const struct snapshot_data *found = jitter_buffer_find(jitter_buffer, jitter_buffer->newest - i);
+        if (!found)
+        {
+            continue;
+        }
+
+        if ((Sint32)(found->time - render_time) <= 0)
+        {
+            from = found;
+            break;
+        }
+
+        to = found;
+    }
+
+    if (!from)
+    {
+        // everything buffered is still in the future, show the oldest until time catches up
+        if (to)
+        {
+            blend(snapshot, to, to, 1.0f);
+            jitter_buffer->held++;
+        }
+        return;
+    }
+
+    if (to)
+    {
+        Uint32 span = to->time - from->time;
+        blend(snapshot, from, to, span ? (float)(render_time - from->time) / (float)span : 1.0f);
+        jitter_buffer->interpolated++;
+        return;
+    }
+
+    // snapshots have stopped arriving, continue along the last known motion for a short while
+    const struct snapshot_data *previous = NULL;
+    for (unsigned int i = 1; i < SNAPSHOT_HISTORY && !previous; i++)
+    {
+        previous = jitter_buffer_find(jitter_buffer, from->sequence - i);
+    }
+
+    Uint32 ahead = SDL_min(render_time - from->time, (Uint32)JITTER_MAX_EXTRAPOLATION);
+    if (!previous || previous->time == from->time)
+    {
+        blend(snapshot, from, from, 1.0f);
+        jitter_buffer->held++;
+        return;
+    }
+
+    blend(snapshot, previous, from, 1.0f + (float)ahead / (float)(from->time - previous->time));
+    jitter_buffer->extrapolated++;
+}
+
+int jitter_buffer_depth(const struct jitter_buffer *jitter_buffer, Uint32 render_time)
+{
+    // how many snapshots have arrived that are not being shown yet
+    int depth = 0;
+    for (unsigned int i = 0; i < SNAPSHOT_HISTORY; i++)
+    {
+        const struct snapshot_data *found = jitter_buffer_find(jitter_buffer, jitter_buffer->newest - i);
+        if (found && (Sint32)(found->time - render_time) > 0)
+        {
+            depth++;
+        }
+    }
+
+    return depth;
+}
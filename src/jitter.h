@@ -0,0 +1,67 @@
+#ifndef JITTER_H
+#define JITTER_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#include "data.h"
+
+// how many recent pings the clock offset is chosen from
+#define CLOCK_SAMPLES 8
+
+// how far past the newest snapshot positions are extrapolated before they are held, in milliseconds
+#define JITTER_MAX_EXTRAPOLATION 250
+
+struct clock_sample
+{
+    Uint32 rtt;
+    Sint32 offset;
+};
+
+// estimates the server's clock from ping round trips, trusting the sample with the shortest
+// round trip since it had the least room for queueing delay on one side only
+struct clock_sync
+{
+    struct clock_sample samples[CLOCK_SAMPLES];
+    int num_samples;
+    int next_sample;
+
+    bool synced;
+    Sint32 offset;
+    Uint32 rtt;
+
+    // where the offset started, so drift between the clocks can be reported
+    Sint32 first_offset;
+    Uint32 first_time;
+};
+
+// snapshots kept by sequence, so deltas can be applied against them and positions can be
+// interpolated between them some time behind the newest
+struct jitter_buffer
+{
+    struct snapshot_data snapshots[SNAPSHOT_HISTORY];
+    unsigned int newest;
+
+    // variation in transit time of snapshots, smoothed as in RFC 3550
+    bool has_transit;
+    Sint32 transit;
+    float jitter;
+
+    // statistics of how rendered frames were produced
+    Uint64 interpolated;
+    Uint64 extrapolated;
+    Uint64 held;
+};
+
+void clock_sync_init(struct clock_sync *clock_sync);
+void clock_sync_sample(struct clock_sync *clock_sync, Uint32 client_time, Uint32 server_time, Uint32 now);
+Uint32 clock_sync_server_time(const struct clock_sync *clock_sync, Uint32 now);
+float clock_sync_drift(const struct clock_sync *clock_sync, Uint32 now);
+
+void jitter_buffer_init(struct jitter_buffer *jitter_buffer);
+const struct snapshot_data *jitter_buffer_find(const struct jitter_buffer *jitter_buffer, unsigned int sequence);
+bool jitter_buffer_add(struct jitter_buffer *jitter_buffer, const struct snapshot_data *snapshot, Uint32 now);
+void jitter_buffer_sample(struct jitter_buffer *jitter_buffer, Uint32 render_time, struct snapshot_data *snapshot);
+int jitter_buffer_depth(const struct jitter_buffer *jitter_buffer, Uint32 render_time);
+
+#endif
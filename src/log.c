@@ -0,0 +1,69 @@
+#include "log.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// the longest line written, including the prefix and the newline
+#define LOG_LINE_SIZE 1024
+
+int log_level = LOG_COMPILE_LEVEL;
+
+static const char *level_names[] = {
+    "none",
+    "error",
+    "warn",
+    "info",
+    "debug",
+    "trace"};
+
+int log_parse_level(const char *name)
+{
+    for (int i = LOG_LEVEL_NONE; i <= LOG_LEVEL_TRACE; i++)
+    {
+        if (strcmp(name, level_names[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void log_write(int level, const char *format, ...)
+{
+    // the whole line goes out in one write, so lines logged from several threads don't interleave
+    char line[LOG_LINE_SIZE];
+    int len = 0;
+
+    switch (level)
+    {
+    case LOG_LEVEL_ERROR:
+    {
+        len = snprintf(line, sizeof(line), "Error: ");
+    }
+    break;
+    case LOG_LEVEL_WARN:
+    {
+        len = snprintf(line, sizeof(line), "Warning: ");
+    }
+    break;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(line + len, sizeof(line) - len, format, args);
+    va_end(args);
+
+    // a longer message is cut short, leaving room for the newline
+    if (written > 0)
+    {
+        len += written;
+    }
+    if (len > (int)sizeof(line) - 1)
+    {
+        len = (int)sizeof(line) - 1;
+    }
+    line[len++] = '\n';
+
+    fwrite(line, 1, len, stdout);
+}
@@ -0,0 +1,57 @@
+#ifndef LOG_H
+#define LOG_H
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
+
+// messages above this level are removed by the preprocessor, e.g. build with -DLOG_COMPILE_LEVEL=5 for per-packet tracing
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+
+// messages above this level are skipped at runtime without evaluating their arguments
+extern int log_level;
+
+int log_parse_level(const char *name);
+void log_write(int level, const char *format, ...);
+
+#define LOG_WRITE(level, ...) ((level) <= log_level ? log_write((level), __VA_ARGS__) : (void)0)
+
+// sizeof does not evaluate its operand, so disabled messages cost nothing but still count as using their arguments
+#define LOG_DISCARD(...) ((void)sizeof(log_write(LOG_LEVEL_NONE, __VA_ARGS__), 0))
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_ERROR
+#define log_error(...) LOG_WRITE(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define log_error(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_WARN
+#define log_warn(...) LOG_WRITE(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define log_warn(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_INFO
+#define log_info(...) LOG_WRITE(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define log_info(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_DEBUG
+#define log_debug(...) LOG_WRITE(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define log_debug(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_TRACE
+#define log_trace(...) LOG_WRITE(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define log_trace(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+#include "loop.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_net.h>
+
+#include "log.h"
+
+void loop_init(struct loop *loop, Uint32 max_wait)
+{
+    loop->max_wait = max_wait;
+    loop->frequency = SDL_GetPerformanceFrequency();
+    loop->deadline = 0;
+    loop->wakeups = 0;
+    loop->timeouts = 0;
+    loop->timer_fires = 0;
+    loop->latency_total = 0;
+    loop->latency_max = 0;
+}
+
+int loop_wait(struct loop *loop, SDLNet_Poller poller)
+{
+    Uint32 timeout = loop->max_wait;
+
+    // wake up no later than the earliest timer, rounding up so the timer is due when we return
+    if (loop->deadline)
+    {
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (loop->deadline <= now)
+        {
+            timeout = 0;
+        }
+        else
+        {
+            Uint64 ms = ((loop->deadline - now) * 1000 + loop->frequency - 1) / loop->frequency;
+            if (ms < timeout)
+            {
+                timeout = (Uint32)ms;
+            }
+        }
+    }
+
+    // timers reschedule themselves every time they are checked
+    loop->deadline = 0;
+
+    int ready = SDLNet_PollerWait(poller, timeout);
+
+    loop->wakeups++;
+    if (ready <= 0)
+    {
+        loop->timeouts++;
+    }
+
+    return ready;
+}
+
+void loop_report(struct loop *loop)
+{
+    double average = loop->timer_fires ? (double)loop->latency_total / loop->timer_fires : 0;
+
+    log_info("Loop: %llu wakeups (%llu timeouts), timer latency avg %.3f ms, max %.3f ms",
+             (unsigned long long)loop->wakeups,
+             (unsigned long long)loop->timeouts,
+             average * 1000 / loop->frequency,
+             (double)loop->latency_max * 1000 / loop->frequency);
+
+    loop->wakeups = 0;
+    loop->timeouts = 0;
+    loop->timer_fires = 0;
+    loop->latency_total = 0;
+    loop->latency_max = 0;
+}
+
+void timer_init(struct loop *loop, struct timer *timer, Uint32 interval)
+{
+    timer->interval = interval * loop->frequency / 1000;
+    timer->next = SDL_GetPerformanceCounter() + timer->interval;
+}
+
+bool timer_update(struct loop *loop, struct timer *timer)
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+    bool fired = false;
+
+    if (now >= timer->next)
+    {
+        // record how late the timer is being serviced
+        Uint64 latency = now - timer->next;
+        loop->timer_fires++;
+        loop->latency_total += latency;
+        if (latency > loop->latency_max)
+        {
+            loop->latency_max = latency;
+        }
+
+        // skip missed intervals instead of firing repeatedly to catch up
+        timer->next += timer->interval;
+        if (timer->next <= now)
+        {
+            timer->next = now + timer->interval;
+        }
+
+        fired = true;
+    }
+
+    if (!loop->deadline || timer->next < loop->deadline)
+    {
+        loop->deadline = timer->next;
+    }
+
+    return fired;
+}
@@ -0,0 +1,41 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_net.h>
+#include <stdbool.h>
+
+#include "SDL_net_ext.h"
+
+#define LOOP_DEFAULT_MAX_WAIT 1000
+
+// a periodic deadline checked by the main loop
+struct timer
+{
+    Uint64 interval;
+    Uint64 next;
+};
+
+// blocks on a poller until a socket is readable or the earliest scheduled timer is due
+struct loop
+{
+    Uint32 max_wait;
+    Uint64 frequency;
+    Uint64 deadline;
+
+    // statistics used to check that blocking does not delay timers
+    Uint64 wakeups;
+    Uint64 timeouts;
+    Uint64 timer_fires;
+    Uint64 latency_total;
+    Uint64 latency_max;
+};
+
+void loop_init(struct loop *loop, Uint32 max_wait);
+int loop_wait(struct loop *loop, SDLNet_Poller poller);
+void loop_report(struct loop *loop);
+
+void timer_init(struct loop *loop, struct timer *timer, Uint32 interval);
+bool timer_update(struct loop *loop, struct timer *timer);
+
+#endif
@@ -2,11 +2,28 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "bench.h"
 #include "client.h"
+#include "log.h"
 #include "server.h"
 
 int main(int argc, char *argv[])
 {
+    // global options apply regardless of where they appear
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--log-level") == 0) && i + 1 < argc)
+        {
+            int level = log_parse_level(argv[++i]);
+            if (level == -1)
+            {
+                log_error("Unknown log level %s", argv[i]);
+                return 1;
+            }
+            log_level = level;
+        }
+    }
+
     for (int i = 1; i < argc; i++)
     {
         if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
@@ -15,6 +32,26 @@ int main(int argc, char *argv[])
             printf("  -h, --help\tPrint this message\n");
             printf("  -c, --client\tRun as client\n");
             printf("  -s, --server\tRun as server\n");
+            printf("  -u, --udp\tConnect over the UDP port only, with a reliable channel instead of TCP\n");
+            printf("  -d, --interp-delay <ms>\tHow far behind the server's clock other clients are drawn\n");
+            printf("  -w, --max-wait <ms>\tLongest time to block waiting for network events\n");
+            printf("  -m, --max-clients <n>\tLimit the number of connected clients\n");
+            printf("  -t, --tick-rate <hz>\tHow often the server simulates and sends snapshots\n");
+            printf("  -q, --send-queue <bytes>\tLimit the output queued for each client\n");
+            printf("  -i, --io-threads <n>\tThreads that read and write the server's TCP connections\n");
+            printf("  -r, --reuse-port\tGive each I/O thread its own socket on the UDP port (Linux only)\n");
+            printf("  --slow-clients <policy>\tdisconnect or drop when a client's queue is full\n");
+            printf("  --metrics-port <port>\tServe metrics as plain text over HTTP on this port\n");
+            printf("  --metrics-address <host>\tListen for metrics scrapes on this address, 127.0.0.1 by default, 0.0.0.0 for every interface\n");
+            printf("  --mtu <bytes>\tLargest datagram that unreliable messages are packed into, larger ones are fragmented\n");
+            printf("  --compress-threshold <bytes>\tCompress reliable messages at least this long for clients that can take it, 0 to never\n");
+            printf("  --no-compress\tDon't ask the server to compress anything\n");
+            printf("  -b, --bench\tSimulate many clients against the server, without a window\n");
+            printf("  -n, --connections <n>\tHow many clients the benchmark simulates\n");
+            printf("  --chat-rate <hz>\tChat messages each simulated client sends per second\n");
+            printf("  --mouse-rate <hz>\tMouse clicks each simulated client sends per second\n");
+            printf("  --duration <s>\tHow long the benchmark runs\n");
+            printf("  -l, --log-level <level>\tOne of none, error, warn, info, debug or trace\n");
         }
         if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--client") == 0)
         {
@@ -24,6 +61,10 @@ int main(int argc, char *argv[])
         {
             return server_main(argc, argv);
         }
+        if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--bench") == 0)
+        {
+            return bench_main(argc, argv);
+        }
     }
 
     return 0;
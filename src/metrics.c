@@ -0,0 +1,359 @@
+#include "metrics.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_net.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+
+// the whole response is formatted at once, it has a line per counter and message type
+#define METRICS_BUFFER_SIZE 16384
+#define METRICS_REQUEST_SIZE 1024
+
+#define METRICS_HEADER "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n"
+
+struct text
+{
+    char *buffer;
+    int size;
+    int len;
+};
+
+static int histogram_bucket(Uint32 value)
+{
+    if (value < HISTOGRAM_STEPS)
+    {
+        return (int)value;
+    }
+
+    int exponent = 0;
+    while (value >> (exponent + 1))
+    {
+        exponent++;
+    }
+
+    int bucket = (exponent - 2) * HISTOGRAM_STEPS + (int)((value >> (exponent - 3)) & (HISTOGRAM_STEPS - 1));
+    return SDL_min(bucket, HISTOGRAM_BUCKETS - 1);
+}
+
+static Uint32 histogram_value(int bucket)
+{
+    if (bucket < HISTOGRAM_STEPS)
+    {
+        return (Uint32)bucket;
+    }
+
+    int exponent = bucket / HISTOGRAM_STEPS + 2;
+    return (Uint32)(HISTOGRAM_STEPS + bucket % HISTOGRAM_STEPS) << (exponent - 3);
+}
+
+void histogram_add(struct histogram *histogram, Uint32 value)
+{
+    histogram->counts[histogram_bucket(value)]++;
+    histogram->total++;
+    histogram->sum += value;
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+}
+
+Uint32 histogram_percentile(const struct histogram *histogram, double percentile)
+{
+    Uint64 target = (Uint64)(percentile / 100 * histogram->total);
+    Uint64 count = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        count += histogram->counts[i];
+        if (count > target)
+        {
+            return histogram_value(i);
+        }
+    }
+
+    return histogram->max;
+}
+
+void metrics_count_in(struct metrics *metrics, enum data_type type, int len)
+{
+    metrics->messages_in[type]++;
+    metrics->bytes_in[type] += (Uint64)len;
+}
+
+void metrics_count_out(struct metrics *metrics, enum data_type type, int len, int count)
+{
+    metrics->messages_out[type] += (Uint64)count;
+    metrics->bytes_out[type] += (Uint64)len * (Uint64)count;
+}
+
+static void append(struct text *text, const char *format, ...)
+{
+    // once the buffer is full the rest is left out, rather than sending a partial line
+    if (text->len >= text->size)
+    {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(text->buffer + text->len, text->size - text->len, format, args);
+    va_end(args);
+
+    text->len = len >= 0 && len < text->size - text->len ? text->len + len : text->size;
+}
+
+static void append_by_type(struct text *text, const char *name, const char *help, const Uint64 *values)
+{
+    append(text, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (int i = 0; i < DATA_NUM_TYPES; i++)
+    {
+        append(text, "%s{type=\"%s\"} %llu\n", name, data_type_name((enum data_type)i), (unsigned long long)values[i]);
+    }
+}
+
+static void append_counter(struct text *text, const char *name, const char *help, Uint64 value)
+{
+    append(text, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name, (unsigned long long)value);
+}
+
+static void append_gauge(struct text *text, const char *name, const char *help, int value)
+{
+    append(text, "# HELP %s %s\n# TYPE %s gauge\n%s %d\n", name, help, name, name, value);
+}
+
+static void append_summary(struct text *text, const char *name, const char *help, const struct histogram *histogram)
+{
+    static const double quantiles[] = {50, 90, 99, 99.9};
+
+    // recorded in microseconds, exposed in seconds
+    append(text, "# HELP %s %s\n# TYPE %s summary\n", name, help, name);
+    for (int i = 0; i < (int)SDL_arraysize(quantiles); i++)
+    {
+        append(text,
+               "%s{quantile=\"%g\"} %.6f\n",
+               name,
+               quantiles[i] / 100,
+               histogram_percentile(histogram, quantiles[i]) / 1000000.0);
+    }
+    append(text, "%s_sum %.6f\n", name, histogram->sum / 1000000.0);
+    append(text, "%s_count %llu\n", name, (unsigned long long)histogram->total);
+    append(text, "%s_max %.6f\n", name, histogram->max / 1000000.0);
+}
+
+int metrics_format(const struct metrics *metrics, char *buffer, int size)
+{
+    struct text text = {buffer, size, 0};
+
+    append_by_type(&text, "server_messages_in_total", "Messages received, by type.", metrics->messages_in);
+    append_by_type(&text, "server_message_bytes_in_total", "Bytes of the messages received, by type.", metrics->bytes_in);
+    append_by_type(&text, "server_messages_out_total", "Messages queued for clients, by type.", metrics->messages_out);
+    append_by_type(&text, "server_message_bytes_out_total", "Bytes of the messages queued for clients, by type.", metrics->bytes_out);
+
+    append_counter(&text, "server_connections_accepted_total", "Clients given a slot.", metrics->accepted);
+    append_counter(&text, "server_connections_rejected_total", "Clients turned away because the server was full.", metrics->rejected);
+    append_counter(&text, "server_disconnects_total", "Clients disconnected, for any reason.", metrics->disconnected);
+    append_counter(&text, "server_timeouts_total", "Clients disconnected because nothing was heard from them.", metrics->timeouts);
+    append_counter(&text, "server_slow_clients_total", "Messages dropped or clients disconnected because a send queue was full.", metrics->overflowed);
+    append_counter(&text, "server_tcp_bytes_written_total", "Bytes written to TCP connections by the I/O threads.", metrics->bytes_written);
+    append_counter(&text, "server_allocations_total", "Allocations and reallocations made.", metrics->allocations);
+    append_counter(&text, "server_datagrams_in_total", "Datagrams of unreliable messages received.", metrics->datagrams_in);
+    append_counter(&text, "server_datagram_messages_in_total", "Unreliable messages received, however they were batched.", metrics->datagram_messages_in);
+    append_counter(&text, "server_datagrams_out_total", "Datagrams of unreliable messages sent, not counting replies to pings.", metrics->datagrams_out);
+    append_counter(&text, "server_datagram_messages_out_total", "Unreliable messages batched into those datagrams.", metrics->datagram_messages_out);
+    append_counter(&text, "server_fragmented_messages_out_total", "Unreliable messages too large for one datagram, sent in fragments.", metrics->fragmented_out);
+    append_counter(&text, "server_truncated_views_total", "Snapshots of views with more clients around them than a snapshot holds.", metrics->truncated_views);
+    append_counter(&text, "server_truncated_view_clients_total", "Clients left out of those snapshots.", metrics->truncated_clients);
+    append_counter(&text, "server_compressed_messages_total", "Reliable messages that compressing made smaller, once however many clients they went to.", metrics->compressed);
+    append_counter(&text, "server_compression_bytes_in_total", "Bytes of the messages compressing was tried on.", metrics->compress_bytes_in);
+    append_counter(&text, "server_compression_bytes_out_total", "Bytes those messages were sent as, compressed or not.", metrics->compress_bytes_out);
+    append_counter(&text, "server_compression_nanoseconds_total", "Time spent compressing.", metrics->compress_ns);
+
+    append_gauge(&text, "server_clients", "Clients connected.", metrics->clients);
+    append_gauge(&text, "server_send_queue_bytes", "Bytes waiting in TCP send queues.", metrics->queued_bytes);
+    append_gauge(&text, "server_send_queue_max_bytes", "The most bytes waiting in any one TCP send queue since the last scrape.", metrics->max_queued_bytes);
+
+    append_summary(&text, "server_tick_seconds", "Time taken to advance the simulation and send the snapshots.", &metrics->tick_time);
+    append_summary(&text, "server_event_latency_seconds", "Time messages read by the I/O threads waited for the logic thread.", &metrics->event_latency);
+    append_summary(&text, "server_rtt_seconds", "Round trip times of the pings sent to clients.", &metrics->rtt);
+
+    return text.len;
+}
+
+bool metrics_server_open(struct metrics_server *server, SDLNet_Poller poller, const char *host, Uint16 port)
+{
+    server->num_scrapers = 0;
+
+    IPaddress address;
+    if (SDLNet_ResolveHost(&address, host, port))
+    {
+        return false;
+    }
+
+    server->socket = SDLNet_TCP_Listen(&address);
+    if (!server->socket)
+    {
+        return false;
+    }
+
+    if (SDLNet_PollerAdd(poller, server->socket, NULL) == -1)
+    {
+        SDLNet_TCP_Close(server->socket);
+        server->socket = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+static void remove_scraper(struct metrics_server *server, SDLNet_Poller poller, int index)
+{
+    struct metrics_scraper *scraper = &server->scrapers[index];
+    SDLNet_PollerDel(poller, scraper->socket);
+    SDLNet_TCP_Close(scraper->socket);
+    SDLNet_TCP_FreeQueue(scraper->queue);
+    *scraper = server->scrapers[--server->num_scrapers];
+}
+
+static bool write_response(struct metrics_server *server, SDLNet_Poller poller, int index)
+{
+    // as much as the socket takes without blocking, the rest once it is writable, and closed when done
+    struct metrics_scraper *scraper = &server->scrapers[index];
+    if (SDLNet_TCP_Flush(scraper->socket, scraper->queue) == -1)
+    {
+        log_warn("Metrics: %s", SDLNet_GetError());
+        remove_scraper(server, poller, index);
+        return false;
+    }
+
+    if (scraper->queue->count == 0)
+    {
+        remove_scraper(server, poller, index);
+        return false;
+    }
+
+    if (!scraper->writing)
+    {
+        SDLNet_PollerWatchWrite(poller, scraper->socket, 1);
+        scraper->writing = true;
+    }
+
+    return true;
+}
+
+bool metrics_server_update(struct metrics_server *server, SDLNet_Poller poller, Uint32 now)
+{
+    if (SDLNet_SocketReady(server->socket))
+    {
+        TCPsocket socket;
+        while ((socket = SDLNet_TCP_Accept(server->socket)))
+        {
+            // scrapers are expected to be few, the rest are turned away
+            TCPqueue *queue = NULL;
+            if (server->num_scrapers == METRICS_MAX_SCRAPERS ||
+                !(queue = SDLNet_TCP_AllocQueue(METRICS_BUFFER_SIZE)) ||
+                SDLNet_PollerAdd(poller, socket, NULL) == -1)
+            {
+                if (queue)
+                {
+                    SDLNet_TCP_FreeQueue(queue);
+                }
+                SDLNet_TCP_Close(socket);
+                continue;
+            }
+
+            struct metrics_scraper *scraper = &server->scrapers[server->num_scrapers++];
+            scraper->socket = socket;
+            scraper->queue = queue;
+            scraper->time = now;
+            scraper->responding = false;
+            scraper->writing = false;
+        }
+    }
+
+    // a scraper that never asks, or never takes its response, would otherwise keep its place for good
+    bool waiting = false;
+    int i = 0;
+    while (i < server->num_scrapers)
+    {
+        struct metrics_scraper *scraper = &server->scrapers[i];
+        if (now - scraper->time > METRICS_SCRAPER_TIMEOUT)
+        {
+            log_debug("Metrics: Closing a scraper that timed out");
+            remove_scraper(server, poller, i);
+            continue;
+        }
+
+        if (scraper->responding)
+        {
+            if (!write_response(server, poller, i))
+            {
+                continue;
+            }
+        }
+        else if (SDLNet_SocketReady(scraper->socket))
+        {
+            waiting = true;
+        }
+
+        i++;
+    }
+
+    return waiting;
+}
+
+void metrics_server_respond(struct metrics_server *server, SDLNet_Poller poller, const struct metrics *metrics)
+{
+    // formatted once for every scraper waiting, whose queues each hold a reference until it is written
+    TCPbuffer *response = SDLNet_TCP_AllocRawBuffer(METRICS_BUFFER_SIZE);
+    if (!response)
+    {
+        log_warn("Metrics: %s", SDLNet_GetError());
+        return;
+    }
+
+    int header_len = (int)strlen(METRICS_HEADER);
+    memcpy(response->data, METRICS_HEADER, header_len);
+    response->len = header_len + metrics_format(metrics, (char *)response->data + header_len, METRICS_BUFFER_SIZE - header_len);
+
+    // the request is read so closing doesn't reset the connection, but whatever was asked for gets the metrics
+    int i = 0;
+    while (i < server->num_scrapers)
+    {
+        struct metrics_scraper *scraper = &server->scrapers[i];
+        if (scraper->responding || !SDLNet_SocketReady(scraper->socket))
+        {
+            i++;
+            continue;
+        }
+
+        char request[METRICS_REQUEST_SIZE];
+        if (SDLNet_TCP_Recv(scraper->socket, request, sizeof(request)) <= 0 ||
+            SDLNet_TCP_Enqueue(scraper->queue, response) == -1)
+        {
+            remove_scraper(server, poller, i);
+            continue;
+        }
+
+        scraper->responding = true;
+        if (write_response(server, poller, i))
+        {
+            i++;
+        }
+    }
+
+    SDLNet_TCP_ReleaseBuffer(response);
+}
+
+void metrics_server_close(struct metrics_server *server, SDLNet_Poller poller)
+{
+    while (server->num_scrapers > 0)
+    {
+        remove_scraper(server, poller, server->num_scrapers - 1);
+    }
+
+    SDLNet_PollerDel(poller, server->socket);
+    SDLNet_TCP_Close(server->socket);
+    server->socket = NULL;
+}
@@ -0,0 +1,116 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_net.h>
+#include <stdbool.h>
+
+#include "data.h"
+#include "SDL_net_ext.h"
+
+// values bucketed with 8 steps per power of two so percentiles are within 12.5%, recording one
+// is a few instructions and never allocates
+#define HISTOGRAM_STEPS 8
+#define HISTOGRAM_BUCKETS (30 * HISTOGRAM_STEPS)
+
+// connections to the scrape port that can be waiting for their response at once, and how long one
+// has to ask and take its response before it is closed, in milliseconds
+#define METRICS_MAX_SCRAPERS 8
+#define METRICS_SCRAPER_TIMEOUT 5000
+
+// the metrics are only served to this machine unless told otherwise
+#define METRICS_DEFAULT_ADDRESS "127.0.0.1"
+
+struct histogram
+{
+    Uint64 counts[HISTOGRAM_BUCKETS];
+    Uint64 total;
+    Uint64 sum;
+    Uint32 max;
+};
+
+// totals since the server started, only touched by the logic thread, a channel datagram is
+// counted as itself and again for each message it carries
+struct metrics
+{
+    Uint64 messages_in[DATA_NUM_TYPES];
+    Uint64 bytes_in[DATA_NUM_TYPES];
+    Uint64 messages_out[DATA_NUM_TYPES];
+    Uint64 bytes_out[DATA_NUM_TYPES];
+
+    Uint64 accepted;
+    Uint64 rejected;
+    Uint64 disconnected;
+    Uint64 timeouts;
+    Uint64 overflowed;
+    Uint64 bytes_written;
+    Uint64 allocations;
+
+    // datagrams of unreliable messages, and how many messages they carried
+    Uint64 datagrams_in;
+    Uint64 datagram_messages_in;
+    Uint64 datagrams_out;
+    Uint64 datagram_messages_out;
+    // of those messages, the ones too large for one datagram that were split into fragments
+    Uint64 fragmented_out;
+
+    // snapshots of crowded views that couldn't hold every client around them, and the clients left out
+    Uint64 truncated_views;
+    Uint64 truncated_clients;
+
+    // reliable messages that got smaller compressed for clients that can take it, and the bytes of
+    // every message it was tried on before and after, those that didn't get smaller left as they were,
+    // with the time it took
+    Uint64 compressed;
+    Uint64 compress_bytes_in;
+    Uint64 compress_bytes_out;
+    Uint64 compress_ns;
+
+    // gauges, filled in before the metrics are written
+    int clients;
+    int queued_bytes;
+    int max_queued_bytes;
+
+    // in microseconds, how long a tick took, how long messages waited for the logic thread, and
+    // the round trips of the server's pings
+    struct histogram tick_time;
+    struct histogram event_latency;
+    struct histogram rtt;
+};
+
+// a connection to the scrape port, and its response while it is written out
+struct metrics_scraper
+{
+    TCPsocket socket;
+    TCPqueue *queue;
+    Uint32 time;
+    bool responding;
+    bool writing;
+};
+
+// serves the metrics as plain text over HTTP, in the Prometheus exposition format
+struct metrics_server
+{
+    TCPsocket socket;
+    struct metrics_scraper scrapers[METRICS_MAX_SCRAPERS];
+    int num_scrapers;
+};
+
+void histogram_add(struct histogram *histogram, Uint32 value);
+
+// the lower edge of the bucket the percentile falls into
+Uint32 histogram_percentile(const struct histogram *histogram, double percentile);
+
+void metrics_count_in(struct metrics *metrics, enum data_type type, int len);
+void metrics_count_out(struct metrics *metrics, enum data_type type, int len, int count);
+int metrics_format(const struct metrics *metrics, char *buffer, int size);
+
+bool metrics_server_open(struct metrics_server *server, SDLNet_Poller poller, const char *host, Uint16 port);
+
+// accepts new scrapers, closes those past their time, writes out what the socket takes of the responses
+// already under way, and returns whether any scrapers are waiting for a response
+bool metrics_server_update(struct metrics_server *server, SDLNet_Poller poller, Uint32 now);
+void metrics_server_respond(struct metrics_server *server, SDLNet_Poller poller, const struct metrics *metrics);
+void metrics_server_close(struct metrics_server *server, SDLNet_Poller poller);
+
+#endif
@@ -0,0 +1,115 @@
+#include "ring.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_net.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct ring *ring_alloc(int capacity, int item_size)
+{
+    struct ring *ring = SDL_calloc(1, sizeof(struct ring));
+
+    if (!ring)
+    {
+        SDLNet_SetError("Couldn't allocate ring");
+
+        return NULL;
+    }
+
+    // a power of two, so the free running indices wrap onto the same items
+    ring->capacity = 1;
+    while (ring->capacity < capacity)
+    {
+        ring->capacity *= 2;
+    }
+
+    ring->item_size = item_size;
+    ring->items = SDL_malloc((size_t)ring->capacity * item_size);
+
+    if (!ring->items)
+    {
+        SDLNet_SetError("Couldn't allocate ring");
+
+        SDL_free(ring);
+
+        return NULL;
+    }
+
+    return ring;
+}
+
+void *ring_reserve(struct ring *ring)
+{
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&ring->tail);
+
+    if (tail - ring->cached_head == (unsigned int)ring->capacity)
+    {
+        ring->cached_head = (unsigned int)SDL_AtomicGet(&ring->head);
+
+        if (tail - ring->cached_head == (unsigned int)ring->capacity)
+        {
+            return NULL;
+        }
+    }
+
+    return ring->items + (size_t)(tail & (ring->capacity - 1)) * ring->item_size;
+}
+
+void ring_commit(struct ring *ring)
+{
+    // the item is written before the index that hands it over
+    SDL_AtomicAdd(&ring->tail, 1);
+}
+
+int ring_space(struct ring *ring)
+{
+    // how many items the producer can reserve before the ring is full
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&ring->tail);
+    ring->cached_head = (unsigned int)SDL_AtomicGet(&ring->head);
+
+    return ring->capacity - (int)(tail - ring->cached_head);
+}
+
+bool ring_push(struct ring *ring, const void *item)
+{
+    void *slot = ring_reserve(ring);
+
+    if (!slot)
+    {
+        return false;
+    }
+
+    memcpy(slot, item, ring->item_size);
+    ring_commit(ring);
+
+    return true;
+}
+
+void *ring_peek(struct ring *ring)
+{
+    unsigned int head = (unsigned int)SDL_AtomicGet(&ring->head);
+
+    if (head == ring->cached_tail)
+    {
+        ring->cached_tail = (unsigned int)SDL_AtomicGet(&ring->tail);
+
+        if (head == ring->cached_tail)
+        {
+            return NULL;
+        }
+    }
+
+    return ring->items + (size_t)(head & (ring->capacity - 1)) * ring->item_size;
+}
+
+void ring_release(struct ring *ring)
+{
+    // the item is finished with before the producer is allowed to reuse it
+    SDL_AtomicAdd(&ring->head, 1);
+}
+
+void ring_free(struct ring *ring)
+{
+    SDL_free(ring->items);
+    SDL_free(ring);
+}
@@ -0,0 +1,38 @@
+#ifndef RING_H
+#define RING_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+// large enough to keep the producer's and consumer's indices from sharing a cache line
+#define RING_CACHE_LINE 64
+
+// a bounded queue of fixed size items passed from one producer thread to one consumer thread
+// without locks, each index is only ever written by one side and read by the other
+struct ring
+{
+    int capacity;
+    int item_size;
+    Uint8 *items;
+
+    // the producer's side, with its last look at the consumer's index so the shared one is rarely read
+    SDL_atomic_t tail;
+    unsigned int cached_head;
+    Uint8 padding1[RING_CACHE_LINE];
+
+    // the consumer's side
+    SDL_atomic_t head;
+    unsigned int cached_tail;
+    Uint8 padding2[RING_CACHE_LINE];
+};
+
+struct ring *ring_alloc(int capacity, int item_size);
+void *ring_reserve(struct ring *ring);
+void ring_commit(struct ring *ring);
+int ring_space(struct ring *ring);
+bool ring_push(struct ring *ring, const void *item);
+void *ring_peek(struct ring *ring);
+void ring_release(struct ring *ring);
+void ring_free(struct ring *ring);
+
+#endif
@@ -2,61 +2,1752 @@
 #include <SDL2/SDL_net.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "alloc.h"
+#include "batch.h"
+#include "channel.h"
 #include "client.h"
+#include "compress.h"
+#include "cookie.h"
 #include "data.h"
+#include "fragment.h"
+#include "interest.h"
+#include "io.h"
+#include "log.h"
+#include "loop.h"
+#include "metrics.h"
 #include "SDL_net_ext.h"
 
 #define SERVER_PORT 1000
-#define MAX_CLIENTS 8
+#define REPORT_INTERVAL 10000
+#define DEFAULT_TICK_RATE 30
+
+// client IDs combine a slot index with a generation counter, so a reused slot gets a new ID,
+// the wire format sizes the slot to the most clients there can be
+#define CLIENT_SLOT_BITS DATA_ID_SLOT_BITS
+#define CLIENT_SLOT_MASK ((1 << CLIENT_SLOT_BITS) - 1)
+#define CLIENT_GENERATION_MASK 0x7FFF
+#define MAX_CLIENTS (1 << CLIENT_SLOT_BITS)
+#define INITIAL_CLIENTS 8
+
+// bytes that may be waiting to be written to a single client
+#define DEFAULT_SEND_QUEUE_SIZE (64 * 1024)
+
+// encoded messages are pooled, every block fits the largest message there is
+#define BUFFER_BLOCK_SIZE ((int)sizeof(TCPbuffer) + TCP_HEADER_SIZE + DATA_MAX_ENCODED_SIZE)
+#define BUFFERS_PER_SLAB 256
+
+// clients are pinged this often, and disconnected once nothing has been heard from them for the timeout
+#define PING_INTERVAL 1000
+#define CLIENT_TIMEOUT 10000
+
+// timeouts are kept in a wheel of slots this many milliseconds apart, which spans more than the timeout
+// so a slot only ever holds clients due at the same time
+#define TIMEOUT_RESOLUTION 250
+#define TIMEOUT_SLOTS 64
+
+// what a client's recent views hold for the snapshots it wasn't sent
+#define VIEW_CELL_NONE 0xFF
+
+// clients with a reliable channel are also found by their address, a power of two
+#define ADDRESS_BUCKETS 4096
 
-// TODO: handle timeouts on clients to automatically disconnect them
 struct client
 {
-    int id;
-    TCPsocket socket;
-    IPaddress udp_address;
-};
+    int id;
+    int generation;
+    int index;
+    struct io_thread *io;
+    struct channel *channel;
+    int pending_index;
+    bool overflowed;
+    bool udp_connected;
+    unsigned int acked;
+
+    // a TCP client joins once its connect request arrives, with the features agreed to in the response
+    bool joined;
+    int features;
+    IPaddress udp_address;
+
+    // unreliable messages for the client, gathered into one datagram until the end of the loop iteration,
+    // allocated the first time the slot is used over UDP and kept for whoever has it next
+    struct batch *batch;
+    char address[ADDRESS_STRLEN];
+
+    // the wheel slot the client times out in, and its neighbours there by slot index
+    Uint32 timeout;
+    int timeout_prev;
+    int timeout_next;
+
+    // the neighbours by slot index in the address bucket of a client with a channel
+    int address_prev;
+    int address_next;
+
+    // round trip time to the server's pings and its variation, smoothed as in RFC 6298, in milliseconds
+    bool has_rtt;
+    float rtt;
+    float rtt_variation;
+
+    // the cell whose view of the world the client was sent with each recent snapshot, or none
+    Uint8 view_cells[SNAPSHOT_HISTORY];
+
+    // the simulated state, and the latest input received for the next tick
+    struct client_state state;
+    struct client_state input;
+    int pressed;
+};
+
+// the client table grows on demand, free slots are reused from a stack and
+// live clients are also listed densely so iterating them never touches empty slots
+static struct client *clients;
+static int *free_slots;
+static int *active_clients;
+static int client_capacity;
+static int num_free_slots;
+static int num_clients;
+static int max_clients = MAX_CLIENTS;
+
+// clients with queued UDP output, flushed once per loop iteration
+static int *pending_clients;
+static int num_pending;
+
+static int send_queue_size = DEFAULT_SEND_QUEUE_SIZE;
+
+// TCP connections are spread over the I/O threads, everything else happens on this thread
+static struct io_thread *io_threads[IO_MAX_THREADS];
+static int num_io_threads = 1;
+static int next_io_thread;
+
+// the most recent chat, copied out of the requests it came in so joining clients can be sent it
+struct chat_entry
+{
+    int id;
+    int length;
+    char message[MAX_STRLEN];
+};
+
+static struct chat_entry chat_history[CHAT_HISTORY];
+static int chat_history_start;
+static int chat_history_count;
+
+// reliable messages at least this long are compressed for clients that can take it, 0 turns it off,
+// and how much it saved and cost since the last report
+static int compress_threshold = COMPRESS_DEFAULT_THRESHOLD;
+static struct compressor *compressor;
+static Uint64 compress_bytes_in;
+static Uint64 compress_bytes_out;
+static Uint64 compress_ticks;
+
+// how many catch-ups were sent since the last report, and how many messages they came to
+static Uint64 catch_ups;
+static Uint64 catch_up_messages;
+
+// compares what was serialized against what fanning it out cost
+static Uint64 bytes_encoded;
+static Uint64 bytes_sent;
+static Uint64 allocations;
+
+// a client is only sent the clients around its own cell, so every client in a cell shares that
+// cell's view of the world, encoded once per tick, and deltas are encoded once per baseline
+// and pair of cells that some client needs
+struct encoded_view
+{
+    unsigned int sequence;
+    int len;
+    unsigned char data[DATA_MAX_ENCODED_SIZE];
+};
+
+struct encoded_delta
+{
+    unsigned int sequence;
+    unsigned int baseline;
+    int baseline_cell;
+    int cell;
+    int len;
+    unsigned char data[DATA_MAX_ENCODED_SIZE];
+};
+
+// deltas are cached by a hash of what they are between, a collision only costs encoding one again
+#define DELTA_CACHE_SIZE 512
+
+static unsigned int tick_count;
+static struct snapshot_data views[SNAPSHOT_HISTORY][INTEREST_CELLS];
+static struct encoded_view encoded_views[INTEREST_CELLS];
+static struct encoded_delta encoded_deltas[DELTA_CACHE_SIZE];
+
+// the state of every client, in the order of the active list, and which cell each is in
+static struct client_state *world;
+static struct interest_grid interest_grid;
+
+static Uint64 snapshot_bytes;
+static Uint64 full_snapshots;
+static Uint64 delta_snapshots;
+
+// views that had more clients around them than a snapshot holds, and the clients they left out
+static Uint64 truncated_views;
+static Uint64 truncated_clients;
+
+// the largest datagram unreliable messages are packed into, and how many were since the last report
+static int mtu = BATCH_DEFAULT_MTU;
+static Uint64 datagrams_out;
+static Uint64 datagram_messages_out;
+static Uint64 datagrams_in;
+static Uint64 datagram_messages_in;
+static Uint64 fragmented_out;
+
+// tells apart the messages being sent in fragments, one counter for every client is enough
+static Uint16 fragment_id;
+
+static enum overflow_policy overflow_policy = OVERFLOW_DISCONNECT;
+
+// acquired by the logic thread when it encodes, released by whichever thread sends the last copy
+static SDLNet_Pool buffer_pool;
+
+static struct metrics metrics;
+static Uint64 frequency;
+
+// the first client in each slot of the timeout wheel, and the slot to expire next, in units of the resolution
+static int timeout_wheel[TIMEOUT_SLOTS];
+static Uint32 timeout_time;
+
+// the first client with a channel in each bucket, by a hash of its address, as datagrams sent before
+// a client learns its ID have nothing else to find it by
+static int address_buckets[ADDRESS_BUCKETS];
+
+// what the cookies a channel client has to connect with are made with
+static struct cookie_key cookie_key;
+
+// read once per loop iteration, so the timeouts of clients heard from are cheap to push back
+static Uint32 loop_time;
+
+static bool grow_clients(void)
+{
+    if (client_capacity >= max_clients)
+    {
+        return false;
+    }
+
+    int capacity = client_capacity ? client_capacity * 2 : INITIAL_CLIENTS;
+    if (capacity > max_clients)
+    {
+        capacity = max_clients;
+    }
+
+    struct client *new_clients = SDL_realloc(clients, capacity * sizeof(struct client));
+    if (!new_clients)
+    {
+        return false;
+    }
+    clients = new_clients;
+
+    int *new_free_slots = SDL_realloc(free_slots, capacity * sizeof(int));
+    if (!new_free_slots)
+    {
+        return false;
+    }
+    free_slots = new_free_slots;
+
+    int *new_active_clients = SDL_realloc(active_clients, capacity * sizeof(int));
+    if (!new_active_clients)
+    {
+        return false;
+    }
+    active_clients = new_active_clients;
+
+    int *new_pending_clients = SDL_realloc(pending_clients, capacity * sizeof(int));
+    if (!new_pending_clients)
+    {
+        return false;
+    }
+    pending_clients = new_pending_clients;
+
+    struct client_state *new_world = SDL_realloc(world, capacity * sizeof(struct client_state));
+    if (!new_world)
+    {
+        return false;
+    }
+    world = new_world;
+
+    // push the new slots in reverse so the lowest ones are handed out first
+    for (int i = capacity - 1; i >= client_capacity; i--)
+    {
+        clients[i].id = -1;
+        clients[i].generation = 0;
+        clients[i].io = NULL;
+        clients[i].channel = NULL;
+        clients[i].batch = NULL;
+
+        free_slots[num_free_slots++] = i;
+    }
+
+    client_capacity = capacity;
+
+    return true;
+}
+
+static void init_timeouts(void)
+{
+    loop_time = SDL_GetTicks();
+    timeout_time = loop_time & ~(Uint32)(TIMEOUT_RESOLUTION - 1);
+
+    for (int i = 0; i < TIMEOUT_SLOTS; i++)
+    {
+        timeout_wheel[i] = -1;
+    }
+}
+
+static void init_addresses(void)
+{
+    for (int i = 0; i < ADDRESS_BUCKETS; i++)
+    {
+        address_buckets[i] = -1;
+    }
+}
+
+static int *address_bucket(const IPaddress *address)
+{
+    // both are in network byte order, which only changes which bucket an address lands in
+    Uint32 hash = (address->host ^ ((Uint32)address->port << 16)) * 2654435761u;
+    return &address_buckets[hash >> 20 & (ADDRESS_BUCKETS - 1)];
+}
+
+static void add_address(struct client *client)
+{
+    int slot = client->id & CLIENT_SLOT_MASK;
+    int *head = address_bucket(&client->udp_address);
+    client->address_prev = -1;
+    client->address_next = *head;
+    if (*head != -1)
+    {
+        clients[*head].address_prev = slot;
+    }
+    *head = slot;
+}
+
+static void remove_address(struct client *client)
+{
+    if (client->address_prev != -1)
+    {
+        clients[client->address_prev].address_next = client->address_next;
+    }
+    else
+    {
+        *address_bucket(&client->udp_address) = client->address_next;
+    }
+
+    if (client->address_next != -1)
+    {
+        clients[client->address_next].address_prev = client->address_prev;
+    }
+}
+
+static void schedule_timeout(struct client *client)
+{
+    // rounded to the resolution, which is a power of two so the slots stay in order when the ticks wrap
+    client->timeout = (loop_time + CLIENT_TIMEOUT) & ~(Uint32)(TIMEOUT_RESOLUTION - 1);
+
+    int slot = client->id & CLIENT_SLOT_MASK;
+    int *head = &timeout_wheel[client->timeout / TIMEOUT_RESOLUTION % TIMEOUT_SLOTS];
+    client->timeout_prev = -1;
+    client->timeout_next = *head;
+    if (*head != -1)
+    {
+        clients[*head].timeout_prev = slot;
+    }
+    *head = slot;
+}
+
+static void unschedule_timeout(struct client *client)
+{
+    if (client->timeout_prev != -1)
+    {
+        clients[client->timeout_prev].timeout_next = client->timeout_next;
+    }
+    else
+    {
+        timeout_wheel[client->timeout / TIMEOUT_RESOLUTION % TIMEOUT_SLOTS] = client->timeout_next;
+    }
+
+    if (client->timeout_next != -1)
+    {
+        clients[client->timeout_next].timeout_prev = client->timeout_prev;
+    }
+}
+
+static void touch_client(struct client *client)
+{
+    // most messages arrive while the client's timeout still rounds to the same slot
+    if (client->timeout != ((loop_time + CLIENT_TIMEOUT) & ~(Uint32)(TIMEOUT_RESOLUTION - 1)))
+    {
+        unschedule_timeout(client);
+        schedule_timeout(client);
+    }
+}
+
+static int alloc_client(void)
+{
+    if (num_free_slots == 0 && !grow_clients())
+    {
+        return -1;
+    }
+
+    int slot = free_slots[--num_free_slots];
+    struct client *client = &clients[slot];
+
+    // generation 0 is skipped so that an ID is never 0
+    client->generation = (client->generation + 1) & CLIENT_GENERATION_MASK;
+    if (client->generation == 0)
+    {
+        client->generation = 1;
+    }
+
+    client->id = client->generation << CLIENT_SLOT_BITS | slot;
+    client->index = num_clients;
+    client->pending_index = -1;
+    client->overflowed = false;
+    client->udp_connected = false;
+    client->joined = false;
+    client->features = 0;
+    if (client->batch)
+    {
+        client->batch->count = 0;
+    }
+    client->acked = 0;
+    memset(client->view_cells, VIEW_CELL_NONE, sizeof(client->view_cells));
+    client->has_rtt = false;
+    client->rtt = 0;
+    client->rtt_variation = 0;
+    schedule_timeout(client);
+
+    client->state.id = client->id;
+    client->state.x = 0;
+    client->state.y = 0;
+    client->state.buttons = 0;
+    client->input = client->state;
+    client->pressed = 0;
+    active_clients[num_clients++] = slot;
+
+    return slot;
+}
+
+static void free_client(int slot)
+{
+    struct client *client = &clients[slot];
+
+    // move the last active client into the freed position
+    int last = active_clients[--num_clients];
+    active_clients[client->index] = last;
+    clients[last].index = client->index;
+
+    unschedule_timeout(client);
+
+    client->id = -1;
+    client->io = NULL;
+    client->channel = NULL;
+
+    free_slots[num_free_slots++] = slot;
+}
+
+static struct client *find_client(int id)
+{
+    int slot = id & CLIENT_SLOT_MASK;
+
+    if (id <= 0 || slot >= client_capacity || clients[slot].id != id)
+    {
+        return NULL;
+    }
+
+    return &clients[slot];
+}
+
+static bool connect_udp(struct client *client, const IPaddress *address)
+{
+    if (!client->batch)
+    {
+        client->batch = SDL_malloc(sizeof(struct batch));
+        if (!client->batch)
+        {
+            SDLNet_SetError("Couldn't allocate batch");
+            return false;
+        }
+        client->batch->count = 0;
+    }
+
+    // a client with a channel is found by its address too
+    if (client->channel && client->udp_connected)
+    {
+        remove_address(client);
+    }
+    client->udp_address = *address;
+    client->udp_connected = true;
+    if (client->channel)
+    {
+        add_address(client);
+    }
+
+    return true;
+}
+
+static void remove_pending(struct client *client)
+{
+    int last = pending_clients[--num_pending];
+    pending_clients[client->pending_index] = last;
+    clients[last].pending_index = client->pending_index;
+    client->pending_index = -1;
+}
+
+static void mark_pending(struct client *client)
+{
+    if (client->pending_index == -1)
+    {
+        client->pending_index = num_pending;
+        pending_clients[num_pending++] = client->id & CLIENT_SLOT_MASK;
+    }
+}
+
+static int message_stream(const TCPbuffer *buffer)
+{
+    // chat gets its own stream so a lost chat message never delays connects and disconnects
+    return compress_peek_type(buffer->data + TCP_HEADER_SIZE, buffer->len - TCP_HEADER_SIZE) == DATA_CHAT_BROADCAST
+               ? CHANNEL_CHAT
+               : CHANNEL_CONTROL;
+}
+
+static void queue_data(struct client *client, TCPbuffer *buffer)
+{
+    if (client->overflowed || (!client->io && !client->channel))
+    {
+        return;
+    }
+
+    // TCP clients are written to by their I/O thread, which applies the overflow policy to the send queue
+    // itself, so here it only overflows if a send queue's worth is already waiting for the thread to
+    // catch up, channel clients get a copy of the message without the stream framing and only overflow
+    // once a send queue's worth is waiting behind their window
+    bool queued = client->io ? io_send(client->io, client->id, client->id & CLIENT_SLOT_MASK, buffer)
+                             : channel_send(client->channel,
+                                            message_stream(buffer),
+                                            buffer->data + TCP_HEADER_SIZE,
+                                            buffer->len - TCP_HEADER_SIZE) != -1;
+    if (!queued)
+    {
+        if (overflow_policy == OVERFLOW_DROP)
+        {
+            metrics.overflowed++;
+            log_debug("Dropping %d bytes for slow client %s", buffer->len, client->address);
+            return;
+        }
+
+        // disconnecting here would modify the client list while it is being iterated, so leave it to the next flush
+        metrics.overflowed++;
+        client->overflowed = true;
+    }
+
+    // the flush writes out channel clients, and disconnects clients that overflowed
+    if (client->channel || client->overflowed)
+    {
+        mark_pending(client);
+    }
+}
+
+static TCPbuffer *encode_data(const struct data *data)
+{
+    unsigned char encoded[DATA_MAX_ENCODED_SIZE];
+    int len = data_encode(data, encoded, sizeof(encoded));
+
+    TCPbuffer *buffer = SDLNet_TCP_AcquireBuffer(buffer_pool, encoded, len);
+    if (!buffer)
+    {
+        log_error("%s", SDLNet_GetError());
+        return NULL;
+    }
+
+    bytes_encoded += buffer->len;
+
+    return buffer;
+}
+
+static TCPbuffer *compress_buffer(const TCPbuffer *buffer)
+{
+    // only worth it for larger messages, and only sent compressed if that made them smaller
+    int len = buffer->len - TCP_HEADER_SIZE;
+    if (!compressor || len < compress_threshold)
+    {
+        return NULL;
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    unsigned char compressed[DATA_MAX_ENCODED_SIZE];
+    int compressed_len = compress_message(compressor, buffer->data + TCP_HEADER_SIZE, len, compressed, sizeof(compressed));
+    Uint64 ticks = SDL_GetPerformanceCounter() - start;
+
+    compress_bytes_in += len;
+    compress_bytes_out += compressed_len != -1 ? compressed_len : len;
+    compress_ticks += ticks;
+    metrics.compress_bytes_in += len;
+    metrics.compress_bytes_out += compressed_len != -1 ? compressed_len : len;
+    metrics.compress_ns += ticks * 1000000000 / frequency;
+    if (compressed_len == -1)
+    {
+        return NULL;
+    }
+
+    TCPbuffer *compressed_buffer = SDLNet_TCP_AcquireBuffer(buffer_pool, compressed, compressed_len);
+    if (!compressed_buffer)
+    {
+        log_error("%s", SDLNet_GetError());
+        return NULL;
+    }
+
+    metrics.compressed++;
+
+    return compressed_buffer;
+}
+
+static void send_data(struct client *client, const struct data *data)
+{
+    TCPbuffer *buffer = encode_data(data);
+    if (buffer)
+    {
+        TCPbuffer *compressed = client->features & DATA_FEATURE_COMPRESSION ? compress_buffer(buffer) : NULL;
+        TCPbuffer *sent = compressed ? compressed : buffer;
+        queue_data(client, sent);
+        metrics_count_out(&metrics, data->type, sent->len - TCP_HEADER_SIZE, 1);
+        if (compressed)
+        {
+            SDLNet_TCP_ReleaseBuffer(compressed);
+        }
+        SDLNet_TCP_ReleaseBuffer(buffer);
+    }
+}
+
+static void broadcast(const struct data *data, int exclude_id)
+{
+    // encode once, and compress once for the clients that can take it, every recipient's queue only
+    // holds a reference
+    TCPbuffer *buffer = encode_data(data);
+    if (!buffer)
+    {
+        return;
+    }
+
+    TCPbuffer *compressed = NULL;
+    bool compress_tried = false;
+    int count = 0;
+    int compressed_count = 0;
+    for (int i = 0; i < num_clients; i++)
+    {
+        struct client *client = &clients[active_clients[i]];
+        if (client->id == exclude_id || !client->joined)
+        {
+            continue;
+        }
+
+        if (client->features & DATA_FEATURE_COMPRESSION && !compress_tried)
+        {
+            compressed = compress_buffer(buffer);
+            compress_tried = true;
+        }
+
+        if (compressed && client->features & DATA_FEATURE_COMPRESSION)
+        {
+            queue_data(client, compressed);
+            compressed_count++;
+        }
+        else
+        {
+            queue_data(client, buffer);
+            count++;
+        }
+    }
+
+    metrics_count_out(&metrics, data->type, buffer->len - TCP_HEADER_SIZE, count);
+    if (compressed)
+    {
+        metrics_count_out(&metrics, data->type, compressed->len - TCP_HEADER_SIZE, compressed_count);
+        SDLNet_TCP_ReleaseBuffer(compressed);
+    }
+    SDLNet_TCP_ReleaseBuffer(buffer);
+}
+
+static void close_client(struct client *client)
+{
+    if (client->pending_index != -1)
+    {
+        remove_pending(client);
+    }
+
+    if (client->io)
+    {
+        io_close(client->io, client->id, client->id & CLIENT_SLOT_MASK);
+    }
+
+    if (client->channel)
+    {
+        remove_address(client);
+        channel_free(client->channel);
+    }
+
+    free_client(client->id & CLIENT_SLOT_MASK);
+}
+
+// the most each part of a catch-up can take, so one can be filled without encoding it to find out,
+// a chat's length is a varint of one or two bytes and its text starts on a byte boundary
+#define CATCH_UP_HEADER_BITS (DATA_TYPE_BITS + 1 + 2 * DATA_COUNT_BITS + 7)
+#define CATCH_UP_CHAT_BITS(id, length) (data_id_bits(id) + 2 * 8 + 7 + 8 * (length))
+
+static void flush_catch_up(struct client *client, struct catch_up_data *catch_up_data, bool more)
+{
+    catch_up_data->more = more;
+    send_data(client, &catch_up_data->data);
+    catch_up_messages++;
+
+    *catch_up_data = catch_up_data_create(DATA_CATCH_UP);
+}
+
+static void send_catch_up(struct client *client)
+{
+    // everyone already connected and then the recent chat, in as few messages as they fit in,
+    // which is one unless the roster is in the hundreds or the history is long messages
+    struct catch_up_data catch_up_data = catch_up_data_create(DATA_CATCH_UP);
+    int bits = CATCH_UP_HEADER_BITS;
+    for (int i = 0; i < num_clients; i++)
+    {
+        int id = clients[active_clients[i]].id;
+        if (id == client->id || !clients[active_clients[i]].joined)
+        {
+            continue;
+        }
+
+        if (catch_up_data.num_clients == CATCH_UP_MAX_CLIENTS ||
+            bits + data_id_bits(id) > DATA_MAX_CATCH_UP_SIZE * 8)
+        {
+            flush_catch_up(client, &catch_up_data, true);
+            bits = CATCH_UP_HEADER_BITS;
+        }
+
+        catch_up_data.clients[catch_up_data.num_clients++] = id;
+        bits += data_id_bits(id);
+    }
+
+    for (int i = 0; i < chat_history_count; i++)
+    {
+        const struct chat_entry *entry = &chat_history[(chat_history_start + i) % CHAT_HISTORY];
+        if (bits + CATCH_UP_CHAT_BITS(entry->id, entry->length) > DATA_MAX_CATCH_UP_SIZE * 8)
+        {
+            flush_catch_up(client, &catch_up_data, true);
+            bits = CATCH_UP_HEADER_BITS;
+        }
+
+        struct chat_data *chat_data = &catch_up_data.chats[catch_up_data.num_chats++];
+        chat_data->data = data_create(DATA_CHAT_BROADCAST);
+        chat_data->id = entry->id;
+        chat_data->message = entry->message;
+        chat_data->length = entry->length;
+        bits += CATCH_UP_CHAT_BITS(entry->id, entry->length);
+    }
+
+    flush_catch_up(client, &catch_up_data, false);
+    catch_ups++;
+}
+
+static void record_chat(const struct chat_data *chat_data)
+{
+    // the oldest is overwritten once the history is full
+    struct chat_entry *entry = &chat_history[(chat_history_start + chat_history_count) % CHAT_HISTORY];
+    if (chat_history_count == CHAT_HISTORY)
+    {
+        chat_history_start = (chat_history_start + 1) % CHAT_HISTORY;
+    }
+    else
+    {
+        chat_history_count++;
+    }
+
+    entry->id = chat_data->id;
+    entry->length = SDL_min(chat_data->length, MAX_STRLEN - 1);
+    memcpy(entry->message, chat_data->message, entry->length);
+}
+
+static void join_client(struct client *client, int features)
+{
+    log_info("Connected to client %s", client->address);
+    metrics.accepted++;
+
+    // of what the client can do, only what the server is set up for is used
+    client->joined = true;
+    client->features = features & (compressor ? DATA_FEATURE_COMPRESSION : 0);
+
+    // send the client their info
+    {
+        struct connect_data connect_data = connect_data_create(DATA_CONNECT_OK, client->id, client->features);
+        connect_data.cookie = cookie_make_id(&cookie_key, client->id);
+        send_data(client, &connect_data.data);
+    }
+
+    // and what they missed
+    send_catch_up(client);
+
+    // inform other clients
+    struct id_data id_data = id_data_create(DATA_CONNECT_BROADCAST, client->id);
+    broadcast(&id_data.data, client->id);
+
+    // log the current number of clients
+    log_info("There are %d clients connected", num_clients);
+}
+
+static void accept_client(TCPsocket socket)
+{
+    // take a free slot
+    int slot = alloc_client();
+    if (slot == -1)
+    {
+        log_info("A client tried to connect, but the server is full");
+
+        // send client a full server message, it's the first write on the socket so it won't block
+        unsigned char buffer[DATA_MAX_ENCODED_SIZE];
+        struct data data = data_create(DATA_CONNECT_FULL);
+        int len = data_encode(&data, buffer, sizeof(buffer));
+        SDLNet_TCP_SendExt(socket, buffer, len);
+        metrics_count_out(&metrics, DATA_CONNECT_FULL, len, 1);
+        metrics.rejected++;
+
+        SDLNet_TCP_Close(socket);
+        return;
+    }
+
+    // format the peer address once so logging never has to resolve it again, the socket is the I/O thread's after this
+    struct client *client = &clients[slot];
+    SDLNet_FormatAddress(SDLNet_TCP_GetPeerAddress(socket), client->address, sizeof(client->address));
+
+    // spread the connections over the I/O threads
+    struct io_thread *io = io_threads[next_io_thread];
+    next_io_thread = (next_io_thread + 1) % num_io_threads;
+    if (!io_open(io, client->id, slot, socket))
+    {
+        log_error("%s", SDLNet_GetError());
+        SDLNet_TCP_Close(socket);
+        free_client(slot);
+        return;
+    }
+    client->io = io;
+
+    // the client joins once its connect request arrives, or times out if it never does
+}
+
+static void disconnect_client(struct client *client)
+{
+    log_info("Disconnecting from client %s", client->address);
+    metrics.disconnected++;
+
+    // inform other clients, who only know of the client if it joined
+    if (client->joined)
+    {
+        struct id_data id_data = id_data_create(DATA_DISCONNECT_BROADCAST, client->id);
+        broadcast(&id_data.data, client->id);
+    }
+
+    // close the TCP connection and uninitialize the client
+    close_client(client);
+
+    // log the current number of clients
+    log_info("There are %d clients connected", num_clients);
+}
+
+static void expire_clients(void)
+{
+    // a slot is expired once its time has fully passed, everyone still in it hasn't been heard from since
+    while ((Sint32)(loop_time - timeout_time) >= TIMEOUT_RESOLUTION)
+    {
+        int *head = &timeout_wheel[timeout_time / TIMEOUT_RESOLUTION % TIMEOUT_SLOTS];
+        while (*head != -1)
+        {
+            struct client *client = &clients[*head];
+            log_info("Client %s timed out", client->address);
+            metrics.timeouts++;
+            disconnect_client(client);
+        }
+
+        timeout_time += TIMEOUT_RESOLUTION;
+    }
+}
+
+static int next_packet(UDPsocket udp_socket, UDPpacket **udp_packets, int count)
+{
+    // the send batch is sent once it is full
+    if (++count == UDP_MAX_BATCH)
+    {
+        SDLNet_UDP_SendBatch(udp_socket, udp_packets, count);
+        count = 0;
+    }
+
+    return count;
+}
+
+static int write_batch(UDPsocket udp_socket, UDPpacket **udp_packets, int count, struct client *client)
+{
+    // the client's messages become the next datagram of the send batch
+    if (client->batch->count == 0)
+    {
+        return count;
+    }
+
+    datagrams_out++;
+    datagram_messages_out += client->batch->count;
+    metrics.datagrams_out++;
+    metrics.datagram_messages_out += client->batch->count;
+
+    udp_packets[count]->address = client->udp_address;
+    udp_packets[count]->len = batch_flush(client->batch, udp_packets[count]->data);
+
+    return next_packet(udp_socket, udp_packets, count);
+}
+
+static int write_fragments(UDPsocket udp_socket, UDPpacket **udp_packets, int count, struct client *client, const unsigned char *data, int len)
+{
+    // every fragment is a datagram of its own in the send batch
+    int fragments = fragment_count(len, mtu);
+    fragment_id++;
+
+    datagrams_out += fragments;
+    datagram_messages_out++;
+    fragmented_out++;
+    metrics.datagrams_out += fragments;
+    metrics.datagram_messages_out++;
+    metrics.fragmented_out++;
+
+    for (int i = 0; i < fragments; i++)
+    {
+        udp_packets[count]->address = client->udp_address;
+        udp_packets[count]->len = fragment_write(udp_packets[count]->data, fragment_id, i, fragments, data, len);
+        count = next_packet(udp_socket, udp_packets, count);
+    }
+
+    return count;
+}
+
+static int send_udp(UDPsocket udp_socket, UDPpacket **udp_packets, int count, struct client *client, const unsigned char *data, int len)
+{
+    // held until the end of the loop iteration, unless the client's datagram is already full, and a
+    // message too large for a datagram even on its own goes out in fragments straight away
+    if (!batch_add(client->batch, mtu, data, len))
+    {
+        count = write_batch(udp_socket, udp_packets, count, client);
+        if (!batch_add(client->batch, mtu, data, len))
+        {
+            count = write_fragments(udp_socket, udp_packets, count, client, data, len);
+        }
+    }
+
+    mark_pending(client);
+
+    return count;
+}
+
+static void ping_clients(UDPsocket udp_socket, UDPpacket **udp_packets)
+{
+    // clients without a UDP address are pinged over their reliable connection, once they have joined
+    Uint32 time = SDL_GetTicks();
+    int count = 0;
+    for (int i = 0; i < num_clients; i++)
+    {
+        struct client *client = &clients[active_clients[i]];
+        if (!client->joined)
+        {
+            continue;
+        }
+
+        struct ping_data ping_data = ping_data_create(DATA_PING, client->id, 0, time);
+        if (!client->udp_connected)
+        {
+            send_data(client, &ping_data.data);
+            continue;
+        }
+
+        unsigned char data[DATA_MAX_ENCODED_SIZE];
+        int len = data_encode(&ping_data.data, data, sizeof(data));
+        count = send_udp(udp_socket, udp_packets, count, client, data, len);
+        metrics_count_out(&metrics, DATA_PING, len, 1);
+    }
+
+    if (count > 0)
+    {
+        SDLNet_UDP_SendBatch(udp_socket, udp_packets, count);
+    }
+}
+
+static void sample_rtt(struct client *client, Uint32 server_time)
+{
+    // a reply to a ping from longer ago than the timeout can't be one of ours
+    Uint32 sample = SDL_GetTicks() - server_time;
+    if (sample > CLIENT_TIMEOUT)
+    {
+        return;
+    }
+
+    histogram_add(&metrics.rtt, sample * 1000);
+
+    if (!client->has_rtt)
+    {
+        client->has_rtt = true;
+        client->rtt = (float)sample;
+        client->rtt_variation = (float)sample / 2;
+        return;
+    }
+
+    float difference = client->rtt - (float)sample;
+    client->rtt_variation += ((difference < 0 ? -difference : difference) - client->rtt_variation) / 4;
+    client->rtt += ((float)sample - client->rtt) / 8;
+}
+
+static int write_channel(UDPsocket udp_socket, UDPpacket **udp_packets, int count, struct client *client)
+{
+    // a channel can have more due than fits one datagram, full batches are sent as they fill
+    Uint32 now = SDL_GetTicks();
+    int len;
+    while ((len = channel_write(client->channel, udp_packets[count]->data, mtu, now)) > 0)
+    {
+        udp_packets[count]->address = client->udp_address;
+        udp_packets[count]->len = len;
+        bytes_sent += len;
+        metrics_count_out(&metrics, DATA_CHANNEL, len, 1);
+
+        if (++count == UDP_MAX_BATCH)
+        {
+            SDLNet_UDP_SendBatch(udp_socket, udp_packets, count);
+            count = 0;
+        }
+    }
+
+    return count;
+}
+
+static void flush_clients(UDPsocket udp_socket, UDPpacket **udp_packets)
+{
+    int count = 0;
+
+    // removing a client moves the last pending one into its place, and
+    // disconnects can queue more data, so the list is walked until it stops changing
+    int i = 0;
+    while (i < num_pending)
+    {
+        struct client *client = &clients[pending_clients[i]];
+
+        if (client->overflowed)
+        {
+            log_info("Client %s is not keeping up", client->address);
+            disconnect_client(client);
+            continue;
+        }
+
+        // datagrams are never partially written, so a client is done once its datagrams are batched
+        if (client->udp_connected)
+        {
+            count = write_batch(udp_socket, udp_packets, count, client);
+        }
+        if (client->channel)
+        {
+            count = write_channel(udp_socket, udp_packets, count, client);
+        }
+        remove_pending(client);
+    }
+
+    if (count > 0)
+    {
+        SDLNet_UDP_SendBatch(udp_socket, udp_packets, count);
+    }
+
+    // TCP output is written by the I/O threads
+    for (int i = 0; i < num_io_threads; i++)
+    {
+        io_flush(io_threads[i]);
+    }
+}
+
+static void handle_message(struct client *client, struct data *data)
+{
+    // nothing but the connect request is taken from a TCP client before it has joined
+    if (!client->joined && data->type != DATA_CONNECT_REQUEST)
+    {
+        log_warn("Client %s sent a message before connecting", client->address);
+        disconnect_client(client);
+        return;
+    }
+
+    switch (data->type)
+    {
+    case DATA_CONNECT_REQUEST:
+    {
+        if (client->joined)
+        {
+            log_warn("Client %s is already connected", client->address);
+            break;
+        }
+
+        struct connect_data *connect_data = (struct connect_data *)data;
+        join_client(client, connect_data->features);
+    }
+    break;
+    case DATA_DISCONNECT_REQUEST:
+    {
+        disconnect_client(client);
+    }
+    break;
+    case DATA_CHAT_REQUEST:
+    {
+        struct chat_data *chat_data = (struct chat_data *)data;
+        log_info("Client %d: %.*s", chat_data->id, chat_data->length, chat_data->message);
+
+        // relay to other clients, attributed to the connection it came from, the text is encoded
+        // straight out of the buffer the request was received in
+        struct chat_data chat_data2 = *chat_data;
+        chat_data2.data = data_create(DATA_CHAT_BROADCAST);
+        chat_data2.id = client->id;
+        broadcast(&chat_data2.data, client->id);
+        record_chat(&chat_data2);
+    }
+    break;
+    case DATA_PONG:
+    {
+        struct ping_data *ping_data = (struct ping_data *)data;
+        sample_rtt(client, ping_data->server_time);
+    }
+    break;
+    default:
+    {
+        log_warn("Unknown message type from client %s", client->address);
+    }
+    break;
+    }
+}
+
+static struct client *find_udp_client(int id, const IPaddress *address)
+{
+    // datagrams are only accepted from the address the client registered, and any that are show it's still there
+    struct client *client = find_client(id);
+    if (!client ||
+        !client->udp_connected ||
+        client->udp_address.host != address->host ||
+        client->udp_address.port != address->port)
+    {
+        return NULL;
+    }
+
+    touch_client(client);
+
+    return client;
+}
+
+static struct client *find_channel_client(const IPaddress *address)
+{
+    // only datagrams sent before the client learns its ID are looked up by address
+    for (int slot = *address_bucket(address); slot != -1; slot = clients[slot].address_next)
+    {
+        struct client *client = &clients[slot];
+        if (client->udp_address.host == address->host &&
+            client->udp_address.port == address->port)
+        {
+            return client;
+        }
+    }
+
+    return NULL;
+}
+
+static struct client *connect_channel_client(UDPsocket udp_socket,
+                                             UDPpacket *reply,
+                                             const IPaddress *address,
+                                             const Uint8 *datagram,
+                                             int datagram_len)
+{
+    // only a connect request with the cookie the client was sent for its address takes a slot, so
+    // datagrams from addresses that never see a reply can't fill the table
+    const Uint8 *request;
+    int request_len = channel_peek_first(datagram, datagram_len, &request);
+    union data_any message;
+    if (request_len == -1 ||
+        data_decode(&message, request, request_len) == -1 ||
+        message.data.type != DATA_CONNECT_REQUEST ||
+        !cookie_check(&cookie_key, address, message.connect_data.cookie, loop_time))
+    {
+        log_debug("UDP: Connect request without a valid cookie");
+        return NULL;
+    }
+
+    // take a free slot
+    int slot = alloc_client();
+    if (slot == -1)
+    {
+        log_info("A client tried to connect, but the server is full");
+
+        // reply with a bare datagram, there is no channel to send it on
+        struct data data = data_create(DATA_CONNECT_FULL);
+        reply->address = *address;
+        reply->len = data_encode(&data, reply->data, reply->maxlen);
+        SDLNet_UDP_Send(udp_socket, -1, reply);
+        metrics_count_out(&metrics, DATA_CONNECT_FULL, reply->len, 1);
+        metrics.rejected++;
+        return NULL;
+    }
+
+    struct client *client = &clients[slot];
+    client->channel = channel_alloc(client->id, send_queue_size);
+    if (!client->channel)
+    {
+        log_error("%s", SDLNet_GetError());
+        free_client(slot);
+        return NULL;
+    }
+
+    if (!connect_udp(client, address))
+    {
+        log_error("%s", SDLNet_GetError());
+        channel_free(client->channel);
+        free_client(slot);
+        return NULL;
+    }
+
+    SDLNet_FormatAddress(address, client->address, sizeof(client->address));
+
+    return client;
+}
+
+static void handle_channel_packet(UDPsocket udp_socket,
+                                  UDPpacket *reply,
+                                  const IPaddress *address,
+                                  const Uint8 *datagram,
+                                  int datagram_len)
+{
+    metrics_count_in(&metrics, DATA_CHANNEL, datagram_len);
+
+    // a client that has not been given an ID yet can only be connecting
+    int id = channel_peek_id(datagram, datagram_len);
+    if (id == -1)
+    {
+        log_warn("UDP: Malformed packet");
+        return;
+    }
+
+    struct client *client = id != 0 ? find_udp_client(id, address) : find_channel_client(address);
+    if (!client && id == 0)
+    {
+        client = connect_channel_client(udp_socket, reply, address, datagram, datagram_len);
+    }
+
+    if (!client || !client->channel)
+    {
+        return;
+    }
+
+    if (channel_read(client->channel, datagram, datagram_len, SDL_GetTicks()) == -1)
+    {
+        log_warn("UDP: %s from client %s", SDLNet_GetError(), client->address);
+        if (!client->joined)
+        {
+            close_client(client);
+        }
+        return;
+    }
+
+    // whatever arrived has to be acknowledged
+    touch_client(client);
+    mark_pending(client);
+
+    // handling a message can disconnect the client
+    id = client->id;
+    const Uint8 *buffer;
+    int len;
+    while (client->id == id && channel_next(client->channel, &buffer, &len))
+    {
+        union data_any message;
+        if (data_decode(&message, buffer, len) == -1)
+        {
+            log_warn("UDP: Malformed message from client %s", client->address);
+            continue;
+        }
+
+        metrics_count_in(&metrics, message.data.type, len);
+
+        if (message.data.type == DATA_CONNECT_REQUEST)
+        {
+            if (!client->joined)
+            {
+                join_client(client, message.connect_data.features);
+            }
+            continue;
+        }
+
+        if (client->joined)
+        {
+            handle_message(client, &message.data);
+        }
+    }
+
+    // the first message on a new channel has to be the connect request
+    if (client->id == id && !client->joined)
+    {
+        close_client(client);
+    }
+}
+
+static int clamp(int value, int min, int max)
+{
+    return value < min ? min : value > max ? max : value;
+}
+
+static const struct encoded_view *encode_view(int cell, unsigned int time)
+{
+    // gathered the first time a client in the cell needs it this tick
+    struct encoded_view *encoded_view = &encoded_views[cell];
+    if (encoded_view->sequence != tick_count)
+    {
+        struct snapshot_data *view = &views[tick_count % SNAPSHOT_HISTORY][cell];
+        *view = snapshot_data_create(DATA_SNAPSHOT, tick_count, time);
+
+        // a snapshot holds at most SNAPSHOT_MAX_CLIENTS, in a crowd the nearest are kept and the rest of
+        // the neighbouring cells are left out, which is counted so it doesn't go unnoticed
+        view->num_clients = interest_gather(&interest_grid, cell, world, view->clients, SNAPSHOT_MAX_CLIENTS);
+        int left_out = interest_count(&interest_grid, cell) - view->num_clients;
+        if (left_out > 0)
+        {
+            truncated_views++;
+            truncated_clients += (Uint64)left_out;
+            metrics.truncated_views++;
+            metrics.truncated_clients += (Uint64)left_out;
+        }
+
+        encoded_view->sequence = tick_count;
+        encoded_view->len = data_encode(&view->data, encoded_view->data, sizeof(encoded_view->data));
+    }
+
+    return encoded_view;
+}
+
+static const struct encoded_delta *encode_delta(unsigned int baseline, int baseline_cell, int cell)
+{
+    unsigned int hash = (baseline * INTEREST_CELLS + (unsigned int)baseline_cell) * INTEREST_CELLS + (unsigned int)cell;
+    struct encoded_delta *encoded_delta = &encoded_deltas[hash % DELTA_CACHE_SIZE];
+    if (encoded_delta->sequence != tick_count ||
+        encoded_delta->baseline != baseline ||
+        encoded_delta->baseline_cell != baseline_cell ||
+        encoded_delta->cell != cell)
+    {
+        struct delta_data delta_data = delta_data_create(DATA_SNAPSHOT_DELTA,
+                                                         &views[baseline % SNAPSHOT_HISTORY][baseline_cell],
+                                                         &views[tick_count % SNAPSHOT_HISTORY][cell]);
+
+        encoded_delta->sequence = tick_count;
+        encoded_delta->baseline = baseline;
+        encoded_delta->baseline_cell = baseline_cell;
+        encoded_delta->cell = cell;
+        encoded_delta->len = data_encode(&delta_data.data, encoded_delta->data, sizeof(encoded_delta->data));
+    }
+
+    return encoded_delta;
+}
+
+static void tick(UDPsocket udp_socket, UDPpacket **udp_packets)
+{
+    tick_count++;
+
+    // apply the input gathered since the last tick
+    for (int i = 0; i < num_clients; i++)
+    {
+        struct client *client = &clients[active_clients[i]];
+
+        client->state.x = clamp(client->input.x, 0, WORLD_WIDTH - 1);
+        client->state.y = clamp(client->input.y, 0, WORLD_HEIGHT - 1);
+        client->state.buttons = client->input.buttons | client->pressed;
+        client->pressed = 0;
+        world[i] = client->state;
+
+        // unacknowledged messages are retransmitted from the flush once their timeout expires
+        if (client->channel && !channel_idle(client->channel))
+        {
+            mark_pending(client);
+        }
+    }
+
+    // sort everyone into the cells they are in, so each view only looks at its neighbourhood
+    if (!interest_grid_build(&interest_grid, world, num_clients))
+    {
+        log_error("%s", SDLNet_GetError());
+
+        // nobody is sent this tick's snapshot, so nobody can acknowledge it
+        for (int i = 0; i < num_clients; i++)
+        {
+            clients[active_clients[i]].view_cells[tick_count % SNAPSHOT_HISTORY] = VIEW_CELL_NONE;
+        }
+        return;
+    }
+
+    // queue a snapshot for every client, to go out with whatever else it is sent this loop iteration
+    Uint32 time = SDL_GetTicks();
+    int count = 0;
+    for (int i = 0; i < num_clients; i++)
+    {
+        struct client *client = &clients[active_clients[i]];
+        if (!client->udp_connected)
+        {
+            continue;
+        }
+
+        int cell = interest_cell(client->state.x, client->state.y);
+        const struct encoded_view *encoded_view = encode_view(cell, time);
+        client->view_cells[tick_count % SNAPSHOT_HISTORY] = (Uint8)cell;
+
+        // delta against the newest snapshot the client acknowledged while it is still kept, from the
+        // view it was sent then, otherwise send everything
+        const unsigned char *data = encoded_view->data;
+        int data_len = encoded_view->len;
+        int baseline_cell = client->view_cells[client->acked % SNAPSHOT_HISTORY];
+        if (client->acked != 0 &&
+            baseline_cell < INTEREST_CELLS &&
+            tick_count - client->acked < SNAPSHOT_HISTORY &&
+            views[client->acked % SNAPSHOT_HISTORY][baseline_cell].sequence == client->acked)
+        {
+            const struct encoded_delta *encoded_delta = encode_delta(client->acked, baseline_cell, cell);
+            if (encoded_delta->len != -1 && encoded_delta->len < data_len)
+            {
+                data = encoded_delta->data;
+                data_len = encoded_delta->len;
+            }
+        }
+
+        if (data == encoded_view->data)
+        {
+            full_snapshots++;
+            metrics_count_out(&metrics, DATA_SNAPSHOT, data_len, 1);
+        }
+        else
+        {
+            delta_snapshots++;
+            metrics_count_out(&metrics, DATA_SNAPSHOT_DELTA, data_len, 1);
+        }
+        snapshot_bytes += data_len;
+
+        count = send_udp(udp_socket, udp_packets, count, client, data, data_len);
+    }
+
+    if (count > 0)
+    {
+        SDLNet_UDP_SendBatch(udp_socket, udp_packets, count);
+    }
+}
+
+static void handle_udp_message(UDPsocket udp_socket, UDPpacket *reply, const IPaddress *address, struct data *data)
+{
+    switch (data->type)
+    {
+    case DATA_CHALLENGE:
+    {
+        // answered without keeping anything, the cookie is made again to check it
+        struct challenge_data challenge_data = challenge_data_create(DATA_CHALLENGE, cookie_make(&cookie_key, address, loop_time));
+        reply->address = *address;
+        reply->len = data_encode(&challenge_data.data, reply->data, reply->maxlen);
+        SDLNet_UDP_Send(udp_socket, -1, reply);
+        metrics_count_out(&metrics, DATA_CHALLENGE, reply->len, 1);
+    }
+    break;
+    case DATA_UDP_CONNECT_REQUEST:
+    {
+        // a client's ID is broadcast to everyone, so only the token it was sent with it proves the
+        // request is its own, and a channel client's address is what it is known by so it never moves
+        struct connect_data *connect_data = (struct connect_data *)data;
+        struct client *client = find_client(connect_data->id);
+        if (!client || !client->joined || client->channel ||
+            connect_data->cookie != cookie_make_id(&cookie_key, client->id))
+        {
+            log_warn("UDP: Unknown client %d", connect_data->id);
+            break;
+        }
+
+        log_info("Saving UDP info of client %d", connect_data->id);
+
+        // save the UDP address
+        if (!connect_udp(client, address))
+        {
+            log_error("%s", SDLNet_GetError());
+            break;
+        }
+        touch_client(client);
+    }
+    break;
+    case DATA_MOUSEDOWN_REQUEST:
+    {
+        struct mouse_data *mouse_data = (struct mouse_data *)data;
+        log_debug("Client %d mouse down: (%d, %d)", mouse_data->id, mouse_data->x, mouse_data->y);
+
+        struct client *client = find_udp_client(mouse_data->id, address);
+        if (client)
+        {
+            client->input.x = mouse_data->x;
+            client->input.y = mouse_data->y;
+            client->pressed |= SDL_BUTTON_LMASK;
+        }
+    }
+    break;
+    case DATA_INPUT_REQUEST:
+    {
+        struct input_data *input_data = (struct input_data *)data;
+
+        // only the latest input counts, but presses in between are remembered until the next tick
+        struct client *client = find_udp_client(input_data->id, address);
+        if (client)
+        {
+            client->input.x = input_data->x;
+            client->input.y = input_data->y;
+            client->input.buttons = input_data->buttons;
+            client->pressed |= input_data->buttons;
+        }
+    }
+    break;
+    case DATA_PING:
+    {
+        struct ping_data *ping_data = (struct ping_data *)data;
+
+        // answer straight away, so the reply time is as close as possible to the middle of the round trip
+        if (find_udp_client(ping_data->id, address))
+        {
+            struct ping_data pong_data = ping_data_create(DATA_PONG, ping_data->id, ping_data->client_time, SDL_GetTicks());
+            reply->address = *address;
+            reply->len = data_encode(&pong_data.data, reply->data, reply->maxlen);
+            SDLNet_UDP_Send(udp_socket, -1, reply);
+            metrics_count_out(&metrics, DATA_PONG, reply->len, 1);
+        }
+    }
+    break;
+    case DATA_PONG:
+    {
+        struct ping_data *ping_data = (struct ping_data *)data;
+
+        struct client *client = find_udp_client(ping_data->id, address);
+        if (client)
+        {
+            sample_rtt(client, ping_data->server_time);
+        }
+    }
+    break;
+    case DATA_SNAPSHOT_ACK:
+    {
+        struct ack_data *ack_data = (struct ack_data *)data;
 
-static struct client clients[MAX_CLIENTS];
+        // acknowledgements can arrive out of order, and only count for a recent snapshot the client
+        // was sent, not one from before it connected or one it missed
+        struct client *client = find_udp_client(ack_data->id, address);
+        if (client &&
+            (int)(ack_data->sequence - client->acked) > 0 &&
+            (int)(tick_count - ack_data->sequence) >= 0 &&
+            tick_count - ack_data->sequence < SNAPSHOT_HISTORY &&
+            client->view_cells[ack_data->sequence % SNAPSHOT_HISTORY] != VIEW_CELL_NONE)
+        {
+            client->acked = ack_data->sequence;
+        }
+    }
+    break;
+    default:
+    {
+        log_warn("UDP: Unknown packet type");
+    }
+    break;
+    }
+}
 
-static int count_clients(void)
+static void handle_datagram(UDPsocket udp_socket, UDPpacket *reply, const IPaddress *address, const Uint8 *datagram, int len)
 {
-    int num_clients = 0;
-    for (int i = 0; i < MAX_CLIENTS; i++)
+    // reliable messages are wrapped in a channel datagram, everything else is a bare message or a batch of them
+    if (data_peek_type(datagram, len) == DATA_CHANNEL)
     {
-        if (clients[i].id != -1)
+        handle_channel_packet(udp_socket, reply, address, datagram, len);
+        return;
+    }
+
+    datagrams_in++;
+    metrics.datagrams_in++;
+
+    int pos = 0;
+    const unsigned char *buffer;
+    int buffer_len;
+    while ((buffer_len = batch_next(datagram, len, &pos, &buffer)) > 0)
+    {
+        union data_any message;
+        if (data_decode(&message, buffer, buffer_len) == -1)
         {
-            num_clients++;
+            break;
         }
+
+        datagram_messages_in++;
+        metrics.datagram_messages_in++;
+        metrics_count_in(&metrics, message.data.type, buffer_len);
+        handle_udp_message(udp_socket, reply, address, &message.data);
+    }
+
+    if (buffer_len != 0)
+    {
+        log_warn("UDP: Malformed packet");
     }
-    return num_clients;
 }
 
-static void broadcast(void *data, int len, int exclude_id)
+static void take_counters(void)
 {
-    for (int i = 0; i < MAX_CLIENTS; i++)
+    // the counters kept by the allocator and the I/O threads are taken by whichever of the report and
+    // the metrics comes first, so both add them up
+    int allocated = alloc_count_take();
+    allocations += allocated;
+    metrics.allocations += allocated;
+
+    for (int i = 0; i < num_io_threads; i++)
+    {
+        Uint32 sent = (Uint32)SDL_AtomicSet(&io_threads[i]->bytes_sent, 0);
+        bytes_sent += sent;
+        metrics.bytes_written += sent;
+        metrics.overflowed += (Uint32)SDL_AtomicSet(&io_threads[i]->overflows, 0);
+    }
+}
+
+static void handle_events(struct io_thread *io, UDPsocket udp_socket, UDPpacket *reply)
+{
+    // messages are decoded from the bytes the I/O thread handed over, and the entry is only given back after
+    struct io_event *event;
+    while ((event = ring_peek(io->events)))
     {
-        if (clients[i].id != -1 && clients[i].id != exclude_id)
+        // how long it waited since the I/O thread handed it over
+        Uint64 waited = SDL_GetPerformanceCounter() - event->time;
+        histogram_add(&metrics.event_latency, (Uint32)(waited * 1000000 / frequency));
+
+        // datagrams from a share of the UDP port are handled like the ones read here
+        if (event->type == IO_EVENT_DATAGRAM)
+        {
+            handle_datagram(udp_socket, reply, &event->address, event->data, event->len);
+            ring_release(io->events);
+            continue;
+        }
+
+        // the client may have been disconnected since the I/O thread read this
+        struct client *client = find_client(event->id);
+        if (client && event->type == IO_EVENT_CLOSED)
+        {
+            // the connection is already gone, so there is nothing to tell the I/O thread
+            client->io = NULL;
+            disconnect_client(client);
+        }
+        else if (client)
         {
-            SDLNet_TCP_SendExt(clients[i].socket, data, len);
+            union data_any message;
+            if (data_decode(&message, event->data, event->len) == -1)
+            {
+                log_warn("TCP: Malformed packet from client %s", client->address);
+            }
+            else
+            {
+                metrics_count_in(&metrics, message.data.type, event->len);
+                touch_client(client);
+                handle_message(client, &message.data);
+            }
         }
+
+        ring_release(io->events);
     }
+
+    // the I/O thread may have stopped reading until there was room for more
+    io_drained(io);
 }
 
 int server_main(int argc, char *argv[])
 {
+    // parse options
+    Uint32 max_wait = LOOP_DEFAULT_MAX_WAIT;
+    int tick_rate = DEFAULT_TICK_RATE;
+    bool reuse_port = false;
+    int metrics_port = 0;
+    const char *metrics_address = METRICS_DEFAULT_ADDRESS;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--reuse-port") == 0)
+        {
+            reuse_port = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            break;
+        }
+        if (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--max-wait") == 0)
+        {
+            max_wait = (Uint32)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--max-clients") == 0)
+        {
+            int value = atoi(argv[++i]);
+            max_clients = SDL_max(1, SDL_min(value, MAX_CLIENTS));
+        }
+        else if (strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "--send-queue") == 0)
+        {
+            int value = atoi(argv[++i]);
+            send_queue_size = SDL_max(TCP_HEADER_SIZE + DATA_MAX_ENCODED_SIZE, value);
+        }
+        else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--tick-rate") == 0)
+        {
+            int value = atoi(argv[++i]);
+            tick_rate = SDL_max(1, SDL_min(value, 1000));
+        }
+        else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--io-threads") == 0)
+        {
+            int value = atoi(argv[++i]);
+            num_io_threads = SDL_max(1, SDL_min(value, IO_MAX_THREADS));
+        }
+        else if (strcmp(argv[i], "--slow-clients") == 0)
+        {
+            overflow_policy = strcmp(argv[++i], "drop") == 0 ? OVERFLOW_DROP : OVERFLOW_DISCONNECT;
+        }
+        else if (strcmp(argv[i], "--mtu") == 0)
+        {
+            int value = atoi(argv[++i]);
+            mtu = SDL_max(BATCH_MIN_MTU, SDL_min(value, PACKET_SIZE));
+        }
+        else if (strcmp(argv[i], "--compress-threshold") == 0)
+        {
+            int value = atoi(argv[++i]);
+            compress_threshold = SDL_max(0, value);
+        }
+        else if (strcmp(argv[i], "--metrics-port") == 0)
+        {
+            int value = atoi(argv[++i]);
+            metrics_port = SDL_max(0, SDL_min(value, 65535));
+        }
+        else if (strcmp(argv[i], "--metrics-address") == 0)
+        {
+            metrics_address = argv[++i];
+        }
+    }
+
+    // count allocations from the start, so the report shows whether the loop makes any once warmed up
+    if (!alloc_count_install())
+    {
+        log_error("%s", SDL_GetError());
+        return 1;
+    }
+
     // init SDL
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
     {
-        printf("Error: %s\n", SDL_GetError());
+        log_error("%s", SDL_GetError());
         return 1;
     }
 
     // init SDL_net
     if (SDLNet_Init() != 0)
     {
-        printf("Error: %s\n", SDLNet_GetError());
+        log_error("%s", SDLNet_GetError());
+        return 1;
+    }
+
+    // the socket handles are read from SDL_net's own structures, so make sure that still works
+    if (SDLNet_CheckSocketHandles() != 0)
+    {
+        log_error("%s", SDLNet_GetError());
         return 1;
     }
 
@@ -64,7 +1755,7 @@ int server_main(int argc, char *argv[])
     IPaddress server_address;
     if (SDLNet_ResolveHost(&server_address, INADDR_ANY, SERVER_PORT))
     {
-        printf("Error: %s\n", SDLNet_GetError());
+        log_error("%s", SDLNet_GetError());
         return 1;
     }
 
@@ -72,234 +1763,392 @@ int server_main(int argc, char *argv[])
     TCPsocket tcp_socket = SDLNet_TCP_Open(&server_address);
     if (!tcp_socket)
     {
-        printf("Error: %s\n", SDLNet_GetError());
+        log_error("%s", SDLNet_GetError());
         return 1;
     }
 
     {
-        const char *host = SDLNet_ResolveIP(&server_address);
-        unsigned short port = SDLNet_Read16(&server_address.port);
-        printf("TCP: Listening on %s:%i", host, port);
+        char address[ADDRESS_STRLEN];
+        log_info("TCP: Listening on %s", SDLNet_FormatAddress(&server_address, address, sizeof(address)));
+    }
+
+    // open UDP socket, or one for each I/O thread sharing the port so the kernel spreads the clients over them
+    UDPsocket udp_sockets[IO_MAX_THREADS];
+    int num_udp_sockets = reuse_port ? num_io_threads : 1;
+    for (int i = 0; i < num_udp_sockets; i++)
+    {
+        udp_sockets[i] = reuse_port ? SDLNet_UDP_OpenShared(SERVER_PORT) : SDLNet_UDP_Open(SERVER_PORT);
+        if (!udp_sockets[i])
+        {
+            log_error("%s", SDLNet_GetError());
+            return 1;
+        }
+    }
+
+    // any socket bound to the port can send from it, so everything goes out through the first
+    UDPsocket udp_socket = udp_sockets[0];
+
+    // allocate UDP packets to receive and send batches with
+    UDPpacket **udp_packets = SDLNet_AllocPacketV(UDP_MAX_BATCH, PACKET_SIZE);
+    if (!udp_packets)
+    {
+        log_error("%s", SDLNet_GetError());
+        return 1;
     }
 
-    // allocate TCP packet
-    TCPpacket *tcp_packet = SDLNet_TCP_AllocPacket(PACKET_SIZE);
-    if (!tcp_packet)
+    UDPpacket **udp_send_packets = SDLNet_AllocPacketV(UDP_MAX_BATCH, PACKET_SIZE);
+    if (!udp_send_packets)
     {
-        printf("Error: %s\n", SDLNet_GetError());
+        log_error("%s", SDLNet_GetError());
         return 1;
     }
 
-    // open UDP socket
-    UDPsocket udp_socket = SDLNet_UDP_Open(SERVER_PORT);
-    if (!udp_socket)
+    // replies are written into a packet of their own, the datagram they answer may hold more messages
+    UDPpacket *udp_reply = SDLNet_UDP_AllocPacket(PACKET_SIZE);
+    if (!udp_reply)
     {
-        printf("Error: %s\n", SDLNet_GetError());
+        log_error("%s", SDLNet_GetError());
         return 1;
     }
 
-    // allocate UDP packet
-    UDPpacket *udp_packet = SDLNet_UDP_AllocPacket(PACKET_SIZE);
-    if (!udp_packet)
+    // compression is only offered to clients if there is a threshold
+    if (compress_threshold > 0)
+    {
+        compressor = compressor_alloc();
+        if (!compressor)
+        {
+            log_error("%s", SDLNet_GetError());
+            return 1;
+        }
+    }
+
+    // allocate poller
+    SDLNet_Poller poller = SDLNet_AllocPoller();
+    if (!poller)
     {
-        printf("Error: %s\n", SDLNet_GetError());
+        log_error("%s", SDLNet_GetError());
         return 1;
     }
 
-    // allocate socket set
-    SDLNet_SocketSet socket_set = SDLNet_AllocSocketSet(MAX_CLIENTS + 2);
-    if (!socket_set)
+    // allocate the wakeup the I/O threads use when they have messages for us
+    SDLNet_Wakeup *wakeup = SDLNet_AllocWakeup();
+    if (!wakeup)
     {
-        printf("Error: %s\n", SDLNet_GetError());
+        log_error("%s", SDLNet_GetError());
         return 1;
     }
 
-    // add TCP and UDP sockets to socket set
-    SDLNet_TCP_AddSocket(socket_set, tcp_socket);
-    SDLNet_UDP_AddSocket(socket_set, udp_socket);
+    // add TCP, UDP and wakeup sockets to poller, a shared UDP port is read by the I/O threads instead
+    SDLNet_PollerAdd(poller, tcp_socket, NULL);
+    if (!reuse_port)
+    {
+        SDLNet_PollerAdd(poller, udp_socket, NULL);
+    }
+    SDLNet_PollerAdd(poller, wakeup->socket, NULL);
+
+    // serve the metrics on their own port, only to this machine unless given an address to listen on
+    struct metrics_server metrics_server;
+    if (metrics_port != 0)
+    {
+        if (!metrics_server_open(&metrics_server, poller, metrics_address, (Uint16)metrics_port))
+        {
+            log_error("%s", SDLNet_GetError());
+            return 1;
+        }
+
+        log_info("Metrics: Serving on %s port %d", metrics_address, metrics_port);
+    }
+
+    // allocate the pool messages are encoded into
+    buffer_pool = SDLNet_AllocPool(BUFFER_BLOCK_SIZE, BUFFERS_PER_SLAB);
+    if (!buffer_pool)
+    {
+        log_error("%s", SDLNet_GetError());
+        return 1;
+    }
 
     // setup client list
-    for (int i = 0; i < MAX_CLIENTS; i++)
+    if (!grow_clients())
     {
-        clients[i].id = -1;
-        clients[i].socket = NULL;
+        log_error("Couldn't allocate client list");
+        return 1;
+    }
+
+    // start the I/O threads
+    for (int i = 0; i < num_io_threads; i++)
+    {
+        io_threads[i] = io_start(i, send_queue_size, overflow_policy, wakeup, reuse_port ? udp_sockets[i] : NULL);
+        if (!io_threads[i])
+        {
+            log_error("%s", SDLNet_GetError());
+            return 1;
+        }
     }
 
+    log_info("Started %d I/O threads%s", num_io_threads, reuse_port ? ", each with a share of the UDP port" : "");
+
+    // setup the event loop
+    struct loop loop;
+    loop_init(&loop, max_wait);
+
+    struct timer report_timer;
+    timer_init(&loop, &report_timer, REPORT_INTERVAL);
+
+    struct timer tick_timer;
+    timer_init(&loop, &tick_timer, 1000 / tick_rate);
+
+    struct timer ping_timer;
+    timer_init(&loop, &ping_timer, PING_INTERVAL);
+    bool ping_due = false;
+
+    frequency = SDL_GetPerformanceFrequency();
+    init_timeouts();
+    init_addresses();
+    cookie_key_init(&cookie_key);
+
     // main loop
     bool quit = false;
     while (!quit)
     {
-        // handle network events
-        while (SDLNet_CheckSockets(socket_set, 0) > 0)
+        // block until there are network events or a timer is due
+        int ready = loop_wait(&loop, poller);
+
+        // checked every time round, the I/O threads only send a wakeup once until it is cleared
+        SDLNet_ClearWakeup(wakeup);
+
+        loop_time = SDL_GetTicks();
+
+        if (ready > 0)
         {
             // check activity on the server
             if (SDLNet_SocketReady(tcp_socket))
             {
-                // accept new clients
-                TCPsocket socket = SDLNet_TCP_Accept(tcp_socket);
-                if (socket)
+                // accept every pending connection
+                TCPsocket socket;
+                while ((socket = SDLNet_TCP_Accept(tcp_socket)))
                 {
-                    // search for an empty client
-                    int client_id = -1;
-                    for (int i = 0; i < MAX_CLIENTS; i++)
-                    {
-                        if (clients[i].id == -1)
-                        {
-                            client_id = i;
-                            break;
-                        }
-                    }
-                    if (client_id != -1)
+                    accept_client(socket);
+                }
+            }
+
+            // handle UDP messages, receiving a batch of datagrams per system call, the ready flag of
+            // a shared socket belongs to the I/O thread reading it
+            if (!reuse_port && SDLNet_SocketReady(udp_socket))
+            {
+                for (int batch = 0; batch < UDP_BATCHES_PER_WAKEUP; batch++)
+                {
+                    int received = SDLNet_UDP_RecvBatch(udp_socket, udp_packets, UDP_MAX_BATCH);
+
+                    for (int i = 0; i < received; i++)
                     {
-                        // get socket info
-                        IPaddress *address = SDLNet_TCP_GetPeerAddress(socket);
-                        const char *host = SDLNet_ResolveIP(address);
-                        unsigned short port = SDLNet_Read16(&address->port);
-                        printf("Connected to client %s:%d\n", host, port);
-
-                        // initialize the client
-                        clients[client_id].id = client_id;
-                        clients[client_id].socket = socket;
-
-                        // add to the socket list
-                        SDLNet_TCP_AddSocket(socket_set, clients[client_id].socket);
-
-                        // send the client their info
-                        {
-                            struct id_data id_data = id_data_create(DATA_CONNECT_OK, clients[client_id].id);
-                            SDLNet_TCP_SendExt(socket, &id_data, sizeof(id_data));
-                        }
-
-                        // inform other clients
-                        struct id_data id_data = id_data_create(DATA_CONNECT_BROADCAST, clients[client_id].id);
-                        broadcast(&id_data, sizeof(id_data), clients[client_id].id);
-
-                        // log the current number of clients
-                        printf("There are %d clients connected\n", count_clients());
+                        handle_datagram(udp_socket, udp_reply, &udp_packets[i]->address, udp_packets[i]->data, udp_packets[i]->len);
                     }
-                    else
-                    {
-                        printf("A client tried to connect, but the server is full\n");
 
-                        // send client a full server message
-                        struct data data = data_create(DATA_CONNECT_FULL);
-                        SDLNet_TCP_SendExt(socket, &data, sizeof(data));
+                    if (received < UDP_MAX_BATCH)
+                    {
+                        break;
                     }
                 }
             }
+        }
+
+        // handle the TCP messages and disconnects the I/O threads have read
+        for (int i = 0; i < num_io_threads; i++)
+        {
+            handle_events(io_threads[i], udp_socket, udp_reply);
+        }
+
+        // pings wait for the next tick, so they go out in the same datagrams as the snapshots
+        if (timer_update(&loop, &ping_timer))
+        {
+            ping_due = true;
+        }
+
+        // advance the simulation at a fixed rate
+        if (timer_update(&loop, &tick_timer))
+        {
+            Uint64 start = SDL_GetPerformanceCounter();
+            tick(udp_socket, udp_send_packets);
+            histogram_add(&metrics.tick_time, (Uint32)((SDL_GetPerformanceCounter() - start) * 1000000 / frequency));
+
+            // only the clients due in the slots passed since the last tick are looked at
+            expire_clients();
+
+            if (ping_due)
+            {
+                ping_clients(udp_socket, udp_send_packets);
+                ping_due = false;
+            }
+        }
+
+        // write out everything queued during this iteration
+        flush_clients(udp_socket, udp_send_packets);
+
+        // the gauges are only gathered from the I/O threads when someone asks for them
+        if (metrics_port != 0 && metrics_server_update(&metrics_server, poller, loop_time))
+        {
+            take_counters();
+
+            metrics.clients = num_clients;
+            metrics.queued_bytes = 0;
+            metrics.max_queued_bytes = 0;
+            for (int i = 0; i < num_io_threads; i++)
+            {
+                int max_queued_bytes = SDL_AtomicSet(&io_threads[i]->max_queued_bytes, 0);
+                metrics.queued_bytes += SDL_AtomicGet(&io_threads[i]->queued_bytes);
+                metrics.max_queued_bytes = SDL_max(metrics.max_queued_bytes, max_queued_bytes);
+            }
+
+            metrics_server_respond(&metrics_server, poller, &metrics);
+        }
 
-            // check activity on each client
-            for (int i = 0; i < MAX_CLIENTS; i++)
+        // report how promptly timers are being serviced and what the output cost
+        if (timer_update(&loop, &report_timer))
+        {
+            loop_report(&loop);
+            take_counters();
+
+            // shows whether the kernel is spreading the clients evenly over the shares of the port
+            if (reuse_port)
             {
-                if (clients[i].id != -1)
+                char rates[IO_MAX_THREADS * 12];
+                int len = 0;
+                for (int i = 0; i < num_io_threads; i++)
                 {
-                    // handle TCP messages
-                    if (SDLNet_SocketReady(clients[i].socket))
-                    {
-                        if (SDLNet_TCP_RecvExt(clients[i].socket, tcp_packet) == 1)
-                        {
-                            struct data *data = (struct data *)tcp_packet->data;
-                            switch (data->type)
-                            {
-                            case DATA_DISCONNECT_REQUEST:
-                            {
-                                // get socket info
-                                IPaddress *address = SDLNet_TCP_GetPeerAddress(clients[i].socket);
-                                const char *host = SDLNet_ResolveIP(address);
-                                unsigned short port = SDLNet_Read16(&address->port);
-                                printf("Disconnecting from client %s:%d\n", host, port);
-
-                                // inform other clients
-                                struct id_data id_data = id_data_create(DATA_DISCONNECT_BROADCAST, clients[i].id);
-                                broadcast(&id_data, sizeof(id_data), clients[i].id);
-
-                                // close the TCP connection
-                                SDLNet_TCP_DelSocket(socket_set, clients[i].socket);
-                                SDLNet_TCP_Close(clients[i].socket);
-
-                                // uninitialize the client
-                                clients[i].id = -1;
-                                clients[i].socket = NULL;
-
-                                // log the current number of clients
-                                printf("There are %d clients connected\n", count_clients());
-                            }
-                            break;
-                            case DATA_CHAT_REQUEST:
-                            {
-                                struct chat_data *chat_data = (struct chat_data *)data;
-                                printf("Client %d: %s\n", chat_data->id, chat_data->message);
-
-                                // relay to other clients
-                                struct chat_data chat_data2 = chat_data_create(DATA_CHAT_BROADCAST, chat_data->id, chat_data->message);
-                                broadcast(&chat_data2, sizeof(chat_data2), clients[i].id);
-                            }
-                            break;
-                            default:
-                            {
-                                printf("TCP: Unknown packet type\n");
-                            }
-                            break;
-                            }
-                        }
-                    }
+                    int datagrams = SDL_AtomicSet(&io_threads[i]->datagrams, 0);
+                    len += snprintf(rates + len, sizeof(rates) - len, " %d", datagrams * 1000 / REPORT_INTERVAL);
                 }
+
+                log_info("UDP shards: datagrams/s%s", rates);
             }
 
-            // handle UDP messages
-            if (SDLNet_SocketReady(udp_socket))
+            log_info("Output: %llu bytes encoded, %llu bytes sent",
+                     (unsigned long long)bytes_encoded,
+                     (unsigned long long)bytes_sent);
+
+            log_info("Snapshots: %llu full, %llu deltas, %llu bytes sent",
+                     (unsigned long long)full_snapshots,
+                     (unsigned long long)delta_snapshots,
+                     (unsigned long long)snapshot_bytes);
+
+            if (truncated_views > 0)
             {
-                if (SDLNet_UDP_RecvExt(udp_socket, udp_packet) == 1)
-                {
-                    struct data *data = (struct data *)udp_packet->data;
-                    switch (data->type)
-                    {
-                    case DATA_UDP_CONNECT_REQUEST:
-                    {
-                        struct id_data *id_data = (struct id_data *)data;
-                        printf("Saving UDP info of client %d\n", id_data->id);
+                log_warn("Snapshots: %llu views had more than %d clients around them, %llu clients were left out",
+                         (unsigned long long)truncated_views,
+                         SNAPSHOT_MAX_CLIENTS,
+                         (unsigned long long)truncated_clients);
+            }
 
-                        // save the UDP address
-                        clients[id_data->id].udp_address = udp_packet->address;
-                    }
-                    break;
-                    case DATA_MOUSEDOWN_REQUEST:
-                    {
-                        struct mouse_data *mouse_data = (struct mouse_data *)data;
-                        printf("Client %d mouse down: (%d, %d)\n", mouse_data->id, mouse_data->x, mouse_data->y);
-                    }
-                    break;
-                    default:
-                    {
-                        printf("UDP: Unknown packet type\n");
-                    }
-                    break;
-                    }
+            log_info("Catch-ups: %llu sent in %llu messages",
+                     (unsigned long long)catch_ups,
+                     (unsigned long long)catch_up_messages);
+
+            log_info("Compression: %llu bytes in, %llu out, ratio %.2f, %.2f ns/byte",
+                     (unsigned long long)compress_bytes_in,
+                     (unsigned long long)compress_bytes_out,
+                     compress_bytes_out > 0 ? (double)compress_bytes_in / compress_bytes_out : 0.0,
+                     compress_bytes_in > 0 ? (double)compress_ticks * 1000000000 / frequency / compress_bytes_in : 0.0);
+
+            log_info("Datagrams: %llu out with %.2f messages each, %llu messages fragmented, %llu in with %.2f messages each",
+                     (unsigned long long)datagrams_out,
+                     datagrams_out > 0 ? (double)datagram_messages_out / datagrams_out : 0.0,
+                     (unsigned long long)fragmented_out,
+                     (unsigned long long)datagrams_in,
+                     datagrams_in > 0 ? (double)datagram_messages_in / datagrams_in : 0.0);
+
+            // the smoothed round trip times of the clients that have answered a ping
+            float rtt = 0;
+            float rtt_variation = 0;
+            int num_rtts = 0;
+            for (int i = 0; i < num_clients; i++)
+            {
+                struct client *client = &clients[active_clients[i]];
+                if (client->has_rtt)
+                {
+                    rtt += client->rtt;
+                    rtt_variation += client->rtt_variation;
+                    num_rtts++;
                 }
             }
+
+            log_info("Clients: %d connected, mean rtt %.1f ms, mean rtt variation %.1f ms, %llu timed out",
+                     num_clients,
+                     num_rtts > 0 ? rtt / num_rtts : 0.0f,
+                     num_rtts > 0 ? rtt_variation / num_rtts : 0.0f,
+                     (unsigned long long)metrics.timeouts);
+
+            // zero once the pools and queues have grown to fit, connects and disconnects still allocate
+            log_info("Memory: %llu allocations", (unsigned long long)allocations);
+
+            bytes_encoded = 0;
+            bytes_sent = 0;
+            allocations = 0;
+            full_snapshots = 0;
+            delta_snapshots = 0;
+            snapshot_bytes = 0;
+            truncated_views = 0;
+            truncated_clients = 0;
+            catch_ups = 0;
+            catch_up_messages = 0;
+            compress_bytes_in = 0;
+            compress_bytes_out = 0;
+            compress_ticks = 0;
+            datagrams_out = 0;
+            datagram_messages_out = 0;
+            datagrams_in = 0;
+            datagram_messages_in = 0;
+            fragmented_out = 0;
         }
     }
 
     // close clients
-    for (int i = 0; i < MAX_CLIENTS; i++)
+    while (num_clients > 0)
     {
-        if (clients[i].id != -1)
-        {
-            SDLNet_TCP_DelSocket(socket_set, clients[i].socket);
-            SDLNet_TCP_Close(clients[i].socket);
+        close_client(&clients[active_clients[num_clients - 1]]);
+    }
 
-            clients[i].id = -1;
-            clients[i].socket = NULL;
-        }
+    // stop the I/O threads once they have been told to close their connections
+    for (int i = 0; i < num_io_threads; i++)
+    {
+        io_stop(io_threads[i]);
+    }
+
+    // every buffer has been given back now that the queues holding them are gone
+    SDLNet_FreePool(buffer_pool);
+
+    for (int i = 0; i < client_capacity; i++)
+    {
+        SDL_free(clients[i].batch);
     }
 
+    SDL_free(clients);
+    SDL_free(free_slots);
+    SDL_free(active_clients);
+    SDL_free(pending_clients);
+    SDL_free(world);
+    interest_grid_free(&interest_grid);
+
     // close SDL_net
-    SDLNet_UDP_DelSocket(socket_set, udp_socket);
-    SDLNet_TCP_DelSocket(socket_set, tcp_socket);
-    SDLNet_FreeSocketSet(socket_set);
-    SDLNet_UDP_FreePacket(udp_packet);
-    SDLNet_UDP_Close(udp_socket);
-    SDLNet_TCP_FreePacket(tcp_packet);
+    if (metrics_port != 0)
+    {
+        metrics_server_close(&metrics_server, poller);
+    }
+    SDLNet_PollerDel(poller, wakeup->socket);
+    if (!reuse_port)
+    {
+        SDLNet_PollerDel(poller, udp_socket);
+    }
+    SDLNet_PollerDel(poller, tcp_socket);
+    SDLNet_FreePoller(poller);
+    SDLNet_FreeWakeup(wakeup);
+    compressor_free(compressor);
+    SDLNet_UDP_FreePacket(udp_reply);
+    SDLNet_FreePacketV(udp_send_packets);
+    SDLNet_FreePacketV(udp_packets);
+    for (int i = 0; i < num_udp_sockets; i++)
+    {
+        SDLNet_UDP_Close(udp_sockets[i]);
+    }
     SDLNet_TCP_Close(tcp_socket);
     SDLNet_Quit();
 
@@ -0,0 +1,392 @@
+// tests of the wire format at its limits, run with `make test`
+//
+// Every message is checked to come back out of the decoder as it went in, values out of range to be
+// clamped or refused, and every truncated or malformed buffer to be rejected rather than misread.
+// Each failed check prints its line, and the exit status is the number of failures.
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "data.h"
+
+static int failures;
+
+#define CHECK(condition)                                              \
+    do                                                                \
+    {                                                                 \
+        if (!(condition))                                             \
+        {                                                             \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+            failures++;                                               \
+        }                                                             \
+    } while (0)
+
+// builds malformed messages a field at a time, most significant bit first like the encoder
+struct bits
+{
+    unsigned char buffer[64];
+    int num_bits;
+};
+
+static void put_bits(struct bits *bits, unsigned int value, int count)
+{
+    for (int i = count - 1; i >= 0; i--)
+    {
+        if (value >> i & 1)
+        {
+            bits->buffer[bits->num_bits / 8] |= (unsigned char)(0x80 >> bits->num_bits % 8);
+        }
+        bits->num_bits++;
+    }
+}
+
+static int bits_len(const struct bits *bits)
+{
+    return (bits->num_bits + 7) / 8;
+}
+
+// encodes the message and decodes it back, the whole buffer has to be used
+static int round_trip(const struct data *data, union data_any *decoded, unsigned char *buffer, int size)
+{
+    int len = data_encode(data, buffer, size);
+    if (len == -1 || data_decode(decoded, buffer, len) != len)
+    {
+        return -1;
+    }
+    return len;
+}
+
+// no prefix of an encoding is a whole message
+static bool rejects_truncated(const struct data *data)
+{
+    unsigned char buffer[DATA_MAX_ENCODED_SIZE];
+    int len = data_encode(data, buffer, sizeof(buffer));
+    for (int i = 0; i < len; i++)
+    {
+        union data_any decoded;
+        if (data_decode(&decoded, buffer, i) != -1)
+        {
+            printf("a %s cut to %d of its %d bytes decoded\n", data_type_name(data->type), i, len);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_coordinates(void)
+{
+    unsigned char buffer[DATA_MAX_ENCODED_SIZE];
+    union data_any decoded;
+
+    // the corners of the world are sent as they are
+    struct mouse_data mouse_data = mouse_data_create(DATA_MOUSEDOWN_REQUEST, 1, 0, 0);
+    CHECK(round_trip(&mouse_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+    CHECK(decoded.mouse_data.x == 0 && decoded.mouse_data.y == 0);
+
+    mouse_data = mouse_data_create(DATA_MOUSEDOWN_REQUEST, 1, WORLD_WIDTH - 1, WORLD_HEIGHT - 1);
+    CHECK(round_trip(&mouse_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+    CHECK(decoded.mouse_data.x == WORLD_WIDTH - 1 && decoded.mouse_data.y == WORLD_HEIGHT - 1);
+
+    // and anything outside it is clamped to the nearest edge
+    mouse_data = mouse_data_create(DATA_MOUSEDOWN_BROADCAST, 1, -1, WORLD_HEIGHT);
+    CHECK(round_trip(&mouse_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+    CHECK(decoded.mouse_data.x == 0 && decoded.mouse_data.y == WORLD_HEIGHT - 1);
+
+    mouse_data = mouse_data_create(DATA_MOUSEDOWN_BROADCAST, 1, WORLD_WIDTH, INT_MIN);
+    CHECK(round_trip(&mouse_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+    CHECK(decoded.mouse_data.x == WORLD_WIDTH - 1 && decoded.mouse_data.y == 0);
+
+    struct input_data input_data = input_data_create(DATA_INPUT_REQUEST, 1, INT_MAX, -100, 0x1F);
+    CHECK(round_trip(&input_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+    CHECK(decoded.input_data.x == WORLD_WIDTH - 1 && decoded.input_data.y == 0);
+    CHECK(decoded.input_data.buttons == 0x1F);
+
+    struct snapshot_data snapshot_data = snapshot_data_create(DATA_SNAPSHOT, 1, 0);
+    snapshot_data.num_clients = 2;
+    snapshot_data.clients[0] = (struct client_state){1, -1, -1, 0};
+    snapshot_data.clients[1] = (struct client_state){2, WORLD_WIDTH + 1, WORLD_HEIGHT + 1, 0};
+    CHECK(round_trip(&snapshot_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+    CHECK(decoded.snapshot_data.clients[0].x == 0 && decoded.snapshot_data.clients[0].y == 0);
+    CHECK(decoded.snapshot_data.clients[1].x == WORLD_WIDTH - 1);
+    CHECK(decoded.snapshot_data.clients[1].y == WORLD_HEIGHT - 1);
+}
+
+static void test_ids(void)
+{
+    unsigned char buffer[DATA_MAX_ENCODED_SIZE];
+    union data_any decoded;
+
+    // generations at the edges of the varint's groups of three bits, up to the largest an int holds
+    static const int generations[] = {0, 1, 7, 8, 63, 64, 511, 512, 4095, 4096, 0x7FFF};
+    for (int i = 0; i < (int)(sizeof(generations) / sizeof(generations[0])); i++)
+    {
+        int id = generations[i] << DATA_ID_SLOT_BITS | 0xFFFF;
+        struct id_data id_data = id_data_create(DATA_CONNECT_BROADCAST, id);
+        int len = round_trip(&id_data.data, &decoded, buffer, sizeof(buffer));
+        CHECK(len != -1);
+        CHECK(decoded.id_data.id == id);
+        CHECK(len * 8 >= DATA_TYPE_BITS + data_id_bits(id) && (len - 1) * 8 < DATA_TYPE_BITS + data_id_bits(id));
+        CHECK(rejects_truncated(&id_data.data));
+    }
+
+    struct id_data id_data = id_data_create(DATA_DISCONNECT_BROADCAST, INT_MAX);
+    CHECK(round_trip(&id_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+    CHECK(decoded.id_data.id == INT_MAX);
+
+    // a generation past that would decode to a negative ID
+    struct bits bits = {{0}, 0};
+    put_bits(&bits, DATA_DISCONNECT_BROADCAST, DATA_TYPE_BITS);
+    put_bits(&bits, 0, DATA_ID_SLOT_BITS);
+    for (int i = 0; i < 5; i++)
+    {
+        put_bits(&bits, 0x8, 4);
+    }
+    put_bits(&bits, 0x1, 4);
+    CHECK(data_decode(&decoded, bits.buffer, bits_len(&bits)) == -1);
+
+    // as would one with more than 32 bits, the eleventh group of three has only two left to fill
+    bits = (struct bits){{0}, 0};
+    put_bits(&bits, DATA_DISCONNECT_BROADCAST, DATA_TYPE_BITS);
+    put_bits(&bits, 0, DATA_ID_SLOT_BITS);
+    for (int i = 0; i < 10; i++)
+    {
+        put_bits(&bits, 0x8, 4);
+    }
+    put_bits(&bits, 0x4, 4);
+    CHECK(data_decode(&decoded, bits.buffer, bits_len(&bits)) == -1);
+}
+
+static void test_chat(void)
+{
+    unsigned char buffer[DATA_MAX_ENCODED_SIZE];
+    union data_any decoded;
+
+    // the longest chat there is, its length takes two groups of the varint
+    char message[MAX_STRLEN + 16];
+    memset(message, 'a', sizeof(message) - 1);
+    message[MAX_STRLEN - 1] = '\0';
+    struct chat_data chat_data = chat_data_create(DATA_CHAT_REQUEST, 1, message);
+    CHECK(chat_data.length == MAX_STRLEN - 1);
+    CHECK(round_trip(&chat_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+    CHECK(decoded.chat_data.length == MAX_STRLEN - 1);
+    CHECK(memcmp(decoded.chat_data.message, message, MAX_STRLEN - 1) == 0);
+    CHECK(rejects_truncated(&chat_data.data));
+
+    // longer text is cut to it
+    message[MAX_STRLEN - 1] = 'a';
+    message[sizeof(message) - 1] = '\0';
+    chat_data = chat_data_create(DATA_CHAT_BROADCAST, 1, message);
+    CHECK(chat_data.length == MAX_STRLEN - 1);
+    CHECK(round_trip(&chat_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+    CHECK(decoded.chat_data.length == MAX_STRLEN - 1);
+
+    chat_data = chat_data_create(DATA_CHAT_BROADCAST, 1, "");
+    CHECK(round_trip(&chat_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+    CHECK(decoded.chat_data.length == 0);
+
+    // a length of one more than fits is refused, even with the bytes there
+    struct bits bits = {{0}, 0};
+    put_bits(&bits, DATA_CHAT_BROADCAST, DATA_TYPE_BITS);
+    put_bits(&bits, 1, DATA_ID_SLOT_BITS);
+    put_bits(&bits, 0, 4);
+    put_bits(&bits, 0x80 | (MAX_STRLEN & 0x7F), 8);
+    put_bits(&bits, MAX_STRLEN >> 7, 8);
+    int len = bits_len(&bits);
+    unsigned char long_chat[64 + MAX_STRLEN];
+    memcpy(long_chat, bits.buffer, len);
+    memset(long_chat + len, 'a', MAX_STRLEN);
+    CHECK(data_decode(&decoded, long_chat, len + MAX_STRLEN) == -1);
+
+    // and so is one longer than what's left of the buffer
+    bits = (struct bits){{0}, 0};
+    put_bits(&bits, DATA_CHAT_BROADCAST, DATA_TYPE_BITS);
+    put_bits(&bits, 1, DATA_ID_SLOT_BITS);
+    put_bits(&bits, 0, 4);
+    put_bits(&bits, 4, 8);
+    len = bits_len(&bits);
+    memcpy(long_chat, bits.buffer, len);
+    memcpy(long_chat + len, "abc", 3);
+    CHECK(data_decode(&decoded, long_chat, len + 3) == -1);
+}
+
+static void test_challenge(void)
+{
+    unsigned char buffer[DATA_MAX_ENCODED_SIZE];
+    union data_any decoded;
+
+    // asking for a cookie takes as many bytes as the answer
+    struct challenge_data challenge_data = challenge_data_create(DATA_CHALLENGE, 0);
+    int request_len = round_trip(&challenge_data.data, &decoded, buffer, sizeof(buffer));
+    CHECK(request_len != -1);
+    CHECK(decoded.challenge_data.cookie == 0);
+
+    challenge_data = challenge_data_create(DATA_CHALLENGE, UINT_MAX);
+    CHECK(round_trip(&challenge_data.data, &decoded, buffer, sizeof(buffer)) == request_len);
+    CHECK(decoded.challenge_data.cookie == UINT_MAX);
+    CHECK(rejects_truncated(&challenge_data.data));
+
+    // and the connect request carries it back
+    struct connect_data connect_data = connect_data_create(DATA_CONNECT_REQUEST, 0, DATA_FEATURE_COMPRESSION);
+    connect_data.cookie = 0x89ABCDEF;
+    CHECK(round_trip(&connect_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+    CHECK(decoded.connect_data.cookie == 0x89ABCDEF);
+    CHECK(decoded.connect_data.features == DATA_FEATURE_COMPRESSION);
+    CHECK(rejects_truncated(&connect_data.data));
+
+    // as do the response's token and the UDP connect request that proves it with it
+    connect_data = connect_data_create(DATA_CONNECT_OK, INT_MAX, DATA_FEATURE_COMPRESSION);
+    connect_data.cookie = UINT_MAX;
+    CHECK(round_trip(&connect_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+    CHECK(decoded.connect_data.id == INT_MAX && decoded.connect_data.cookie == UINT_MAX);
+
+    connect_data = connect_data_create(DATA_UDP_CONNECT_REQUEST, 65537, 0);
+    connect_data.cookie = 0x01234567;
+    CHECK(round_trip(&connect_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+    CHECK(decoded.connect_data.id == 65537 && decoded.connect_data.cookie == 0x01234567);
+    CHECK(rejects_truncated(&connect_data.data));
+}
+
+static void test_varints(void)
+{
+    unsigned char buffer[DATA_MAX_ENCODED_SIZE];
+    union data_any decoded;
+
+    // sequences and times at the edges of the varint's groups of seven bits
+    static const unsigned int values[] = {
+        0, 1, 127, 128, 16383, 16384, 2097151, 2097152, 268435455, 268435456, UINT_MAX};
+    for (int i = 0; i < (int)(sizeof(values) / sizeof(values[0])); i++)
+    {
+        struct snapshot_data snapshot_data = snapshot_data_create(DATA_SNAPSHOT, values[i], UINT_MAX - values[i]);
+        snapshot_data.num_clients = 0;
+        CHECK(round_trip(&snapshot_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+        CHECK(decoded.snapshot_data.sequence == values[i]);
+        CHECK(decoded.snapshot_data.time == UINT_MAX - values[i]);
+        CHECK(rejects_truncated(&snapshot_data.data));
+    }
+
+    // the fifth group of seven can only fill the top four bits of 32
+    struct bits bits = {{0}, 0};
+    put_bits(&bits, DATA_SNAPSHOT, DATA_TYPE_BITS);
+    for (int i = 0; i < 4; i++)
+    {
+        put_bits(&bits, 0xFF, 8);
+    }
+    put_bits(&bits, 0x0F, 8);
+    put_bits(&bits, 0, 8);
+    put_bits(&bits, 0, DATA_COUNT_BITS);
+    CHECK(data_decode(&decoded, bits.buffer, bits_len(&bits)) == bits_len(&bits));
+    CHECK(decoded.snapshot_data.sequence == UINT_MAX);
+
+    bits = (struct bits){{0}, 0};
+    put_bits(&bits, DATA_SNAPSHOT, DATA_TYPE_BITS);
+    for (int i = 0; i < 4; i++)
+    {
+        put_bits(&bits, 0xFF, 8);
+    }
+    put_bits(&bits, 0x1F, 8);
+    put_bits(&bits, 0, 8);
+    put_bits(&bits, 0, DATA_COUNT_BITS);
+    CHECK(data_decode(&decoded, bits.buffer, bits_len(&bits)) == -1);
+
+    // and never has a sixth after it
+    bits = (struct bits){{0}, 0};
+    put_bits(&bits, DATA_SNAPSHOT, DATA_TYPE_BITS);
+    for (int i = 0; i < 5; i++)
+    {
+        put_bits(&bits, 0x80, 8);
+    }
+    put_bits(&bits, 0, 8);
+    put_bits(&bits, 0, 8);
+    put_bits(&bits, 0, DATA_COUNT_BITS);
+    CHECK(data_decode(&decoded, bits.buffer, bits_len(&bits)) == -1);
+}
+
+static void test_malformed(void)
+{
+    union data_any decoded;
+
+    CHECK(data_decode(&decoded, NULL, 0) == -1);
+    CHECK(data_peek_type(NULL, 0) == -1);
+
+    // tags past the last type
+    for (int type = DATA_NUM_TYPES; type < 1 << DATA_TYPE_BITS; type++)
+    {
+        unsigned char buffer[8] = {DATA_TAG(type)};
+        CHECK(data_decode(&decoded, buffer, sizeof(buffer)) == -1);
+    }
+
+    // more clients than a snapshot holds
+    struct bits bits = {{0}, 0};
+    put_bits(&bits, DATA_SNAPSHOT, DATA_TYPE_BITS);
+    put_bits(&bits, 0, 8);
+    put_bits(&bits, 0, 8);
+    put_bits(&bits, SNAPSHOT_MAX_CLIENTS + 1, DATA_COUNT_BITS);
+    unsigned char snapshot[DATA_MAX_ENCODED_SIZE + 64] = {0};
+    memcpy(snapshot, bits.buffer, bits_len(&bits));
+    CHECK(data_decode(&decoded, snapshot, sizeof(snapshot)) == -1);
+
+    // every message with a field of each kind, cut short anywhere
+    struct snapshot_data baseline = snapshot_data_create(DATA_SNAPSHOT, 1, 100);
+    baseline.num_clients = 3;
+    for (int i = 0; i < baseline.num_clients; i++)
+    {
+        baseline.clients[i] = (struct client_state){(1 << DATA_ID_SLOT_BITS) | i, i * 100, i * 50, 0};
+    }
+    struct snapshot_data snapshot_data = baseline;
+    snapshot_data.sequence = 2;
+    snapshot_data.clients[1].x++;
+    snapshot_data.num_clients--;
+
+    struct catch_up_data catch_up_data = catch_up_data_create(DATA_CATCH_UP);
+    catch_up_data.num_clients = 2;
+    catch_up_data.clients[0] = 1;
+    catch_up_data.clients[1] = 1 << DATA_ID_SLOT_BITS;
+    catch_up_data.num_chats = 1;
+    catch_up_data.chats[0] = chat_data_create(DATA_CHAT_BROADCAST, 1, "Hello, World!");
+
+    struct connect_data connect_data = connect_data_create(DATA_CONNECT_OK, 65537, DATA_FEATURE_COMPRESSION);
+    struct ack_data ack_data = ack_data_create(DATA_SNAPSHOT_ACK, 65537, 300);
+    struct ping_data ping_data = ping_data_create(DATA_PONG, 65537, 123456, 654321);
+    struct delta_data delta_data = delta_data_create(DATA_SNAPSHOT_DELTA, &baseline, &snapshot_data);
+    struct mouse_data mouse_data = mouse_data_create(DATA_MOUSEDOWN_BROADCAST, 65537, 400, 300);
+    struct input_data input_data = input_data_create(DATA_INPUT_REQUEST, 65537, 400, 300, 1);
+
+    CHECK(rejects_truncated(&connect_data.data));
+    CHECK(rejects_truncated(&ack_data.data));
+    CHECK(rejects_truncated(&ping_data.data));
+    CHECK(rejects_truncated(&snapshot_data.data));
+    CHECK(rejects_truncated(&delta_data.data));
+    CHECK(rejects_truncated(&catch_up_data.data));
+    CHECK(rejects_truncated(&mouse_data.data));
+    CHECK(rejects_truncated(&input_data.data));
+
+    // and the delta still applies to its baseline once it's decoded
+    unsigned char buffer[DATA_MAX_ENCODED_SIZE];
+    struct snapshot_data applied;
+    CHECK(round_trip(&delta_data.data, &decoded, buffer, sizeof(buffer)) != -1);
+    CHECK(snapshot_apply(&applied, &baseline, &decoded.delta_data) != -1);
+    CHECK(applied.num_clients == snapshot_data.num_clients);
+    CHECK(memcmp(applied.clients, snapshot_data.clients, snapshot_data.num_clients * sizeof(struct client_state)) == 0);
+}
+
+int main(int argc, char *argv[])
+{
+    test_coordinates();
+    test_ids();
+    test_chat();
+    test_challenge();
+    test_varints();
+    test_malformed();
+
+    if (failures)
+    {
+        printf("%d checks failed\n", failures);
+    }
+    else
+    {
+        printf("All checks passed\n");
+    }
+
+    return failures;
+}